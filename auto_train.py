@@ -4,6 +4,7 @@ import random
 import sys
 
 SERVER_URL = "http://localhost:8080/search"
+BATCH_URL = SERVER_URL + "/batch"
 CSV_PATH = "data/wiki_movie_plots_deduped.csv"
 NUM_SAMPLES = 100
 
@@ -23,29 +24,29 @@ def load_dataset():
     return dataset
 
 def evaluate(dataset, k1, b, w_title):
+    # Все запросы точки сетки - одним запросом к /search/batch.
+    try:
+        resp = requests.post(BATCH_URL, json={
+            "queries": [title for _, title in dataset],
+            "k1": k1,
+            "b": b,
+            "w_title": w_title
+        }, timeout=30)
+        if resp.status_code != 200: return 0.0
+        batch = resp.json()
+    except:
+        return 0.0
+
     hits = 0
     total = 0
-    
-    for target_id, title in dataset:
-        try:
-            resp = requests.get(SERVER_URL, params={
-                "q": title, 
-                "k1": k1, 
-                "b": b, 
-                "w_title": w_title
-            }, timeout=1)
-            
-            if resp.status_code != 200: continue
-            results = resp.json()
-            if not results: continue
+    for (target_id, title), results in zip(dataset, batch):
+        if not results: continue
 
-            total += 1
-            if results[0]['id'] == target_id:
-                hits += 1
-            elif results[0]['title'].strip().lower() == title.strip().lower():
-                hits += 1
-        except:
-            continue
+        total += 1
+        if results[0]['id'] == target_id:
+            hits += 1
+        elif results[0]['title'].strip().lower() == title.strip().lower():
+            hits += 1
 
     if total == 0: return 0.0
     return (hits / total) * 100
@@ -0,0 +1,149 @@
+#pragma once
+// Детерминированный синтетический корпус для бенчмарков: слова выбираются по
+// закону Ципфа (частота слова ранга r пропорциональна 1 / (r + 1)^s), самые
+// частые ранги - настоящие стоп-слова, остальные - псевдослова из слогов.
+// Генератор случайных чисел и все распределения свои (splitmix64), поэтому при
+// одинаковом seed корпус совпадает байт в байт на любой платформе и стандартной
+// библиотеке. write_csv пишет корпус в формате wiki_movie_plots_deduped.csv.
+#include "Document.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class SyntheticCorpus {
+public:
+    struct Options {
+        size_t num_docs = 20000;
+        size_t vocab_size = 50000;
+        double zipf_s = 1.0;
+        size_t min_title_words = 1;
+        size_t max_title_words = 6;
+        size_t min_plot_words = 20;
+        size_t max_plot_words = 400;
+        uint64_t seed = 42;
+    };
+
+    class Rng {
+    public:
+        explicit Rng(uint64_t seed) : state_(seed) {}
+
+        uint64_t next() {
+            uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+        // Равномерно в [0, 1).
+        double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+        // Равномерно в [lo, hi].
+        size_t range(size_t lo, size_t hi) { return lo + next() % (hi - lo + 1); }
+
+    private:
+        uint64_t state_;
+    };
+
+    explicit SyntheticCorpus(const Options& options) : options_(options) {
+        options_.vocab_size = std::max(options_.vocab_size, std::size(kStopWords) + 1);
+        cdf_.resize(options_.vocab_size);
+        double sum = 0.0;
+        for (size_t r = 0; r < options_.vocab_size; ++r) cdf_[r] = sum += 1.0 / std::pow(r + 1.0, options_.zipf_s);
+        for (double& c : cdf_) c /= sum;
+        words_.reserve(options_.vocab_size);
+        for (size_t r = 0; r < options_.vocab_size; ++r) words_.push_back(make_word(r));
+    }
+
+    const Options& options() const { return options_; }
+    const std::string& word(size_t rank) const { return words_[rank]; }
+    size_t vocab_size() const { return words_.size(); }
+    // Ранги меньше этого - стоп-слова токенизатора и близкие к ним.
+    static constexpr size_t first_content_rank() { return std::size(kStopWords); }
+
+    size_t sample_rank(Rng& rng) const {
+        return std::upper_bound(cdf_.begin(), cdf_.end() - 1, rng.uniform()) - cdf_.begin();
+    }
+    // Ранг не из стоп-слов - для терминов запросов.
+    size_t sample_content_rank(Rng& rng) const {
+        while (true) {
+            size_t r = sample_rank(rng);
+            if (r >= first_content_rank()) return r;
+        }
+    }
+
+    std::vector<Document> generate() const {
+        Rng rng(options_.seed);
+        std::vector<Document> docs;
+        docs.reserve(options_.num_docs);
+        for (size_t i = 0; i < options_.num_docs; ++i) {
+            Document doc{static_cast<DocId>(i), {}, {}};
+            doc.title = text(rng, rng.range(options_.min_title_words, options_.max_title_words), true);
+            doc.plot = text(rng, rng.range(options_.min_plot_words, options_.max_plot_words), false);
+            docs.push_back(std::move(doc));
+        }
+        return docs;
+    }
+
+    // Колонки как в исходном датасете; индексатор берёт из них название (1) и сюжет (7).
+    static void write_csv(const std::vector<Document>& docs, const std::string& path) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) throw std::runtime_error("Cannot create " + path);
+        out << "Release Year,Title,Origin/Ethnicity,Director,Cast,Genre,Wiki Page,Plot\n";
+        for (const auto& doc : docs) {
+            out << 1900 + doc.id % 120 << ',' << quote(doc.title) << ",American,Unknown,,drama,"
+                << "https://en.wikipedia.org/wiki/Synthetic_" << doc.id << ',' << quote(doc.plot) << '\n';
+        }
+        if (!out) throw std::runtime_error("Failed to write " + path);
+    }
+
+private:
+    static constexpr const char* kStopWords[] = {"the", "a", "of", "and", "in", "he", "is", "to", "his", "with",
+                                                 "her", "she", "was", "for", "on", "they", "an", "it", "but", "are"};
+
+    static std::string make_word(size_t rank) {
+        if (rank < std::size(kStopWords)) return kStopWords[rank];
+        static constexpr char kConsonants[] = "bcdfghklmnprstvz";
+        static constexpr char kVowels[] = "aeiou";
+        constexpr size_t kSyllables = (sizeof(kConsonants) - 1) * (sizeof(kVowels) - 1);
+        std::string w;
+        size_t n = rank - std::size(kStopWords);
+        // Не меньше двух слогов, чтобы псевдослова не совпадали со стоп-словами.
+        for (size_t i = 0; i < 2 || n > 0; ++i, n /= kSyllables) {
+            size_t s = n % kSyllables;
+            w += kConsonants[s / (sizeof(kVowels) - 1)];
+            w += kVowels[s % (sizeof(kVowels) - 1)];
+        }
+        return w;
+    }
+
+    std::string text(Rng& rng, size_t num_words, bool title) const {
+        std::string out;
+        for (size_t i = 0; i < num_words; ++i) {
+            if (i > 0) out += ' ';
+            std::string w = words_[sample_rank(rng)];
+            double r = rng.uniform();
+            if (title || r < 0.05) w[0] = static_cast<char>(w[0] - 'a' + 'A');
+            if (r < 0.01) w = std::to_string(1900 + rng.range(0, 120));
+            else if (r < 0.04) w += ',';
+            else if (r < 0.06) w += "'s";
+            else if (r < 0.08 && !title) w += '.';
+            out += w;
+        }
+        return out;
+    }
+
+    static std::string quote(const std::string& s) {
+        std::string q = "\"";
+        for (char c : s) {
+            if (c == '"') q += '"';
+            q += c;
+        }
+        return q + '"';
+    }
+
+    Options options_;
+    std::vector<double> cdf_;
+    std::vector<std::string> words_;
+};
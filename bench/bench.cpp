@@ -0,0 +1,485 @@
+// Набор бенчмарков на синтетическом корпусе (SyntheticCorpus):
+//   micro - токенизация, varint, ядра пересечения, объединение и AND NOT над
+//           DocSet, NEAR/ADJ, Ranker::score;
+//   macro - построение индекса (один поток, несколько потоков, SPIMI), запись,
+//           загрузка и распределение задержек запросов по классам.
+// Результаты печатаются таблицей; --json пишет их в файл, --compare сравнивает
+// с таким файлом от прошлого запуска. Мерить стоит в Release-сборке.
+//
+// Запуск: ./bench [--docs N] [--vocab N] [--seed S] [--queries N] [--filter STR]
+//                 [--temp-dir DIR] [--json FILE] [--compare FILE]
+//         ./bench --write-csv FILE [--docs N] [--vocab N] [--seed S]
+#include "DocSet.h"
+#include "Encoding.h"
+#include "Index.h"
+#include "Intersect.h"
+#include "Parallel.h"
+#include "Ranker.h"
+#include "SearchEngine.h"
+#include "SpimiIndexer.h"
+#include "SyntheticCorpus.h"
+#include "Tokenizer.h"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    SyntheticCorpus::Options corpus;
+    size_t queries = 200;
+    std::string filter;
+    std::string temp_dir;
+    std::string json_path;
+    std::string compare_path;
+    std::string csv_path;
+};
+
+struct Result {
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+class Report {
+public:
+    explicit Report(std::string filter) : filter_(std::move(filter)) {}
+
+    bool enabled(const std::string& group) const {
+        return filter_.empty() || group.find(filter_) != std::string::npos;
+    }
+
+    void add(const std::string& name, double value, const std::string& unit) {
+        results_.push_back({name, value, unit});
+        std::printf("%-44s %14.3f %s\n", name.c_str(), value, unit.c_str());
+        std::fflush(stdout);
+    }
+
+    json to_json(const Options& opt) const {
+        json results = json::array();
+        for (const auto& r : results_) results.push_back({{"name", r.name}, {"value", r.value}, {"unit", r.unit}});
+        return {{"config", {{"docs", opt.corpus.num_docs}, {"vocab", opt.corpus.vocab_size},
+                            {"zipf_s", opt.corpus.zipf_s}, {"seed", opt.corpus.seed}, {"queries", opt.queries},
+                            {"threads", default_num_threads()}}},
+                {"results", results}};
+    }
+
+    // Отношение к прошлому запуску: для единиц "в секунду" больше - лучше, иначе меньше.
+    void compare(const json& base) const {
+        std::map<std::string, double> old;
+        for (const auto& r : base.at("results")) old[r.at("name").get<std::string>()] = r.at("value").get<double>();
+        std::printf("\n%-44s %14s %14s %8s\n", "benchmark", "base", "current", "change");
+        for (const auto& r : results_) {
+            auto it = old.find(r.name);
+            if (it == old.end() || it->second == 0) continue;
+            double change = r.value / it->second - 1;
+            bool higher_better = r.unit.find("/s") != std::string::npos;
+            bool worse = higher_better ? change < -0.1 : change > 0.1;
+            std::printf("%-44s %14.3f %14.3f %+7.1f%%%s\n", r.name.c_str(), it->second, r.value, change * 100,
+                        worse ? "  <-- worse" : "");
+        }
+    }
+
+private:
+    std::string filter_;
+    std::vector<Result> results_;
+};
+
+template <typename F>
+double best_seconds(F&& f, int reps = 5) {
+    double best = 1e100;
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+double elapsed_seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+volatile size_t g_sink;
+
+// n различных DocId из [0, universe), отсортированных.
+DocList random_list(size_t n, uint32_t universe, SyntheticCorpus::Rng& rng) {
+    std::vector<bool> taken(universe);
+    DocList docs;
+    docs.reserve(n);
+    while (docs.size() < n) {
+        uint32_t id = static_cast<uint32_t>(rng.next() % universe);
+        if (!taken[id]) {
+            taken[id] = true;
+            docs.push_back(id);
+        }
+    }
+    std::sort(docs.begin(), docs.end());
+    return docs;
+}
+
+void bench_tokenize(Report& report, const std::vector<Document>& docs) {
+    Tokenizer tokenizer;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t n = std::min<size_t>(docs.size(), 2000);
+    for (size_t i = 0; i < n; ++i) bytes += docs[i].plot.size();
+    double sec = best_seconds([&] {
+        tokens = 0;
+        for (size_t i = 0; i < n; ++i) tokens += tokenizer.tokenize(docs[i].plot).size();
+        g_sink = tokens;
+    });
+    report.add("micro/tokenize/throughput", bytes / sec / 1e6, "MB/s");
+    report.add("micro/tokenize/per_token", sec / tokens * 1e9, "ns");
+
+    // Без строк на токен: буфер переиспользуется, как в индексаторе.
+    TokenBuffer buffer;
+    double views = best_seconds([&] {
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            tokenizer.tokenize(docs[i].plot, buffer);
+            count += buffer.tokens.size();
+        }
+        g_sink = count;
+    });
+    report.add("micro/tokenize/views_throughput", bytes / views / 1e6, "MB/s");
+}
+
+void bench_varint(Report& report, SyntheticCorpus::Rng& rng) {
+    // Разности DocId и tf: в основном маленькие числа с редкими большими.
+    std::vector<uint32_t> values(1 << 20);
+    for (auto& v : values) v = static_cast<uint32_t>(rng.next() >> (40 + rng.next() % 24));
+    std::string buf;
+    double enc = best_seconds([&] {
+        buf.clear();
+        for (uint32_t v : values) append_varint(buf, v);
+    });
+    std::vector<uint32_t> out(values.size());
+    double dec = best_seconds([&] {
+        const auto* p = reinterpret_cast<const uint8_t*>(buf.data());
+        const auto* end = p + buf.size();
+        for (auto& v : out) v = static_cast<uint32_t>(read_varint(p, end));
+    });
+    if (out != values) throw std::runtime_error("varint round trip mismatch");
+    report.add("micro/varint/encode", enc / values.size() * 1e9, "ns/int");
+    report.add("micro/varint/decode", dec / values.size() * 1e9, "ns/int");
+    report.add("micro/varint/bytes_per_int", static_cast<double>(buf.size()) / values.size(), "bytes");
+}
+
+void bench_intersect(Report& report, SyntheticCorpus::Rng& rng) {
+    const uint32_t universe = 1 << 22;
+    DocList large = random_list(1 << 18, universe, rng);
+    DocList out(large.size());
+    const intersect::Kernel kernels[] = {intersect::Kernel::kScalarMerge, intersect::Kernel::kSseMerge,
+                                         intersect::Kernel::kAvx2Merge, intersect::Kernel::kGallop};
+    for (size_t ratio : {1, 16, 256}) {
+        DocList small = random_list(large.size() / ratio, universe, rng);
+        std::string prefix = "micro/intersect/ratio" + std::to_string(ratio) + "/";
+        for (auto kernel : kernels) {
+            double sec = best_seconds([&] {
+                g_sink = intersect::intersect(kernel, small.data(), small.size(), large.data(), large.size(), out.data());
+            });
+            report.add(prefix + intersect::kernel_name(kernel), sec * 1e6, "us");
+        }
+        double sec = best_seconds([&] {
+            g_sink = intersect::intersect(small.data(), small.size(), large.data(), large.size(), out.data());
+        });
+        report.add(prefix + "auto", sec * 1e6, "us");
+    }
+}
+
+// Пути DocSet, через которые выполняются AND / OR / AND NOT булевых запросов:
+// список со списком, список с битмапом, битмап с битмапом.
+void bench_docset(Report& report, SyntheticCorpus::Rng& rng) {
+    const uint32_t universe = 1 << 20;
+    DocList sparse_a = random_list(universe / 256, universe, rng);
+    DocList sparse_b = random_list(universe / 64, universe, rng);
+    DocList dense_a = random_list(universe / 4, universe, rng);
+    DocList dense_b = random_list(universe / 8, universe, rng);
+    struct Pair {
+        const char* name;
+        const DocList& a;
+        const DocList& b;
+    };
+    const Pair pairs[] = {{"list_list", sparse_a, sparse_b},
+                          {"list_bitmap", sparse_b, dense_a},
+                          {"bitmap_bitmap", dense_a, dense_b}};
+    for (const auto& [name, a_list, b_list] : pairs) {
+        DocSet a = DocSet::from_list(a_list, universe);
+        DocSet b = DocSet::from_list(b_list, universe);
+        std::string suffix = std::string("/") + name;
+        report.add("micro/docset/and" + suffix,
+                   best_seconds([&] { g_sink = DocSet::intersect(a, b).size(); }) * 1e6, "us");
+        report.add("micro/docset/or" + suffix,
+                   best_seconds([&] { g_sink = DocSet::unite(a, b).size(); }) * 1e6, "us");
+        // Так выполняется x AND NOT y: дополнение не строится, берётся разность.
+        report.add("micro/docset/and_not" + suffix, best_seconds([&] {
+            g_sink = DocSet::intersect(a, DocSet(b).complement()).size();
+        }) * 1e6, "us");
+    }
+}
+
+// Запросы с термами, взятыми из одного документа, чтобы у NEAR / ADJ были совпадения.
+std::pair<std::string, std::string> adjacent_pair(const std::vector<Document>& docs, const Tokenizer& tokenizer,
+                                                  SyntheticCorpus::Rng& rng, size_t gap) {
+    while (true) {
+        const auto& doc = docs[rng.next() % docs.size()];
+        auto tokens = tokenizer.tokenize(doc.plot);
+        if (tokens.size() <= gap) continue;
+        size_t i = rng.next() % (tokens.size() - gap);
+        return {tokens[i], tokens[i + gap]};
+    }
+}
+
+void bench_prox(Report& report, const SearchEngine& engine, const std::vector<Document>& docs,
+                SyntheticCorpus::Rng& rng) {
+    Tokenizer tokenizer;
+    for (const char* op : {"ADJ", "NEAR/5"}) {
+        std::vector<std::string> queries;
+        for (size_t i = 0; i < 100; ++i) {
+            auto [a, b] = adjacent_pair(docs, tokenizer, rng, op[0] == 'A' ? 1 : 3);
+            queries.push_back(a + " " + op + " " + b);
+        }
+        double sec = best_seconds([&] {
+            for (const auto& q : queries) g_sink = engine.search(q).size();
+        }, 3);
+        std::string name = op[0] == 'A' ? "adj" : "near5";
+        report.add("micro/prox/" + name, sec / queries.size() * 1e6, "us/query");
+    }
+}
+
+void bench_ranker(Report& report, const Index& index, const SyntheticCorpus& corpus, SyntheticCorpus::Rng& rng) {
+    Ranker ranker(index, 1.2, 0.75, 5.0);
+    std::vector<Term> terms;
+    for (size_t i = 0; i < 3; ++i) terms.push_back(corpus.word(corpus.sample_content_rank(rng)));
+    auto prepared = ranker.prepare(terms);
+    size_t num_docs = index.get_forward_index().size();
+    double sec = best_seconds([&] {
+        double sum = 0;
+        for (DocId id = 0; id < num_docs; ++id) sum += ranker.score(id, prepared);
+        g_sink = static_cast<size_t>(sum);
+    }, 3);
+    report.add("micro/ranker/score_3_terms", sec / num_docs * 1e9, "ns/doc");
+}
+
+void build_index(Index& index, const std::vector<Document>& docs) {
+    for (const auto& doc : docs) index.add_document(doc);
+    index.build_postings_metadata();
+}
+
+size_t files_size(const std::string& base) {
+    size_t total = 0;
+    for (const char* ext : {".seg", ".store", ".norms"}) {
+        std::error_code ec;
+        auto size = fs::file_size(base + ext, ec);
+        if (!ec) total += size;
+    }
+    return total;
+}
+
+void bench_build(Report& report, const std::vector<Document>& docs, const std::string& dir) {
+    size_t dictionary_bytes = 0;
+    size_t num_terms = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        Index index;
+        build_index(index, docs);
+        dictionary_bytes = index.dictionary_bytes();
+        num_terms = index.num_terms();
+    }
+    double sec = elapsed_seconds(t0);
+    report.add("macro/build/single_thread", sec, "s");
+    report.add("macro/build/single_thread_rate", docs.size() / sec, "docs/s");
+    report.add("macro/build/dictionary_bytes_per_term",
+               static_cast<double>(dictionary_bytes) / std::max<size_t>(1, num_terms), "bytes");
+
+    size_t threads = default_num_threads();
+    t0 = std::chrono::steady_clock::now();
+    {
+        Index index;
+        index.add_documents(docs, threads);
+        index.build_postings_metadata();
+    }
+    report.add("macro/build/threads_" + std::to_string(threads), elapsed_seconds(t0), "s");
+
+    t0 = std::chrono::steady_clock::now();
+    {
+        SpimiIndexer spimi(dir + "/spimi", 64 << 20, dir);
+        for (const auto& doc : docs) spimi.add_document(doc);
+        spimi.finish();
+    }
+    report.add("macro/build/spimi_64mb", elapsed_seconds(t0), "s");
+}
+
+struct QueryClass {
+    std::string name;
+    std::vector<std::string> queries;
+    std::function<void(const SearchEngine&, const std::string&)> run;
+};
+
+std::vector<QueryClass> make_query_classes(const SyntheticCorpus& corpus, const std::vector<Document>& docs,
+                                           size_t n, SyntheticCorpus::Rng& rng) {
+    Tokenizer tokenizer;
+    auto word = [&] { return corpus.word(corpus.sample_content_rank(rng)); };
+    auto top_k = [](const SearchEngine& e, const std::string& q) { g_sink = e.search_top_k(q, 20).size(); };
+    auto ranked_or = [](const SearchEngine& e, const std::string& q) { g_sink = e.search_ranked_or(q, 20).size(); };
+
+    std::vector<QueryClass> classes = {{"term", {}, top_k},  {"and2", {}, top_k}, {"and3", {}, top_k},
+                                       {"or3_boolean", {}, top_k}, {"or3_ranked", {}, ranked_or},
+                                       {"and_not", {}, top_k}, {"adj", {}, top_k}, {"near5", {}, top_k},
+                                       {"field", {}, top_k}, {"title", {}, top_k}};
+    for (size_t i = 0; i < n; ++i) {
+        classes[0].queries.push_back(word());
+        classes[1].queries.push_back(word() + " " + word());
+        classes[2].queries.push_back(word() + " " + word() + " " + word());
+        classes[3].queries.push_back(word() + " OR " + word() + " OR " + word());
+        classes[4].queries.push_back(word() + " " + word() + " " + word());
+        classes[5].queries.push_back(word() + " AND NOT " + word());
+        auto [a, b] = adjacent_pair(docs, tokenizer, rng, 1);
+        classes[6].queries.push_back(a + " ADJ " + b);
+        auto [c, d] = adjacent_pair(docs, tokenizer, rng, 3);
+        classes[7].queries.push_back(c + " NEAR/5 " + d);
+        classes[8].queries.push_back("title:" + word() + " " + word());
+        classes[9].queries.push_back(docs[rng.next() % docs.size()].title);
+    }
+    return classes;
+}
+
+void bench_queries(Report& report, const SearchEngine& engine, const std::vector<QueryClass>& classes) {
+    for (const auto& cls : classes) {
+        std::vector<double> micros;
+        micros.reserve(cls.queries.size());
+        for (const auto& q : cls.queries) {
+            auto t0 = std::chrono::steady_clock::now();
+            cls.run(engine, q);
+            micros.push_back(elapsed_seconds(t0) * 1e6);
+        }
+        std::sort(micros.begin(), micros.end());
+        auto pct = [&](double p) { return micros[std::min(micros.size() - 1, static_cast<size_t>(p * micros.size()))]; };
+        double mean = 0;
+        for (double m : micros) mean += m;
+        mean /= micros.size();
+        std::string prefix = "macro/query/" + cls.name + "/";
+        report.add(prefix + "p50", pct(0.50), "us");
+        report.add(prefix + "p90", pct(0.90), "us");
+        report.add(prefix + "p99", pct(0.99), "us");
+        report.add(prefix + "max", micros.back(), "us");
+        report.add(prefix + "mean", mean, "us");
+    }
+}
+
+void usage(const char* name) {
+    std::cerr << "Usage: " << name << " [--docs N] [--vocab N] [--seed S] [--queries N] [--filter STR]"
+              << " [--temp-dir DIR] [--json FILE] [--compare FILE] [--write-csv FILE]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) { usage(argv[0]); return 1; }
+        std::string value = argv[++i];
+        if (arg == "--docs") opt.corpus.num_docs = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--vocab") opt.corpus.vocab_size = std::stoul(value);
+        else if (arg == "--seed") opt.corpus.seed = std::stoull(value);
+        else if (arg == "--queries") opt.queries = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--filter") opt.filter = value;
+        else if (arg == "--temp-dir") opt.temp_dir = value;
+        else if (arg == "--json") opt.json_path = value;
+        else if (arg == "--compare") opt.compare_path = value;
+        else if (arg == "--write-csv") opt.csv_path = value;
+        else { usage(argv[0]); return 1; }
+    }
+
+    try {
+        SyntheticCorpus corpus(opt.corpus);
+        auto docs = corpus.generate();
+        if (!opt.csv_path.empty()) {
+            SyntheticCorpus::write_csv(docs, opt.csv_path);
+            std::cout << "Wrote " << docs.size() << " documents to " << opt.csv_path << std::endl;
+            return 0;
+        }
+
+        std::string dir = opt.temp_dir.empty() ? fs::temp_directory_path().string() : opt.temp_dir;
+        dir += "/search_bench_" + std::to_string(getpid());
+        fs::create_directories(dir);
+
+        Report report(opt.filter);
+        SyntheticCorpus::Rng rng(opt.corpus.seed ^ 0x5EED);
+        std::printf("corpus: %zu docs, vocabulary %zu, zipf s=%.2f, seed %llu\n", docs.size(),
+                    corpus.vocab_size(), opt.corpus.zipf_s, static_cast<unsigned long long>(opt.corpus.seed));
+
+        if (report.enabled("micro/tokenize")) bench_tokenize(report, docs);
+        if (report.enabled("micro/varint")) bench_varint(report, rng);
+        if (report.enabled("micro/intersect")) bench_intersect(report, rng);
+        if (report.enabled("micro/docset")) bench_docset(report, rng);
+        if (report.enabled("macro/build")) bench_build(report, docs, dir);
+
+        bool need_index = report.enabled("micro/prox") || report.enabled("micro/ranker") ||
+                          report.enabled("macro/save") || report.enabled("macro/load") ||
+                          report.enabled("macro/query");
+        if (need_index) {
+            {
+                Index index;
+                build_index(index, docs);
+                auto t0 = std::chrono::steady_clock::now();
+                index.save(dir + "/index");
+                if (report.enabled("macro/save")) {
+                    report.add("macro/save/time", elapsed_seconds(t0), "s");
+                    report.add("macro/save/size", files_size(dir + "/index") / 1e6, "MB");
+                }
+            }
+            if (report.enabled("macro/load")) {
+                double sec = best_seconds([&] {
+                    Index loaded;
+                    loaded.load(dir + "/index");
+                }, 3);
+                report.add("macro/load/time", sec * 1e3, "ms");
+            }
+
+            Index index;
+            index.load(dir + "/index");
+            SearchEngine engine(index);
+            if (report.enabled("micro/prox")) bench_prox(report, engine, docs, rng);
+            if (report.enabled("micro/ranker")) bench_ranker(report, index, corpus, rng);
+            if (report.enabled("macro/query")) {
+                auto classes = make_query_classes(corpus, docs, opt.queries, rng);
+                // Прогрев: первые обращения распаковывают postings терминов.
+                for (const auto& cls : classes) {
+                    for (const auto& q : cls.queries) cls.run(engine, q);
+                }
+                bench_queries(report, engine, classes);
+            }
+        }
+        fs::remove_all(dir);
+
+        if (!opt.json_path.empty()) {
+            std::ofstream out(opt.json_path);
+            out << report.to_json(opt).dump(2) << '\n';
+            if (!out) throw std::runtime_error("Failed to write " + opt.json_path);
+        }
+        if (!opt.compare_path.empty()) {
+            std::ifstream in(opt.compare_path);
+            if (!in.is_open()) throw std::runtime_error("Cannot open " + opt.compare_path);
+            report.compare(json::parse(in));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
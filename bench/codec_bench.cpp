@@ -0,0 +1,138 @@
+// Микробенчмарк кодеков postings: varint (как в старом .inv) против block_codec.
+// Запуск: ./codec_bench [количество чисел]
+#include "BlockCodec.h"
+#include "Encoding.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace {
+
+struct Dataset {
+    std::string name;
+    std::vector<uint32_t> values;
+    bool sorted;
+};
+
+Dataset make_doc_ids(size_t n, double avg_gap, std::mt19937& rng) {
+    std::geometric_distribution<uint32_t> gap(1.0 / avg_gap);
+    Dataset d{"docids gap~" + std::to_string(static_cast<int>(avg_gap)), {}, true};
+    uint32_t doc = 0;
+    for (size_t i = 0; i < n; ++i) d.values.push_back(doc += gap(rng) + 1);
+    return d;
+}
+
+Dataset make_small(size_t n, double mean, const std::string& name, std::mt19937& rng) {
+    std::geometric_distribution<uint32_t> dist(1.0 / (mean + 1));
+    Dataset d{name, {}, false};
+    for (size_t i = 0; i < n; ++i) d.values.push_back(dist(rng));
+    return d;
+}
+
+template <typename F>
+double best_seconds(F&& f, int reps = 7) {
+    double best = 1e100;
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+void report(const Dataset& d, const char* codec, size_t bytes, double seconds) {
+    std::printf("%-18s %-14s %8.3f bytes/int %10.1f Mint/s\n", d.name.c_str(), codec,
+                static_cast<double>(bytes) / d.values.size(), d.values.size() / seconds / 1e6);
+}
+
+volatile uint32_t g_sink;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? std::stoul(argv[1]) : (1u << 20);
+    // Кратно 128, чтобы сравнивать именно упакованные куски, а не varint-хвост.
+    n -= n % block_codec::kChunkSize;
+    std::mt19937 rng(42);
+    std::vector<Dataset> sets = {make_doc_ids(n, 2, rng), make_doc_ids(n, 16, rng), make_doc_ids(n, 1024, rng),
+                                 make_small(n, 0.3, "tf-1", rng), make_small(n, 40, "position gaps", rng)};
+
+    std::vector<uint32_t> out(n);
+    for (const auto& d : sets) {
+        uint32_t check = d.values.back();
+
+        // Текущий путь .inv: varint по одному байту через std::ifstream::get.
+        {
+            const std::string tmp = "codec_bench.tmp";
+            {
+                std::ofstream f(tmp, std::ios::binary);
+                if (d.sorted) {
+                    write_delta_vector(f, d.values);
+                } else {
+                    write_vector(f, d.values);
+                }
+            }
+            size_t bytes = 0;
+            double sec = best_seconds([&] {
+                std::ifstream f(tmp, std::ios::binary);
+                auto v = d.sorted ? read_delta_vector(f) : read_vector(f);
+                bytes = f.tellg();
+                g_sink = v.back();
+            }, 3);
+            std::remove(tmp.c_str());
+            report(d, "varint-stream", bytes, sec);
+        }
+
+        // varint поверх буфера в памяти.
+        {
+            std::string buf;
+            uint32_t prev = 0;
+            for (uint32_t v : d.values) {
+                append_varint(buf, d.sorted ? v - prev : v);
+                prev = v;
+            }
+            const auto* begin = reinterpret_cast<const uint8_t*>(buf.data());
+            const auto* end = begin + buf.size();
+            double sec = best_seconds([&] {
+                const uint8_t* p = begin;
+                uint32_t acc = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint32_t v = static_cast<uint32_t>(read_varint(p, end));
+                    out[i] = d.sorted ? (acc += v) : v;
+                }
+            });
+            if (out.back() != check) std::printf("varint-buffer: MISMATCH\n");
+            report(d, "varint-buffer", buf.size(), sec);
+        }
+
+        std::string buf;
+        if (d.sorted) {
+            block_codec::encode_delta(d.values.data(), n, 0, buf);
+        } else {
+            block_codec::encode(d.values.data(), n, buf);
+        }
+        const auto* begin = reinterpret_cast<const uint8_t*>(buf.data());
+        const auto* end = begin + buf.size();
+        for (auto kernel : {block_codec::Kernel::kScalar, block_codec::Kernel::kSse, block_codec::Kernel::kAvx2}) {
+            if (kernel == block_codec::Kernel::kAvx2 && block_codec::best_kernel() != kernel) continue;
+            std::fill(out.begin(), out.end(), 0);
+            double sec = best_seconds([&] {
+                if (d.sorted) {
+                    block_codec::decode_delta(kernel, begin, end, n, 0, out.data());
+                } else {
+                    block_codec::decode(kernel, begin, end, n, out.data());
+                }
+            });
+            if (!std::equal(out.begin(), out.end(), d.values.begin())) {
+                std::printf("%s: MISMATCH\n", block_codec::kernel_name(kernel));
+            }
+            report(d, (std::string("block-") + block_codec::kernel_name(kernel)).c_str(), buf.size(), sec);
+        }
+    }
+    return 0;
+}
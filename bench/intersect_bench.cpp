@@ -0,0 +1,135 @@
+// Микробенчмарк пересечения postings по соотношению длин списков:
+// std::set_intersection и старые sqrt skip-указатели против ядер intersect.
+// Запуск: ./intersect_bench [длина длинного списка]
+#include "Intersect.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// n случайных различных DocId из [0, universe), отсортированных.
+DocList random_list(size_t n, uint32_t universe, std::mt19937& rng) {
+    std::uniform_int_distribution<uint32_t> dist(0, universe - 1);
+    DocList docs;
+    docs.reserve(n + n / 8);
+    while (docs.size() < n) {
+        size_t missing = n - docs.size();
+        for (size_t i = 0; i < missing + missing / 8; ++i) docs.push_back(dist(rng));
+        std::sort(docs.begin(), docs.end());
+        docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+    }
+    std::shuffle(docs.begin(), docs.end(), rng);
+    docs.resize(n);
+    std::sort(docs.begin(), docs.end());
+    return docs;
+}
+
+// Короткий список: половина элементов взята из длинного, чтобы пересечение не было пустым.
+DocList short_list(const DocList& large, size_t n, uint32_t universe, std::mt19937& rng) {
+    DocList docs = random_list(n - n / 2, universe, rng);
+    std::vector<DocId> sample;
+    std::sample(large.begin(), large.end(), std::back_inserter(sample), n / 2, rng);
+    docs.insert(docs.end(), sample.begin(), sample.end());
+    std::sort(docs.begin(), docs.end());
+    docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+    return docs;
+}
+
+// Прежний SearchEngine::execute_intersect: skip-указатели через sqrt(n) и линейный шаг.
+size_t sqrt_skips(const DocList& small, const DocList& large, const std::vector<size_t>& skips, size_t step,
+                  DocId* out) {
+    size_t i = 0, j = 0, count = 0;
+    while (i < small.size() && j < large.size()) {
+        if (small[i] == large[j]) {
+            out[count++] = small[i];
+            i++;
+            j++;
+        } else if (small[i] < large[j]) {
+            i++;
+        } else {
+            size_t skip_idx = j / step;
+            while (skip_idx < skips.size() && large[skips[skip_idx]] <= small[i]) {
+                j = skips[skip_idx];
+                skip_idx++;
+            }
+            while (j < large.size() && large[j] < small[i]) j++;
+        }
+    }
+    return count;
+}
+
+template <typename F>
+double best_seconds(F&& f, int reps = 7) {
+    double best = 1e100;
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+volatile size_t g_sink;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t m = argc > 1 ? std::stoul(argv[1]) : (1u << 20);
+    const uint32_t universe = static_cast<uint32_t>(std::min<size_t>(UINT32_MAX, m * 8));
+    std::mt19937 rng(42);
+    DocList large = random_list(m, universe, rng);
+
+    size_t step = static_cast<size_t>(std::sqrt(large.size()));
+    std::vector<size_t> skips;
+    for (size_t i = step; i < large.size(); i += step) skips.push_back(i);
+
+    const intersect::Kernel kernels[] = {intersect::Kernel::kScalarMerge, intersect::Kernel::kSseMerge,
+                                         intersect::Kernel::kAvx2Merge, intersect::Kernel::kGallop};
+    std::printf("large list: %zu docs, universe %u; time per intersection in microseconds\n", m,
+                universe);
+    std::printf("%8s %8s %9s %9s", "ratio", "small", "set_isect", "sqrt_skip");
+    for (auto k : kernels) std::printf(" %12s", intersect::kernel_name(k));
+    std::printf(" %9s  %s\n", "auto", "(auto kernel)");
+
+    DocList out(m);
+    for (size_t ratio : {1, 2, 4, 8, 16, 32, 64, 128, 256, 1024, 4096, 16384}) {
+        if (m / ratio < 2) break;
+        DocList small = short_list(large, m / ratio, universe, rng);
+        DocList expected;
+        std::set_intersection(small.begin(), small.end(), large.begin(), large.end(), std::back_inserter(expected));
+
+        auto micros = [&](auto&& run) {
+            size_t count = 0;
+            double s = best_seconds([&] { g_sink = count = run(); });
+            if (count != expected.size() || !std::equal(expected.begin(), expected.end(), out.begin())) {
+                std::fprintf(stderr, "mismatch at ratio %zu\n", ratio);
+                std::exit(1);
+            }
+            return s * 1e6;
+        };
+
+        std::printf("%8zu %8zu", ratio, small.size());
+        std::printf(" %9.1f", micros([&] {
+            return static_cast<size_t>(
+                std::set_intersection(small.begin(), small.end(), large.begin(), large.end(), out.begin()) -
+                out.begin());
+        }));
+        std::printf(" %9.1f", micros([&] { return sqrt_skips(small, large, skips, step, out.data()); }));
+        for (auto k : kernels) {
+            std::printf(" %12.1f", micros([&] {
+                return intersect::intersect(k, small.data(), small.size(), large.data(), large.size(), out.data());
+            }));
+        }
+        std::printf(" %9.1f  %s\n", micros([&] {
+            return intersect::intersect(small.data(), small.size(), large.data(), large.size(), out.data());
+        }), intersect::kernel_name(intersect::choose(small.size(), large.size())));
+    }
+    return 0;
+}
@@ -0,0 +1,260 @@
+// Оценка качества ранжирования и подбор k1 / b / w_title без HTTP.
+// Запросы - названия случайных документов индекса; релевантными считаются сам
+// документ и документы с тем же названием (как в auto_train.py). Булев поиск
+// выполняется один раз на запрос; для каждого кандидата запоминаются частоты
+// терминов по полям и нормы полей, после чего каждая точка сетки параметров
+// только пересчитывает BM25F по этим признакам. Точки сетки считаются параллельно.
+//
+// Запуск: ./evaluate [--index BASE] [--samples N] [--seed S] [--k K] [--threads T]
+//                    [--k1 1.2,1.5,2.0] [--b 0.4,0.75,1.0] [--w-title 1,5,10]
+#include "Index.h"
+#include "Parallel.h"
+#include "Ranker.h"
+#include "SearchEngine.h"
+#include "TopK.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string index = "index";
+    size_t samples = 100;
+    uint32_t seed = 42;
+    size_t k = 10;
+    size_t threads = 0;
+    std::vector<double> k1 = {1.2, 1.5, 2.0};
+    std::vector<double> b = {0.4, 0.75, 1.0};
+    std::vector<double> w_title = {1.0, 5.0, 10.0};
+};
+
+// Частота термина в поле документа-кандидата и норма этого поля.
+struct Feature {
+    uint32_t term;
+    uint32_t field;
+    uint32_t tf;
+    uint8_t norm;
+};
+
+struct EvalQuery {
+    std::string text;
+    std::vector<double> idf;          // по терминам запроса
+    std::vector<DocId> candidates;
+    std::vector<uint32_t> features_begin;  // candidates.size() + 1 смещений в features
+    std::vector<Feature> features;    // у кандидата упорядочены по термину
+    std::vector<uint32_t> relevant;   // номера релевантных кандидатов
+    size_t num_relevant = 0;          // релевантных во всём индексе
+};
+
+struct Metrics {
+    double k1 = 0, b = 0, w_title = 0;
+    double hit_at_k = 0, mrr = 0, ndcg = 0;
+};
+
+std::vector<double> parse_list(const std::string& s) {
+    std::vector<double> values;
+    std::stringstream in(s);
+    for (std::string item; std::getline(in, item, ',');) values.push_back(std::stod(item));
+    return values;
+}
+
+std::string normalize_title(const std::string& title) {
+    size_t begin = title.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return {};
+    size_t end = title.find_last_not_of(" \t\r\n");
+    std::string s = title.substr(begin, end - begin + 1);
+    for (char& c : s) c = std::tolower(static_cast<unsigned char>(c));
+    return s;
+}
+
+// Кандидаты запроса и их признаки. idf и нормы не зависят от параметров, поэтому
+// годится Ranker с любыми k1 / b / w_title.
+EvalQuery collect(const SearchEngine& engine, const Ranker& ranker,
+                  const std::string& text, const std::vector<DocId>& relevant_docs) {
+    EvalQuery q;
+    q.text = text;
+    auto prepared = ranker.prepare(engine.scoring_terms(text));
+    for (const auto& term : prepared) q.idf.push_back(term.idf);
+    q.candidates = engine.search(text);
+    std::sort(q.candidates.begin(), q.candidates.end());
+    q.features_begin.reserve(q.candidates.size() + 1);
+    for (DocId doc : q.candidates) {
+        q.features_begin.push_back(q.features.size());
+        for (uint32_t t = 0; t < prepared.size(); ++t) {
+            for (const auto& [postings, field] : prepared[t].fields) {
+                auto it = std::lower_bound(postings->docs.begin(), postings->docs.end(), doc);
+                if (it == postings->docs.end() || *it != doc) continue;
+                size_t idx = it - postings->docs.begin();
+                if (idx < postings->tfs.size()) q.features.push_back({t, field, postings->tfs[idx], ranker.norm(field, doc)});
+            }
+        }
+    }
+    q.features_begin.push_back(q.features.size());
+    for (DocId doc : relevant_docs) {
+        auto it = std::lower_bound(q.candidates.begin(), q.candidates.end(), doc);
+        if (it != q.candidates.end() && *it == doc) q.relevant.push_back(it - q.candidates.begin());
+    }
+    q.num_relevant = relevant_docs.size();
+    return q;
+}
+
+// Те же формулы, что в Ranker::score, но по сохранённым признакам.
+double score(const Ranker& ranker, const EvalQuery& q, size_t c) {
+    double total = 0.0;
+    double tf = 0.0;
+    uint32_t term = UINT32_MAX;
+    for (uint32_t i = q.features_begin[c]; i < q.features_begin[c + 1]; ++i) {
+        const Feature& f = q.features[i];
+        if (f.term != term) {
+            if (term != UINT32_MAX) total += ranker.term_score(q.idf[term], tf);
+            term = f.term;
+            tf = 0.0;
+        }
+        tf += ranker.field_tf(f.field, f.tf, f.norm);
+    }
+    if (term != UINT32_MAX) total += ranker.term_score(q.idf[term], tf);
+    return total;
+}
+
+Metrics evaluate_point(const Index& index, const std::vector<EvalQuery>& queries, size_t k,
+                       double k1, double b, double w_title) {
+    Ranker ranker(index, k1, b, w_title);
+    Metrics m{k1, b, w_title};
+    std::vector<double> scores;
+    for (const auto& q : queries) {
+        scores.resize(q.candidates.size());
+        for (size_t c = 0; c < q.candidates.size(); ++c) scores[c] = score(ranker, q, c);
+        // Место кандидата в выдаче - число кандидатов, стоящих выше него (как в TopK).
+        size_t best_rank = SIZE_MAX;
+        double dcg = 0.0;
+        for (uint32_t r : q.relevant) {
+            ScoredDoc doc{scores[r], q.candidates[r]};
+            size_t rank = 1;
+            for (size_t c = 0; c < q.candidates.size(); ++c) {
+                if (TopK::better({scores[c], q.candidates[c]}, doc)) ++rank;
+            }
+            best_rank = std::min(best_rank, rank);
+            if (rank <= k) dcg += 1.0 / std::log2(rank + 1.0);
+        }
+        double idcg = 0.0;
+        for (size_t i = 1; i <= std::min(k, q.num_relevant); ++i) idcg += 1.0 / std::log2(i + 1.0);
+        if (best_rank <= k) m.hit_at_k += 1;
+        if (best_rank != SIZE_MAX) m.mrr += 1.0 / best_rank;
+        if (idcg > 0) m.ndcg += dcg / idcg;
+    }
+    if (!queries.empty()) {
+        m.hit_at_k /= queries.size();
+        m.mrr /= queries.size();
+        m.ndcg /= queries.size();
+    }
+    return m;
+}
+
+void usage(const char* name) {
+    std::cerr << "Usage: " << name << " [--index BASE] [--samples N] [--seed S] [--k K] [--threads T]"
+              << " [--k1 LIST] [--b LIST] [--w-title LIST]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) { usage(argv[0]); return 1; }
+        std::string value = argv[++i];
+        if (arg == "--index") opt.index = value;
+        else if (arg == "--samples") opt.samples = std::stoul(value);
+        else if (arg == "--seed") opt.seed = std::stoul(value);
+        else if (arg == "--k") opt.k = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--threads") opt.threads = std::stoul(value);
+        else if (arg == "--k1") opt.k1 = parse_list(value);
+        else if (arg == "--b") opt.b = parse_list(value);
+        else if (arg == "--w-title") opt.w_title = parse_list(value);
+        else { usage(argv[0]); return 1; }
+    }
+
+    Index index;
+    try {
+        index.load(opt.index);
+    } catch (const std::exception& e) {
+        std::cerr << "Cannot load index: " << e.what() << std::endl;
+        return 1;
+    }
+    const auto& forward_index = index.get_forward_index();
+    size_t num_docs = forward_index.size();
+    if (num_docs == 0) { std::cerr << "Empty index" << std::endl; return 1; }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<DocId> sample(num_docs);
+    for (DocId id = 0; id < num_docs; ++id) sample[id] = id;
+    if (opt.samples > 0 && opt.samples < num_docs) {
+        std::mt19937 rng(opt.seed);
+        std::shuffle(sample.begin(), sample.end(), rng);
+        sample.resize(opt.samples);
+    }
+
+    // Релевантные документы: все с тем же названием, что у выбранного.
+    std::vector<std::string> titles(sample.size());
+    std::unordered_map<std::string, std::vector<DocId>> same_title;
+    for (size_t i = 0; i < sample.size(); ++i) {
+        titles[i] = forward_index.get_document(sample[i]).title;
+        same_title.emplace(normalize_title(titles[i]), std::vector<DocId>{});
+    }
+    for (DocId id = 0; id < num_docs; ++id) {
+        auto it = same_title.find(normalize_title(forward_index.get_document(id).title));
+        if (it != same_title.end()) it->second.push_back(id);
+    }
+
+    SearchEngine engine(index);
+    Ranker base(index, 1.2, 0.75, 5.0);
+    std::vector<EvalQuery> queries;
+    queries.reserve(sample.size());
+    for (size_t i = 0; i < sample.size(); ++i) {
+        queries.push_back(collect(engine, base, titles[i], same_title.at(normalize_title(titles[i]))));
+    }
+    auto retrieved = std::chrono::steady_clock::now();
+
+    struct Point { double k1, b, w_title; };
+    std::vector<Point> grid;
+    for (double w : opt.w_title)
+        for (double k1 : opt.k1)
+            for (double b : opt.b) grid.push_back({k1, b, w});
+    std::vector<Metrics> results(grid.size());
+    size_t threads = std::min(opt.threads ? opt.threads : default_num_threads(), std::max<size_t>(1, grid.size()));
+    std::atomic<size_t> next{0};
+    run_parallel(threads, [&](size_t) {
+        for (size_t p; (p = next.fetch_add(1)) < grid.size();) {
+            results[p] = evaluate_point(index, queries, opt.k, grid[p].k1, grid[p].b, grid[p].w_title);
+        }
+    });
+    auto finished = std::chrono::steady_clock::now();
+
+    std::printf("%-8s | %-6s | %-6s | %-8s | %-8s | %-8s\n", "w_title", "k1", "b",
+                ("hit@" + std::to_string(opt.k)).c_str(), "MRR", ("nDCG@" + std::to_string(opt.k)).c_str());
+    std::printf("%s\n", std::string(60, '-').c_str());
+    const Metrics* best = nullptr;
+    for (const auto& m : results) {
+        std::printf("%-8.2f | %-6.2f | %-6.2f | %-8.4f | %-8.4f | %-8.4f\n", m.w_title, m.k1, m.b, m.hit_at_k, m.mrr, m.ndcg);
+        if (!best || m.mrr > best->mrr) best = &m;
+    }
+    std::printf("%s\n", std::string(60, '-').c_str());
+    if (best) {
+        std::printf("BEST (MRR): w_title=%g k1=%g b=%g hit@%zu=%.4f MRR=%.4f nDCG@%zu=%.4f\n", best->w_title, best->k1,
+                    best->b, opt.k, best->hit_at_k, best->mrr, opt.k, best->ndcg);
+    }
+    std::printf("%zu queries, %zu grid points, %zu threads: retrieval %.1f ms, re-ranking %.1f ms\n", queries.size(),
+                grid.size(), threads, std::chrono::duration<double, std::milli>(retrieved - start).count(),
+                std::chrono::duration<double, std::milli>(finished - retrieved).count());
+    return 0;
+}
@@ -1,81 +1,189 @@
 #include "Index.h"
+#include "SpimiIndexer.h"
+#include "CsvReader.h"
+#include "Encoding.h"
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <functional>
 #include <cstdio> // remove
+#include <thread>
+
+// Передаёт документы по одному прямо из отображённого CSV, не накапливая корпус в памяти.
+// Колонки: 1 - название, 7 - сюжет; строки короче 8 полей пропускаются.
+void for_each_csv_document(const std::string& filename, const std::function<void(const DocumentView&)>& callback) {
+    CsvReader reader(filename);
+    DocId id = 0;
+    reader.for_each_record([&](const CsvReader::Row& row) {
+        if (row.size() >= 8) callback(DocumentView{id++, row[1], row[7]});
+    });
+}
 
 std::vector<Document> parse_csv(const std::string& filename) {
     std::vector<Document> docs;
-    std::ifstream file(filename);
-    if (!file.is_open()) return docs;
-
-    std::string line;
-    uint32_t id = 0;
-    std::getline(file, line); 
+    for_each_csv_document(filename, [&](const DocumentView& doc) {
+        docs.push_back({doc.id, std::string(doc.title), std::string(doc.plot)});
+    });
+    return docs;
+}
 
-    std::string record_buffer;
-    bool in_quotes = false;
-    char c;
+// Квантованные вклады для параметров BM25F по умолчанию (как в SearchEngine).
+void save_impacts(const Index& index) {
+    std::cout << "Writing impact-ordered postings..." << std::endl;
+    write_impacts(index, "index.impacts", 1.2, 0.75, 5.0);
+}
 
-    while (file.get(c)) {
-        if (c == '"') in_quotes = !in_quotes;
-        if (c == '\n' && !in_quotes) {
-            std::stringstream ss(record_buffer);
-            std::vector<std::string> row;
-            std::string field;
-            bool fq = false;
-            for(char ch : record_buffer) {
-                if (ch == '"') fq = !fq;
-                else if (ch == ',' && !fq) { row.push_back(field); field.clear(); }
-                else field += ch;
-            }
-            row.push_back(field);
-            if (row.size() >= 8) docs.push_back({id++, row[1], row[7]});
-            record_buffer.clear();
-        } else {
-            record_buffer += c;
+int run_spimi(const std::string& csv, size_t memory_mb, const std::string& temp_dir, bool impacts) {
+    std::cout << "Indexing with SPIMI, memory budget " << memory_mb << " MB..." << std::endl;
+    try {
+        SpimiIndexer spimi("index", memory_mb << 20, temp_dir);
+        size_t count = 0;
+        for_each_csv_document(csv, [&](const DocumentView& doc) {
+            spimi.add_document(doc);
+            ++count;
+        });
+        std::cout << "Merging " << spimi.runs() << " run(s) of " << count << " docs..." << std::endl;
+        spimi.finish();
+        if (impacts) {
+            Index index;
+            index.load("index");
+            save_impacts(index);
         }
+        std::cout << "Done. Index version " << Index::publish_version("index") << " saved successfully." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "FATAL ERROR SAVING INDEX: " << e.what() << std::endl;
+        return 1;
     }
-    // Хвост
-    if (!record_buffer.empty()) {
-         std::stringstream ss(record_buffer);
-            std::vector<std::string> row;
-            std::string field;
-            bool fq = false;
-            for(char ch : record_buffer) {
-                if (ch == '"') fq = !fq;
-                else if (ch == ',' && !fq) { row.push_back(field); field.clear(); }
-                else field += ch;
+    return 0;
+}
+
+// Коллекция, разбитая по диапазонам DocId на shards индексов index.shard<i>:
+// у каждого свои локальные DocId, глобальные - в index.shard<i>.ids. Шарды
+// перечислены в index.shards; у каждого и у index своя версия.
+int run_sharded(const std::string& csv, size_t shards, size_t threads) {
+    try {
+        std::cout << "Parsing CSV..." << std::endl;
+        auto docs = parse_csv(csv);
+        std::vector<std::string> names;
+        for (size_t s = 0; s < shards; ++s) {
+            size_t begin = docs.size() * s / shards;
+            size_t end = docs.size() * (s + 1) / shards;
+            std::string name = "shard" + std::to_string(s);
+            std::cout << "Indexing " << name << ": docs [" << begin << ", " << end << ")..." << std::endl;
+            std::vector<Document> slice(std::make_move_iterator(docs.begin() + begin),
+                                        std::make_move_iterator(docs.begin() + end));
+            DocList ids;
+            ids.reserve(slice.size());
+            for (size_t i = 0; i < slice.size(); ++i) {
+                ids.push_back(slice[i].id);
+                slice[i].id = static_cast<DocId>(i);
             }
-            row.push_back(field);
-            if (row.size() >= 8) docs.push_back({id++, row[1], row[7]});
+            Index index;
+            index.add_documents(slice, threads);
+            index.build_postings_metadata();
+            index.save("index." + name);
+            std::ofstream out("index." + name + ".ids", std::ios::binary);
+            write_delta_vector(out, ids);
+            out.close();
+            if (!out) throw std::runtime_error("Cannot write index." + name + ".ids");
+            Index::publish_version("index." + name);
+            names.push_back(name);
+        }
+        Index::save_shards("index", names);
+        std::cout << "Done. Index version " << Index::publish_version("index") << " saved successfully in "
+                  << shards << " shards." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "FATAL ERROR SAVING INDEX: " << e.what() << std::endl;
+        return 1;
     }
-    return docs;
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    std::cout << "Parsing CSV..." << std::endl;
-    auto docs = parse_csv("data/wiki_movie_plots_deduped.csv");
-    
+    const std::string csv = "data/wiki_movie_plots_deduped.csv";
+    size_t threads = 1;
+    bool spimi = false;
+    bool impacts = false;
+    size_t memory_mb = 256;
+    size_t shards = 1;
+    std::string temp_dir;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+            if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        } else if (arg == "--spimi") {
+            spimi = true;
+        } else if (arg == "--memory-mb" && i + 1 < argc) {
+            memory_mb = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--temp-dir" && i + 1 < argc) {
+            temp_dir = argv[++i];
+        } else if (arg == "--impacts") {
+            impacts = true;
+        } else if (arg == "--shards" && i + 1 < argc) {
+            shards = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--threads N] [--spimi [--memory-mb M] [--temp-dir DIR]] [--impacts] [--shards N]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    // Вклады saat квантуются по статистике одного индекса, а шарды ранжируются
+    // по статистике всей коллекции; SPIMI пишет один индекс.
+    if (shards > 1 && (spimi || impacts)) {
+        std::cerr << "--shards cannot be combined with --spimi or --impacts" << std::endl;
+        return 1;
+    }
+
+    // Удаляем старые файлы, чтобы не было конфликтов. Работающий сервер держит их
+    // отображёнными в память и дочитывает старую версию; новую он подхватит, когда
+    // в конце появится следующая версия в index.version.
+    std::remove("index.docs");
+    std::remove("index.store");
+    std::remove("index.inv");
+    std::remove("index.seg");
+    std::remove("index.norms");
+    std::remove("index.impacts");
+    try {
+        for (const auto& name : Index::shards("index")) {
+            for (const char* ext : {".seg", ".store", ".norms", ".ids"}) std::remove(("index." + name + ext).c_str());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    std::remove("index.shards");
+
+    if (spimi) return run_spimi(csv, memory_mb, temp_dir, impacts);
+    if (shards > 1) return run_sharded(csv, shards, threads);
+
     Index index;
-    std::cout << "Indexing " << docs.size() << " docs..." << std::endl;
-    for (const auto& doc : docs) index.add_document(doc);
+    try {
+        if (threads == 1) {
+            std::cout << "Parsing and indexing CSV..." << std::endl;
+            for_each_csv_document(csv, [&](const DocumentView& doc) { index.add_document(doc); });
+        } else {
+            std::cout << "Parsing CSV..." << std::endl;
+            auto docs = parse_csv(csv);
+            std::cout << "Indexing " << docs.size() << " docs in " << threads << " threads..." << std::endl;
+            index.add_documents(docs, threads);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "FATAL ERROR INDEXING: " << e.what() << std::endl;
+        return 1;
+    }
     
-    std::cout << "Building Skip Pointers & Sorting..." << std::endl;
-    index.build_skip_pointers();
+    std::cout << "Building postings metadata..." << std::endl;
+    index.build_postings_metadata();
 
     std::cout << "Saving index..." << std::endl;
-    
-    // Удаляем старые файлы, чтобы не было конфликтов
-    std::remove("index.docs");
-    std::remove("index.inv");
 
     try {
         index.save("index");
-        std::cout << "Done. Index saved successfully." << std::endl;
+        if (impacts) save_impacts(index);
+        std::cout << "Done. Index version " << Index::publish_version("index") << " saved successfully." << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "FATAL ERROR SAVING INDEX: " << e.what() << std::endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Common.h"
+#include <span>
+
+// Множество из count документов среди universe хранится битмапом, если оно
+// плотнее 1/kDenseRatio: тогда битсет не больше списка DocId.
+constexpr size_t kDenseRatio = 32;
+
+inline bool is_dense(size_t count, size_t universe) {
+    return count > 0 && count * kDenseRatio >= universe;
+}
+
+// Сжатый битмап в стиле Roaring: DocId делится на старшие 16 бит (ключ контейнера)
+// и младшие 16 бит. Разреженный контейнер — отсортированный массив uint16,
+// плотный (больше kArrayMax значений) — битсет на 65536 бит. Операции над
+// битсетами идут по 64-битным словам.
+class Bitmap {
+public:
+    static constexpr size_t kArrayMax = 4096;
+    static constexpr size_t kWords = 65536 / 64;
+
+    Bitmap() = default;
+    static Bitmap from_sorted(std::span<const DocId> docs);
+
+    static Bitmap intersect(const Bitmap& a, const Bitmap& b);
+    static Bitmap unite(const Bitmap& a, const Bitmap& b);
+    static Bitmap difference(const Bitmap& a, const Bitmap& b);
+
+    bool contains(DocId id) const;
+    size_t cardinality() const;
+    bool empty() const { return containers_.empty(); }
+
+    // Отбирает из отсортированного списка элементы, которые есть (keep = true)
+    // или которых нет (keep = false) в битмапе.
+    DocList filter(std::span<const DocId> docs, bool keep) const;
+
+    template <typename F>
+    void for_each(F&& fn) const {
+        for (const auto& c : containers_) {
+            DocId high = static_cast<DocId>(c.key) << 16;
+            if (!c.is_bitset()) {
+                for (uint16_t low : c.array) fn(high | low);
+                continue;
+            }
+            for (size_t w = 0; w < kWords; ++w) {
+                for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                    fn(high | static_cast<DocId>(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+    }
+
+    void append_to(DocList& out) const {
+        out.reserve(out.size() + cardinality());
+        for_each([&](DocId id) { out.push_back(id); });
+    }
+
+private:
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;  // пуст, если контейнер — битсет
+        std::vector<uint64_t> bits;   // kWords слов или пусто
+
+        bool is_bitset() const { return !bits.empty(); }
+        bool contains(uint16_t low) const;
+    };
+
+    static void push_bits(Bitmap& out, uint16_t key, std::vector<uint64_t>&& bits);
+    static void push_array(Bitmap& out, uint16_t key, std::vector<uint16_t>&& array);
+    static std::vector<uint64_t> to_bits(const Container& c);
+
+    std::vector<Container> containers_;  // по возрастанию key
+};
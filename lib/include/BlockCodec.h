@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Блочный кодек для postings: битовая упаковка кусками по kChunkSize чисел
+// (в духе SIMD-BP128 / Lucene ForUtil). Кусок - байт ширины b и 128 чисел по b бит
+// в "вертикальной" раскладке на 8 дорожек: число i лежит в дорожке i % 8, а слова
+// дорожек чередуются. Так одна и та же последовательность сдвигов и масок
+// распаковывает сразу 4 (SSE) или 8 (AVX2) чисел без ветвлений на каждое число.
+// Остаток короче kChunkSize пишется обычным varint, как раньше.
+namespace block_codec {
+
+constexpr size_t kChunkSize = 128;
+
+enum class Kernel { kScalar, kSse, kAvx2 };
+
+// Лучшее ядро, которое поддерживает процессор.
+Kernel best_kernel();
+const char* kernel_name(Kernel kernel);
+
+// Дописывает в out закодированные n чисел.
+void encode(const uint32_t* in, size_t n, std::string& out);
+// То же для неубывающей последовательности: хранятся разности с предыдущим, первое - с prev.
+void encode_delta(const uint32_t* in, size_t n, uint32_t prev, std::string& out);
+
+// Декодирует n чисел из [in, end) и возвращает указатель на первый непрочитанный байт.
+// Бросает std::runtime_error, если данных не хватает.
+const uint8_t* decode(const uint8_t* in, const uint8_t* end, size_t n, uint32_t* out);
+const uint8_t* decode_delta(const uint8_t* in, const uint8_t* end, size_t n, uint32_t prev, uint32_t* out);
+
+// Явный выбор ядра - для бенчмарков и проверки ядер друг против друга.
+const uint8_t* decode(Kernel kernel, const uint8_t* in, const uint8_t* end, size_t n, uint32_t* out);
+const uint8_t* decode_delta(Kernel kernel, const uint8_t* in, const uint8_t* end, size_t n, uint32_t prev,
+                            uint32_t* out);
+
+}  // namespace block_codec
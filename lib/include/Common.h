@@ -7,9 +7,18 @@
 using DocId = uint32_t;
 using DocList = std::vector<DocId>;
 using Term = std::string;
+// Номер термина в словаре индекса (см. TermDictionary); термины нумеруются по возрастанию.
+using TermId = uint32_t;
+constexpr TermId kNoTerm = UINT32_MAX;
 using Tokens = std::vector<Term>;
 using Positions = std::vector<uint32_t>;
 
+struct ScoredDoc {
+    double score;
+    DocId id;
+};
+using ScoredDocs = std::vector<ScoredDoc>;
+
 
 inline void encode_varint(std::ofstream& out, uint32_t value) {
     while (value >= 128) {
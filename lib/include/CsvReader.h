@@ -0,0 +1,27 @@
+#pragma once
+#include "MappedFile.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Потоковый разбор CSV поверх mmap. Граница записи - перевод строки вне кавычек,
+// поля разделяются запятыми вне кавычек, сами кавычки из полей выбрасываются.
+// Первая строка (заголовок) пропускается. Специальные символы ищутся по 16 байт
+// за раз (SSE2), обычный текст между ними не трогается вовсе.
+class CsvReader {
+public:
+    using Row = std::vector<std::string_view>;
+
+    explicit CsvReader(const std::string& path) : file_(path) {
+        file_.advise_sequential();
+    }
+
+    // Вызывает callback для каждой записи. Поля без кавычек указывают прямо в
+    // отображённый файл, поля с кавычками - во внутренний буфер; и те и другие
+    // действительны только до возврата из callback.
+    void for_each_record(const std::function<void(const Row&)>& callback);
+
+private:
+    MappedFile file_;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include "Index.h"
+#include "QueryPlan.h"
+#include "DocSet.h"
+#include "Ranker.h"
+#include <functional>
+
+// Выполнение булева плана документ за документом (DAAT). Операторы плана
+// становятся курсорами, которые вместе двигают курсоры postings вперёд:
+// AND — leapfrog от самого редкого операнда, OR — минимум, AND_NOT и NOT —
+// проверка исключаемых курсоров на текущем документе, NEAR/ADJ — позиции
+// с курсоров, уже стоящих на документе. Курсоры postings общие для сопоставления
+// и BM25: на найденном документе tf всех терминов запроса уже под рукой,
+// и каждый список проходится один раз, без повторных бинарных поисков.
+// Score совпадает с Ranker::score.
+//
+// Поддеревья NOT / AND_NOT без NEAR/ADJ выгоднее считать целиком на битмапах
+// (DocSet): они вычисляются через evaluate_set и дальше читаются как обычный курсор.
+// cached_set, если задан, может вернуть готовый список документов узла AND
+// (из кэша промежуточных результатов); nullptr - строить курсоры как обычно.
+class DaatEvaluator {
+public:
+    using SetEvaluator = std::function<DocSet(PlanNode&)>;
+    using CachedSet = std::function<std::shared_ptr<const DocList>(PlanNode&)>;
+
+    // deleted - документы, которые не попадают в выдачу (nullptr - таких нет).
+    DaatEvaluator(const Index& index, const Ranker& ranker, SetEvaluator evaluate_set, CachedSet cached_set = {},
+                  const Bitmap* deleted = nullptr)
+        : index_(index), ranker_(ranker), evaluate_set_(std::move(evaluate_set)), cached_set_(std::move(cached_set)),
+          deleted_(deleted) {}
+
+    // Параметры BM25F берутся из ranker.
+    ScoredDocs search(PlanNode& plan, const Ranker::PreparedQuery& scoring, size_t k, size_t offset) const;
+
+private:
+    const Index& index_;
+    const Ranker& ranker_;
+    SetEvaluator evaluate_set_;
+    CachedSet cached_set_;
+    const Bitmap* deleted_;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "Bitmap.h"
+#include "Postings.h"
+#include <memory>
+#include <span>
+
+// Множество документов для булевых запросов: отсортированный список для
+// разреженных множеств или битмап для плотных (см. is_dense). NOT не
+// раскрывается: множество хранит флаг дополнения до [0, universe), и
+// x AND NOT y выполняется как разность без построения дополнения.
+class DocSet {
+public:
+    DocSet() = default;
+    // Список владеющий; плотный список сразу превращается в битмап.
+    static DocSet from_list(DocList docs, size_t universe);
+    // Представление postings без копирования: битмап, если он построен, иначе docs.
+    static DocSet from_postings(const PostingsList& postings, size_t universe);
+
+    static DocSet intersect(const DocSet& a, const DocSet& b);
+    static DocSet unite(const DocSet& a, const DocSet& b);
+    DocSet complement() &&;
+
+    bool negated() const { return negated_; }
+    size_t size() const;
+    // Раскрывает множество (в том числе дополнение) в отсортированный список.
+    DocList to_list() const;
+
+private:
+    static DocSet combine_and(const DocSet& a, bool a_neg, const DocSet& b, bool b_neg);
+    static DocSet positive_and(const DocSet& a, const DocSet& b);
+    static DocSet positive_or(const DocSet& a, const DocSet& b);
+    static DocSet positive_and_not(const DocSet& a, const DocSet& b);
+    static DocSet from_bitmap(Bitmap bitmap, size_t universe);
+
+    std::span<const DocId> list() const { return borrowed_ ? *borrowed_ : std::span<const DocId>(owned_); }
+
+    DocList owned_;
+    const DocList* borrowed_ = nullptr;
+    std::shared_ptr<const Bitmap> bitmap_;  // если задан, список не используется
+    bool negated_ = false;
+    size_t universe_ = 0;
+};
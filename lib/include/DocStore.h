@@ -0,0 +1,72 @@
+#pragma once
+#include "Common.h"
+#include "Document.h"
+#include "MappedFile.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Хранилище документов base_name.store: документы подряд по DocId, упакованные
+// в блоки примерно по kStoreBlockSize байт и сжатые кодеком lz. Раскладка
+// (целые числа little-endian):
+//   [заголовок 32 байта][блоки][таблица блоков]
+// Блок: u32 исходный размер, u32 сжатый размер, данные. Внутри блока документ -
+// varint длина и байты названия, затем так же сюжет. Запись таблицы блоков:
+// u64 смещение блока, u32 первый DocId блока.
+constexpr size_t kStoreBlockSize = 8 << 10;
+
+class DocStoreWriter {
+public:
+    explicit DocStoreWriter(const std::string& path);
+
+    DocStoreWriter(const DocStoreWriter&) = delete;
+    DocStoreWriter& operator=(const DocStoreWriter&) = delete;
+
+    // Документы добавляются по возрастанию DocId без пропусков.
+    void add_document(const DocumentView& doc);
+    void finish();
+
+    size_t size() const { return num_docs_; }
+
+private:
+    void flush_block();
+
+    std::string path_;
+    std::ofstream out_;
+    std::string block_;
+    std::string table_;
+    uint64_t offset_ = 0;
+    uint32_t num_docs_ = 0;
+    uint32_t block_first_ = 0;
+    uint32_t num_blocks_ = 0;
+    bool finished_ = false;
+};
+
+// Файл отображается в память; распаковываются только блоки запрошенных
+// документов, последние cache_blocks распакованных блоков живут в LRU.
+// Потокобезопасен.
+class DocStoreReader {
+public:
+    explicit DocStoreReader(const std::string& path, size_t cache_blocks = 64);
+
+    size_t size() const { return num_docs_; }
+    Document get_document(DocId id) const;
+
+private:
+    using Block = std::shared_ptr<const std::string>;
+
+    Block block(uint32_t index) const;
+    Block decompress(uint32_t index) const;
+
+    MappedFile file_;
+    uint32_t num_docs_ = 0;
+    uint32_t num_blocks_ = 0;
+    const uint8_t* blocks_ = nullptr;
+    const uint8_t* table_ = nullptr;
+
+    size_t cache_blocks_;
+    mutable std::mutex mutex_;
+    mutable std::list<std::pair<uint32_t, Block>> lru_;  // в начале - недавние
+    mutable std::unordered_map<uint32_t, std::list<std::pair<uint32_t, Block>>::iterator> cached_;
+};
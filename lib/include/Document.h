@@ -1,8 +1,21 @@
 #pragma once
 #include "Common.h"
+#include <string_view>
 
 struct Document {
     DocId id;
     std::string title;
     std::string plot;
-};
\ No newline at end of file
+};
+
+// Документ без владения строками: поля указывают в буфер разбора (например, в
+// отображённый CSV). Неявно строится из Document, поэтому годится везде, где
+// документ нужно только прочитать.
+struct DocumentView {
+    DocId id;
+    std::string_view title;
+    std::string_view plot;
+
+    DocumentView(DocId id, std::string_view title, std::string_view plot) : id(id), title(title), plot(plot) {}
+    DocumentView(const Document& doc) : id(doc.id), title(doc.title), plot(doc.plot) {}
+};
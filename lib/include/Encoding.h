@@ -5,6 +5,9 @@
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <cstring>
+#include <span>
+#include <string_view>
 
 const size_t MAX_BLOCK_SIZE = 200 * 1024 * 1024; 
 
@@ -29,7 +32,7 @@ inline uint64_t read_varint(std::ifstream& in) {
     return value;
 }
 
-inline void write_string(std::ofstream& out, const std::string& s) {
+inline void write_string(std::ofstream& out, std::string_view s) {
     write_varint(out, s.size());
     out.write(s.data(), s.size());
 }
@@ -41,7 +44,7 @@ inline void read_string(std::ifstream& in, std::string& s) {
     if (len > 0) in.read(&s[0], len);
 }
 
-inline void write_delta_vector(std::ofstream& out, const std::vector<uint32_t>& vec) {
+inline void write_delta_vector(std::ofstream& out, std::span<const uint32_t> vec) {
     write_varint(out, vec.size());
     uint64_t prev = 0;
     for (uint32_t val : vec) {
@@ -66,4 +69,53 @@ inline std::vector<uint32_t> read_delta_vector(std::ifstream& in) {
         prev = val;
     }
     return vec;
-}
\ No newline at end of file
+}
+
+inline void write_vector(std::ofstream& out, const std::vector<uint32_t>& vec) {
+    write_varint(out, vec.size());
+    for (uint32_t val : vec) write_varint(out, val);
+}
+
+inline std::vector<uint32_t> read_vector(std::ifstream& in) {
+    size_t size = read_varint(in);
+    if (size > MAX_BLOCK_SIZE) throw std::runtime_error("Vector too large");
+
+    std::vector<uint32_t> vec(size);
+    for (auto& val : vec) val = static_cast<uint32_t>(read_varint(in));
+    return vec;
+}
+
+// Те же varint, но поверх буфера в памяти (для сегментов, отображённых через mmap).
+inline void append_varint(std::string& buf, uint64_t value) {
+    while (value >= 128) {
+        buf.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buf.push_back(static_cast<char>(value));
+}
+
+inline uint64_t read_varint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (true) {
+        if (p >= end) throw std::runtime_error("Varint out of bounds");
+        uint8_t byte = *p++;
+        value |= (static_cast<uint64_t>(byte & 0x7F) << shift);
+        if ((byte & 0x80) == 0) break;
+        shift += 7;
+        if (shift > 63) throw std::runtime_error("Varint corrupted");
+    }
+    return value;
+}
+
+template <typename T>
+inline void append_raw(std::string& buf, T value) {
+    buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline T load_raw(const uint8_t* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
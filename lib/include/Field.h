@@ -0,0 +1,23 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Поля документа известны при компиляции. Номер поля - индекс в FieldPostings
+// и FieldNorms; имена нужны только на границах: в файлах и в квалификаторах
+// запроса вида title:word.
+enum FieldId : uint32_t { kTitleField = 0, kPlotField = 1, kNumFields = 2 };
+
+constexpr uint32_t kNoField = UINT32_MAX;
+
+inline constexpr std::array<std::string_view, kNumFields> kFieldNames = {"title", "plot"};
+
+constexpr std::string_view field_name(uint32_t field) { return kFieldNames[field]; }
+
+// kNoField для неизвестного имени.
+constexpr uint32_t field_id(std::string_view name) {
+    for (uint32_t f = 0; f < kNumFields; ++f) {
+        if (kFieldNames[f] == name) return f;
+    }
+    return kNoField;
+}
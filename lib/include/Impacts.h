@@ -0,0 +1,73 @@
+#pragma once
+#include "Common.h"
+#include "MappedFile.h"
+#include <string_view>
+
+class Index;
+
+// Квантованные вклады BM25F (impacts) для одного набора параметров k1, b, w_title.
+// Вклад термина в документ (по всем полям сразу) переводится в байт 1..255 по общей
+// для всего индекса шкале, поэтому вклады разных терминов складываются как целые.
+// Postings термина упорядочены по вкладу: группы документов с одинаковым вкладом
+// по убыванию вклада, внутри группы DocId по возрастанию.
+//
+// Раскладка base_name.impacts (целые числа little-endian):
+//   [заголовок][группы][словарь][строки терминов]
+// Группа: байт вклада, varint число документов, varint длина данных, затем DocId
+// через block_codec::encode_delta. Словарь - отсортированные записи фиксированного
+// размера: u64 смещение строки, u32 длина, u32 число групп, u64 смещение групп.
+
+// Строит файл по загруженному индексу в два прохода по терминам:
+// сначала максимальный вклад (шкала квантования), затем запись групп.
+void write_impacts(const Index& index, const std::string& path, double k1, double b, double w_title);
+
+class ImpactReader {
+public:
+    struct Group {
+        uint8_t impact;
+        uint32_t count;
+        const uint8_t* data;
+        const uint8_t* end;
+    };
+
+    explicit ImpactReader(const std::string& path);
+
+    // Посчитаны ли вклады для этих параметров BM25F.
+    bool matches(double k1, double b, double w_title) const;
+    // score, соответствующий единице вклада.
+    double scale() const { return scale_; }
+    uint32_t num_docs() const { return num_docs_; }
+
+    // Группы термина по убыванию вклада; пусто, если термина нет.
+    std::vector<Group> find(std::string_view term) const;
+    // Пишет group.count DocId группы в out.
+    void decode(const Group& group, DocId* out) const;
+
+private:
+    std::string_view term(uint32_t ordinal) const;
+
+    MappedFile file_;
+    uint32_t num_terms_ = 0;
+    uint32_t num_docs_ = 0;
+    double k1_ = 0, b_ = 0, w_title_ = 0;
+    double scale_ = 1.0;
+    const uint8_t* groups_ = nullptr;
+    const uint8_t* dictionary_ = nullptr;
+    const uint8_t* strings_ = nullptr;
+    const uint8_t* end_ = nullptr;
+};
+
+// Поиск score-at-a-time (в духе JASS): группы всех терминов запроса обрабатываются
+// по убыванию вклада, вклады складываются в целочисленные аккумуляторы. Первыми
+// идут самые весомые postings, поэтому обход можно оборвать после postings_budget
+// postings и получить приближённый top-k с ограниченным временем; 0 - без ограничения.
+// Score результата - сумма вкладов, умноженная на ImpactReader::scale.
+class ScoreAtATime {
+public:
+    explicit ScoreAtATime(const ImpactReader& impacts) : impacts_(impacts) {}
+
+    ScoredDocs search(const std::vector<Term>& terms, size_t k, size_t offset, size_t postings_budget) const;
+
+private:
+    const ImpactReader& impacts_;
+};
@@ -1,35 +1,99 @@
 #pragma once
 #include "Common.h"
 #include "Document.h"
+#include "Impacts.h"
 #include "Tokenizer.h"
 #include "ForwardIndex.h"
-#include <unordered_map>
+#include "Norms.h"
+#include "Postings.h"
+#include "TermDictionary.h"
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
-struct PostingsList {
-    DocList docs;
-    std::vector<std::vector<uint32_t>> positions; 
-    std::vector<size_t> skips;
-    size_t skip_step = 0;
-};
-
-using InvertedIndex = std::unordered_map<Term, std::unordered_map<std::string, PostingsList>>;
+class SegmentReader;
 
 class Index {
 public:
-    void add_document(const Document& doc);
-    void build_skip_pointers();
+    Index();
+    ~Index();
+
+    void add_document(const DocumentView& doc);
+    // Параллельная индексация: каждый из num_threads потоков строит частичный индекс
+    // над своим диапазоном DocId, затем частичные индексы параллельно сливаются.
+    // Результат совпадает с последовательным add_document для тех же документов.
+    void add_documents(const std::vector<Document>& docs, size_t num_threads);
+    // Сортирует термины в TermDictionary (TermId меняются), строит Block-Max
+    // метаданные, битмапы плотных списков и df терминов; вызывается после индексации.
+    void build_postings_metadata();
+    // Пишет хранилище документов base_name.store, base_name.norms и сегмент base_name.seg.
     void save(const std::string& base_name) const;
+    // Отображает base_name.seg и base_name.store в память; если их нет - читает
+    // старые base_name.inv и base_name.docs.
+    // base_name.impacts подхватывается, если он есть.
     void load(const std::string& base_name);
 
-    const InvertedIndex& get_inverted_index() const { return inverted_index_; }
+    // Версия индекса base_name - число в base_name.version. Индексатор увеличивает
+    // её последним шагом, когда все файлы индекса уже записаны; 0 - файла нет.
+    static uint64_t version(const std::string& base_name);
+    // Записывает версию на единицу больше текущей (атомарно, через rename) и возвращает её.
+    static uint64_t publish_version(const std::string& base_name);
+    // Шарды base_name (файл base_name.shards): индексатор разбил коллекцию по
+    // диапазонам DocId на индексы base_name.<имя>, глобальные DocId документов
+    // шарда - в base_name.<имя>.ids. Пусто - индекс не разбит.
+    static std::vector<std::string> shards(const std::string& base_name);
+    static void save_shards(const std::string& base_name, const std::vector<std::string>& names);
+
+    // TermId термина или kNoTerm. Запрос ищет каждый термин один раз, дальше
+    // работает с TermId.
+    TermId term_id(std::string_view term) const;
+    uint32_t num_terms() const;
+    // Postings термина по полям. Для сегмента декодируются при первом обращении.
+    const FieldPostings& postings(TermId id) const;
+    // Число документов, где термин есть хотя бы в одном поле; посчитано при индексации.
+    uint32_t doc_freq(TermId id) const;
+    // Память словаря терминов: строки и структуры поиска, без postings.
+    size_t dictionary_bytes() const;
     const ForwardIndex& get_forward_index() const { return forward_index_; }
+    const FieldNorms& get_norms() const { return norms_; }
+    // Квантованные вклады для score-at-a-time или nullptr, если их не строили.
+    const ImpactReader* impacts() const { return impacts_.get(); }
+
+    // Все термины по возрастанию вместе с postings. Postings сегмента декодируются
+    // заново и не кэшируются - это для офлайн-проходов по всему индексу.
+    void for_each_term(const std::function<void(std::string_view, const FieldPostings&)>& fn) const;
 
 private:
-    void add_field_to_index(DocId doc_id, const std::string& field_name, const std::string& text);
+    // Возвращает число токенов поля.
+    uint32_t add_field_to_index(InvertedIndex& target, DocId doc_id, uint32_t field, std::string_view text) const;
+    void build_block_max_for(FieldPostings& fields) const;
+    // Переносит термины из хеш-таблицы построения в отсортированный словарь.
+    void seal_dictionary();
+    // Обратно: хеш-таблица нужна, чтобы дописывать документы после seal_dictionary.
+    void unseal_dictionary();
+    void rebuild_norms();
+    static void append_postings(PostingsList& target, PostingsList&& source);
+    void load_legacy(const std::string& filename);
+    // Термины .inv и магическое число в конце; false, если файл не того формата.
+    // store = false - только проверка, индекс не меняется.
+    bool read_legacy_terms(std::ifstream& in, bool has_block_max, bool store);
+
+    static constexpr uint64_t kLegacyFormatVersion = 2;
 
+    // Пока идёт индексация, термины ищутся в inverted_index_.ids; после
+    // seal_dictionary таблица пуста, TermId - номер в dictionary_, а
+    // inverted_index_.postings упорядочены по нему.
     InvertedIndex inverted_index_;
+    TermDictionary dictionary_;
     ForwardIndex forward_index_;
+    FieldNorms norms_;
+    std::vector<uint32_t> doc_freqs_;  // по TermId, после build_postings_metadata
     Tokenizer tokenizer_;
-};
\ No newline at end of file
+
+    std::unique_ptr<SegmentReader> segment_;
+    std::unique_ptr<ImpactReader> impacts_;
+    mutable std::unique_ptr<std::once_flag[]> decode_once_;
+    mutable std::unique_ptr<std::unique_ptr<FieldPostings>[]> decoded_;
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include "Common.h"
+#include <algorithm>
+#include <cstddef>
+
+// Ядра пересечения отсортированных списков DocId без повторов. Для списков
+// близкого размера — слияние блоками: блок одного списка сравнивается со всеми
+// сдвигами блока другого (4x4 на SSE, 8x8 на AVX2). Если один список намного
+// длиннее, для каждого элемента короткого делается экспоненциальный поиск в
+// длинном, последний шаг — сравнение с блоком из 8 элементов.
+namespace intersect {
+
+// Во столько раз длинный список должен превосходить короткий, чтобы галоп
+// оказался быстрее слияния (см. bench/intersect_bench.cpp).
+constexpr size_t kGallopRatio = 48;
+
+enum class Kernel { kScalarMerge, kSseMerge, kAvx2Merge, kGallop };
+
+// Лучшее ядро слияния, которое поддерживает процессор.
+Kernel best_merge_kernel();
+// Ядро для списков длины n и m.
+Kernel choose(size_t n, size_t m);
+const char* kernel_name(Kernel kernel);
+
+// Пишет пересечение в out (места нужно на min(n, m) элементов), возвращает его длину.
+size_t intersect(const DocId* a, size_t n, const DocId* b, size_t m, DocId* out);
+// Явный выбор ядра - для бенчмарков и проверки ядер друг против друга.
+size_t intersect(Kernel kernel, const DocId* a, size_t n, const DocId* b, size_t m, DocId* out);
+
+inline DocList intersect(const DocList& a, const DocList& b) {
+    DocList out(std::min(a.size(), b.size()));
+    out.resize(intersect(a.data(), a.size(), b.data(), b.size(), out.data()));
+    return out;
+}
+
+}  // namespace intersect
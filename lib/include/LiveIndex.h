@@ -0,0 +1,215 @@
+#pragma once
+#include "Bitmap.h"
+#include "Index.h"
+#include "Parallel.h"
+#include "PostingsCursor.h"
+#include "SearchEngine.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Обновляемый индекс (коллекция base_name): неизменяемые сегменты на диске и
+// буфер изменений в памяти.
+// - Сегмент - обычный Index (base_name.<имя>.seg/.store/.norms), глобальные DocId
+//   его документов (.ids) и tombstones - битмап удалённых локальных DocId
+//   (.<поколение>.del). Исходный индекс base_name - сегмент без имени, его DocId
+//   и есть глобальные. Если индексатор разбил base_name на шарды (Index::shards),
+//   исходный индекс - это сегменты-шарды с именами шардов.
+// - add_document / delete_document только пополняют буфер. refresh() (фоновый
+//   поток, раз в refresh_interval) пишет добавленные документы новым сегментом,
+//   отмечает заменённые и удалённые документы в tombstones и публикует новый
+//   снимок - с этого момента изменения видны поиску.
+// - Фоновое слияние по уровням (tiered): когда набирается merge_factor сегментов
+//   одного уровня, они переписываются одним сегментом без удалённых документов;
+//   сегмент, где удалена половина документов, переписывается отдельно.
+// - Состав коллекции - base_name.manifest; он заменяется атомарно (rename) после
+//   каждого refresh и слияния. Изменения, не дошедшие до refresh, при падении
+//   процесса теряются.
+// - Манифест помнит версию base_name (Index::version). Если индексатор с тех пор
+//   пересобрал индекс, манифест устарел: коллекция начинается заново с нового
+//   base_name, дописанные к старой версии сегменты удаляются.
+// Поиск идёт по снимку (snapshot()): набор сегментов не меняется, пока снимок
+// жив, а запись и слияние не блокируют поиск.
+class LiveIndex {
+public:
+    struct Options {
+        // 0 - без фонового refresh, только явные вызовы refresh().
+        std::chrono::milliseconds refresh_interval{1000};
+        size_t merge_factor = 10;
+        // Кэш пересечений AND, общий для всех сегментов; nullptr - без кэша.
+        SearchEngine::ConjunctionCache* conjunction_cache = nullptr;
+        // Потоки для поиска по сегментам одного запроса; nullptr - по очереди.
+        ThreadPool* search_pool = nullptr;
+    };
+
+    struct Segment {
+        std::string name;  // пусто - исходный индекс base_name; шард исходного индекса - имя шарда
+        std::shared_ptr<const Index> index;
+        // Глобальные DocId по возрастанию, позиция - локальный DocId;
+        // nullptr - совпадают с локальными.
+        std::shared_ptr<const DocList> ids;
+        std::shared_ptr<const Bitmap> deleted;  // nullptr - удалённых нет
+        size_t num_deleted = 0;
+        uint64_t deleted_generation = 0;  // файл .del; 0 - его нет
+
+        size_t num_docs() const { return index->get_forward_index().size(); }
+        size_t live_docs() const { return num_docs() - num_deleted; }
+        DocId global_id(DocId local) const { return ids ? (*ids)[local] : local; }
+        // Локальный DocId неудалённого документа.
+        std::optional<DocId> find(DocId global) const;
+    };
+
+    // Снимок коллекции. Запросы выполняются в каждом сегменте (параллельно, если
+    // задан пул) с общей статистикой BM25 (CollectionStats), выдачи сливаются в
+    // общий top-k по глобальным DocId. Методы поиска повторяют SearchEngine.
+    class Snapshot {
+    public:
+        // base_version входит в ключи кэша пересечений: имена сегментов _N после
+        // пересборки исходного индекса начинаются заново, а кэш живёт дольше коллекции.
+        Snapshot(std::vector<Segment> segments, uint64_t generation, uint64_t base_version,
+                 SearchEngine::ConjunctionCache* cache, ThreadPool* pool = nullptr);
+        // Те же сегменты со статистикой всей распределённой коллекции, частью
+        // которой является local (шард в другом процессе). Движки сегментов
+        // создаются заново - годится на один запрос.
+        Snapshot(const Snapshot& local, CollectionStats stats);
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        // Растёт с каждым refresh и слиянием; годится в ключ кэша ответов.
+        uint64_t generation() const { return generation_; }
+        const std::vector<Segment>& segments() const { return segments_; }
+        // Неудалённые документы.
+        size_t num_docs() const;
+        // Статистика BM25 снимка: документы (с удалёнными, как и в df), средние
+        // длины полей и df по всем сегментам.
+        const CollectionStats& stats() const { return stats_; }
+        uint64_t total_length(uint32_t field) const { return total_length_[field]; }
+        // Термины запроса, по которым считается BM25 (SearchEngine::scoring_terms).
+        Tokens scoring_terms(const std::string& query_str) const;
+
+        ScoredDocs search_top_k(const std::string& query_str, size_t k, size_t offset = 0,
+                                double k1 = 1.2, double b = 0.75, double w_title = 5.0) const;
+        ScoredDocs search_ranked_or(const std::string& query_str, size_t k, size_t offset = 0,
+                                    double k1 = 1.2, double b = 0.75, double w_title = 5.0) const;
+        ScoredDocs search_impacts(const std::string& query_str, size_t k, size_t offset = 0,
+                                  double k1 = 1.2, double b = 0.75, double w_title = 5.0,
+                                  size_t postings_budget = 0) const;
+        std::vector<ScoredDocs> search_batch(const std::vector<SearchEngine::BatchQuery>& queries,
+                                             double k1 = 1.2, double b = 0.75, double w_title = 5.0,
+                                             size_t num_threads = 0) const;
+        std::string normalize_query(const std::string& query_str) const;
+        std::string explain(const std::string& query_str) const;
+
+        // Документ с глобальным DocId, если он есть и не удалён.
+        std::optional<Document> document(DocId id) const;
+
+    private:
+        // Движки сегментов; с collection_stats - по статистике stats_.
+        void init_engines(bool collection_stats);
+        // Разбор запроса, не зависящий от индекса.
+        const SearchEngine& parser() const;
+        // search(engine, k, offset) в каждом сегменте, выдачи - в общий top-k.
+        template <typename Search>
+        ScoredDocs gather(size_t k, size_t offset, Search&& search) const;
+
+        std::vector<Segment> segments_;
+        std::vector<std::unique_ptr<SearchEngine>> engines_;
+        CollectionStats stats_;
+        std::array<uint64_t, kNumFields> total_length_{};
+        uint64_t generation_;
+        uint64_t base_version_;
+        SearchEngine::ConjunctionCache* cache_;
+        ThreadPool* pool_;
+    };
+
+    // Открывает base_name.manifest; если его нет или он устарел - коллекция из
+    // исходного индекса base_name или его шардов (если нет и их - пустая).
+    LiveIndex(std::string base_name, Options options);
+    // close().
+    ~LiveIndex();
+
+    LiveIndex(const LiveIndex&) = delete;
+    LiveIndex& operator=(const LiveIndex&) = delete;
+
+    // Наибольший DocId документа: kEndDoc - метка конца postings в курсорах.
+    static constexpr DocId kMaxDocId = kEndDoc - 1;
+
+    // Документ получает новый DocId; если id задан - заменяет документ с этим DocId.
+    // id больше kMaxDocId - std::out_of_range; если новых DocId не осталось - std::length_error.
+    DocId add_document(std::string title, std::string plot, std::optional<DocId> id = std::nullopt);
+    // false, если документа с таким DocId нет.
+    bool delete_document(DocId id);
+    // Делает видимыми поиску все изменения, принятые до вызова.
+    void refresh();
+    // Одно слияние по политике уровней; false, если сливать нечего.
+    bool maybe_merge();
+    // Останавливает фоновые потоки, делает refresh накопленного и больше не
+    // пишет файлы коллекции: после close их может открыть другой LiveIndex.
+    // Поиск по snapshot() продолжает работать, add_document и delete_document
+    // бросают std::runtime_error. Повторный вызов ничего не делает.
+    void close();
+    // Снова принимает изменения после close(), если файлы коллекции с тех пор
+    // никто не менял - например, когда новая версия индекса не открылась.
+    void reopen();
+
+    std::shared_ptr<const Snapshot> snapshot() const { return snapshot_.load(); }
+    // Версия base_name, на которой построена коллекция.
+    uint64_t base_version() const { return base_version_; }
+
+private:
+    // Документы нового сегмента; добавляются по возрастанию глобальных DocId.
+    struct SegmentBuilder {
+        Index index;
+        DocList ids;
+
+        void add(DocId global, std::string_view title, std::string_view plot);
+    };
+
+    std::string segment_path(const std::string& name) const;
+    std::string deleted_path(const std::string& name, uint64_t generation) const;
+    // Под commit_mutex_.
+    std::string next_segment_name();
+    // Пишет сегмент на диск и открывает его отображённым в память.
+    Segment write_segment(SegmentBuilder& builder, const std::string& name);
+    Segment open_segment(const std::string& name, uint64_t deleted_generation) const;
+    // Файлы сегмента, кроме tombstones; исходный индекс не трогается.
+    void remove_segment_files(const std::string& name) const;
+    void load_manifest();
+    // Пишет tombstones изменившихся сегментов и манифест, публикует снимок и
+    // удаляет файлы, на которые манифест больше не ссылается. Под commit_mutex_.
+    void commit(std::vector<Segment> segments);
+    std::vector<size_t> pick_merge(const std::vector<Segment>& segments) const;
+    void start_threads();
+    void refresh_loop();
+    void merge_loop();
+    bool stopping();
+
+    std::string base_name_;
+    Options options_;
+    uint64_t base_version_ = 0;
+    std::atomic<bool> closed_{false};
+    std::atomic<std::shared_ptr<const Snapshot>> snapshot_;
+
+    std::mutex pending_mutex_;
+    std::map<DocId, std::optional<Document>> pending_;  // nullopt - удаление
+    DocId next_doc_ = 0;
+
+    std::mutex commit_mutex_;  // refresh и публикация слияний по одному
+    uint64_t generation_ = 0;
+    uint64_t next_segment_ = 0;
+    DocId committed_next_doc_ = 0;
+
+    std::mutex thread_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    bool merge_requested_ = false;
+    std::thread refresh_thread_;
+    std::thread merge_thread_;
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Счётчики кэша; общий тип для всех ShardedLruCache.
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t insertions = 0;
+    uint64_t evictions = 0;
+    uint64_t expirations = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// LRU-кэш, разбитый на шарды по хешу ключа: у каждого шарда свой мьютекс и своя
+// доля бюджета памяти, поэтому рабочие потоки сервера почти не ждут друг друга.
+// Размер записи оценивает вызывающий (bytes в put), к нему добавляется длина ключа.
+// Записи старше ttl считаются промахом и удаляются при обращении; ttl = 0 - без срока.
+template <typename Value>
+class ShardedLruCache {
+public:
+    using Stats = CacheStats;
+
+    ShardedLruCache(size_t memory_budget, std::chrono::milliseconds ttl, size_t num_shards = 16)
+        : shards_(std::max<size_t>(1, num_shards)), ttl_(ttl) {
+        for (auto& shard : shards_) shard.budget = memory_budget / shards_.size();
+    }
+
+    std::optional<Value> get(const std::string& key) {
+        Shard& shard = shard_of(key);
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        if (expired(*it->second)) {
+            shard.erase(it->second);
+            expirations_.fetch_add(1, std::memory_order_relaxed);
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second->value;
+    }
+
+    void put(const std::string& key, Value value, size_t bytes) {
+        Shard& shard = shard_of(key);
+        bytes += key.size();
+        if (bytes > shard.budget) return;
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) shard.erase(it->second);
+        shard.entries.push_front({key, std::move(value), bytes, std::chrono::steady_clock::now()});
+        shard.index.emplace(key, shard.entries.begin());
+        shard.bytes += bytes;
+        insertions_.fetch_add(1, std::memory_order_relaxed);
+        while (shard.bytes > shard.budget) {
+            shard.erase(std::prev(shard.entries.end()));
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            shard.entries.clear();
+            shard.index.clear();
+            shard.bytes = 0;
+        }
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.hits = hits_.load(std::memory_order_relaxed);
+        s.misses = misses_.load(std::memory_order_relaxed);
+        s.insertions = insertions_.load(std::memory_order_relaxed);
+        s.evictions = evictions_.load(std::memory_order_relaxed);
+        s.expirations = expirations_.load(std::memory_order_relaxed);
+        for (const auto& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            s.entries += shard.entries.size();
+            s.bytes += shard.bytes;
+        }
+        return s;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        Value value;
+        size_t bytes;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;  // в начале - недавние
+        std::unordered_map<std::string, typename std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        size_t budget = 0;
+
+        void erase(typename std::list<Entry>::iterator it) {
+            bytes -= it->bytes;
+            index.erase(it->key);
+            entries.erase(it);
+        }
+    };
+
+    Shard& shard_of(const std::string& key) { return shards_[std::hash<std::string>{}(key) % shards_.size()]; }
+
+    bool expired(const Entry& entry) const {
+        return ttl_.count() > 0 && std::chrono::steady_clock::now() - entry.created > ttl_;
+    }
+
+    std::vector<Shard> shards_;
+    std::chrono::milliseconds ttl_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> insertions_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> expirations_{0};
+};
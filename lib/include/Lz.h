@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Байтовый LZ77-кодек в формате блоков LZ4: последовательность = байт-токен
+// (длина литералов в старшей тетраде, длина совпадения - 4 в младшей; 15 означает
+// продолжение байтами по 255), литералы, 2 байта смещения назад и продолжение
+// длины совпадения. Последняя последовательность - только литералы. Совпадения
+// ищутся хеш-таблицей по 4 байтам, окно 64 КБ. Быстро распаковывается и не
+// требует внешних библиотек; блоки независимы.
+namespace lz {
+
+// Дописывает в out сжатые n байт.
+void compress(const char* in, size_t n, std::string& out);
+
+// Распаковывает [in, end) ровно в raw_size байт out.
+// Бросает std::runtime_error на повреждённых данных.
+void decompress(const uint8_t* in, const uint8_t* end, char* out, size_t raw_size);
+
+}  // namespace lz
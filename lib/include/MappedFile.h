@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Файл, отображённый в память только для чтения.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open " + path);
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot mmap " + path);
+            }
+            data_ = static_cast<const uint8_t*>(addr);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Подсказка ядру: доступ случайный, упреждающее чтение не нужно.
+    void advise_random() const {
+        if (data_) ::madvise(const_cast<uint8_t*>(data_), size_, MADV_RANDOM);
+    }
+
+    // Подсказка ядру: файл читается подряд, можно читать наперёд.
+    void advise_sequential() const {
+        if (data_) ::madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+    }
+
+    // Отдаёт ядру уже прочитанные страницы [0, offset), чтобы потоковое чтение
+    // большого файла не держало его целиком в резидентной памяти.
+    void release_prefix(size_t offset) const {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        offset -= offset % page;
+        if (data_ && offset > 0) ::madvise(const_cast<uint8_t*>(data_), offset, MADV_DONTNEED);
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,160 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Этапы выполнения запроса. Сопоставление и BM25 в DAAT / WAND идут одним
+// проходом курсоров, поэтому это один этап evaluate.
+enum class Stage : uint8_t {
+    Cache,      // нормализация запроса и поиск в кэше ответов
+    Parse,      // tokenize_query, to_rpn, построение и оптимизация плана (оценки
+                // мощностей читают postings, так что первая распаковка термина - здесь)
+    Prepare,    // термины для BM25, idf, postings по полям
+    Evaluate,   // сопоставление и ранжирование
+    Fetch,      // чтение документов выдачи
+    Serialize,  // JSON ответа
+    Count
+};
+
+constexpr size_t kNumStages = static_cast<size_t>(Stage::Count);
+const char* stage_name(Stage stage);
+
+// Трассировка одного запроса в потоке, который его выполняет. Пока объект жив,
+// QueryTrace::current() указывает на него, и SearchEngine отмечает в нём этапы;
+// без активной трассировки отметки сводятся к одной проверке указателя.
+// Время этапа - от предыдущей отметки (или создания трассировки) до mark().
+class QueryTrace {
+public:
+    QueryTrace() : start_(std::chrono::steady_clock::now()), last_(start_), previous_(current_) { current_ = this; }
+    ~QueryTrace() { current_ = previous_; }
+
+    QueryTrace(const QueryTrace&) = delete;
+    QueryTrace& operator=(const QueryTrace&) = delete;
+
+    static QueryTrace* current() { return current_; }
+
+    static void mark(Stage stage) {
+        if (QueryTrace* trace = current_) trace->mark_stage(stage);
+    }
+    // Счётчики запроса: postings в списках терминов (для saat - реально
+    // обработанные), документы, для которых посчитан полный score.
+    static void add_postings(uint64_t n) {
+        if (QueryTrace* trace = current_) trace->postings += n;
+    }
+    static void add_scored(uint64_t n) {
+        if (QueryTrace* trace = current_) trace->scored += n;
+    }
+
+    // Итоги части запроса, выполненной в другом потоке под собственной
+    // трассировкой: current() там свой, и отметки SearchEngine до запроса не доходят.
+    struct Part {
+        std::array<uint64_t, kNumStages> stage_ns{};
+        uint64_t postings = 0;
+        uint64_t scored = 0;
+    };
+    Part part() const { return {stage_ns, postings, scored}; }
+    // Складывает счётчики частей, а время с предыдущей отметки (части шли
+    // параллельно) делит между этапами пропорционально их времени в частях.
+    void mark_parts(std::span<const Part> parts);
+
+    void mark_stage(Stage stage) {
+        auto now = std::chrono::steady_clock::now();
+        stage_ns[static_cast<size_t>(stage)] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+        last_ = now;
+    }
+    // Общее время с создания трассировки.
+    uint64_t total_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::array<uint64_t, kNumStages> stage_ns{};
+    uint64_t postings = 0;
+    uint64_t scored = 0;
+    uint64_t results = 0;
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_;
+    QueryTrace* previous_;
+    static thread_local QueryTrace* current_;
+};
+
+// Номер полосы для потока: потоки распределяются по kMetricStripes полосам по
+// кругу, так что запись в гистограмму или счётчик - relaxed-инкремент почти
+// всегда без конкуренции за строку кэша.
+constexpr size_t kMetricStripes = 16;
+size_t metric_stripe();
+
+class StripedCounter {
+public:
+    void add(uint64_t n) { stripes_[metric_stripe()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Stripe, kMetricStripes> stripes_;
+};
+
+// Гистограмма задержек в наносекундах в духе HDR: на каждую степень двойки
+// 8 линейных корзин, относительная погрешность не больше 1/8. Значения от
+// 2^40 нс (~18 минут) попадают в последнюю корзину.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+    static constexpr int kMaxExponent = 40;
+    static constexpr size_t kBuckets = (kMaxExponent - kSubBucketBits + 2) << kSubBucketBits;
+
+    struct Snapshot {
+        std::vector<uint64_t> counts;  // по корзинам
+        uint64_t count = 0;
+        uint64_t sum_ns = 0;
+
+        // Верхняя граница корзины, в которую попадает квантиль q.
+        uint64_t quantile(double q) const;
+    };
+
+    static size_t bucket(uint64_t ns);
+    // Наибольшее значение, попадающее в корзину.
+    static uint64_t bucket_upper(size_t bucket);
+
+    void record(uint64_t ns);
+    Snapshot snapshot() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::array<std::atomic<uint64_t>, kBuckets> counts{};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+    std::array<Stripe, kMetricStripes> stripes_;
+};
+
+// Метрики запросов сервера: гистограммы по этапам и общая, счётчики.
+// prometheus() отдаёт их в текстовом формате Prometheus.
+class QueryMetrics {
+public:
+    void record(const QueryTrace& trace, uint64_t total_ns);
+    void record_error() { errors_.add(1); }
+    void record_cache_hit(uint64_t total_ns) {
+        cache_hits_.add(1);
+        total_.record(total_ns);
+    }
+
+    std::string prometheus() const;
+
+private:
+    std::array<LatencyHistogram, kNumStages> stages_;
+    LatencyHistogram total_;
+    StripedCounter queries_;
+    StripedCounter cache_hits_;
+    StripedCounter errors_;
+    StripedCounter postings_;
+    StripedCounter scored_;
+    StripedCounter results_;
+};
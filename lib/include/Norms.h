@@ -0,0 +1,42 @@
+#pragma once
+#include "Common.h"
+#include "Field.h"
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Длина поля (число токенов) в одном байте, как нормы Lucene: до 32 токенов
+// точно, дальше 5 значащих бит с округлением вниз (ошибка меньше 1/16).
+// Кодирование монотонно: меньшей норме соответствует не большая длина.
+namespace norms {
+
+uint8_t encode(uint32_t length);
+uint32_t decode(uint8_t norm);
+
+}  // namespace norms
+
+// Нормы всех полей: плотный массив байтов на поле (FieldId), индекс - DocId.
+// Точные суммы длин хранятся отдельно, средняя длина поля из них не искажается
+// квантованием. Файл base_name.norms пишется вместе с индексом.
+class FieldNorms {
+public:
+    // Массивы всех полей растут до doc + 1.
+    void set(uint32_t field, DocId doc, uint32_t length);
+
+    uint8_t norm(uint32_t field, DocId doc) const { return doc < norms_[field].size() ? norms_[field][doc] : 0; }
+    const std::vector<uint8_t>& field_norms(uint32_t field) const { return norms_[field]; }
+    double avg_length(uint32_t field) const;
+    uint64_t total_length(uint32_t field) const { return total_length_[field]; }
+    size_t num_docs() const { return num_docs_; }
+
+    void clear();
+    void save(const std::string& filename) const;
+    // false, если файла нет (индексы, построенные до появления норм).
+    bool load(const std::string& filename);
+
+private:
+    std::array<std::vector<uint8_t>, kNumFields> norms_;
+    std::array<uint64_t, kNumFields> total_length_{};
+    size_t num_docs_ = 0;
+};
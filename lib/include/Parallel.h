@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Запускает fn(0..n-1) в n потоках; первое исключение пробрасывается наружу.
+inline void run_parallel(size_t n, const std::function<void(size_t)>& fn) {
+    std::vector<std::exception_ptr> errors(n);
+    std::vector<std::thread> workers;
+    workers.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        workers.emplace_back([&, i] {
+            try {
+                fn(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    for (auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+}
+
+// Число рабочих потоков по умолчанию: по одному на ядро.
+inline size_t default_num_threads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Постоянные потоки для частей одного запроса (поиск по сегментам и шардам),
+// без создания потоков на каждый запрос. Вызывающий поток сам выполняет ещё
+// не взятые задачи своего run, поэтому занятый другими запросами пул только
+// уменьшает параллельность, но не заставляет ждать в очереди.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+    // fn(0..n-1) в потоках пула и вызывающем; первое исключение пробрасывается наружу.
+    void run(size_t n, const std::function<void(size_t)>& fn);
+
+private:
+    struct Batch;
+    void worker_loop();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::shared_ptr<Batch>> queue_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
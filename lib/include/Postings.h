@@ -0,0 +1,148 @@
+#pragma once
+#include "Bitmap.h"
+#include "Common.h"
+#include "Field.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <string>
+#include <string_view>
+
+// Размер блока для Block-Max метаданных.
+constexpr size_t kBlockSize = 128;
+
+// Postings в виде структуры массивов: DocId, tf и позиции лежат в отдельных
+// непрерывных массивах. Позиции всех документов идут подряд, pos_offsets[i] —
+// начало позиций docs[i], их количество равно tfs[i].
+struct PostingsList {
+    DocList docs;
+    std::vector<uint32_t> tfs;
+    std::vector<uint32_t> positions;
+    std::vector<uint32_t> pos_offsets;
+
+    // Метаданные блоков по kBlockSize документов: последний DocId блока,
+    // максимальный tf и минимальная норма поля (см. Norms.h) в блоке. Не зависят
+    // от параметров BM25F, поэтому верхние оценки считаются уже во время запроса.
+    std::vector<DocId> block_last;
+    std::vector<uint32_t> block_max_tf;
+    std::vector<uint32_t> block_min_norm;
+    uint32_t max_tf = 0;
+    uint32_t min_norm = 0;
+
+    // Копия docs в виде битмапа, только для плотных списков (см. build_bitmap).
+    std::shared_ptr<const Bitmap> bitmap;
+
+    size_t size() const { return docs.size(); }
+
+    std::span<const uint32_t> positions_of(size_t i) const {
+        return {positions.data() + pos_offsets[i], tfs[i]};
+    }
+
+    void add(DocId doc, std::span<const uint32_t> doc_positions) {
+        docs.push_back(doc);
+        tfs.push_back(static_cast<uint32_t>(doc_positions.size()));
+        pos_offsets.push_back(static_cast<uint32_t>(positions.size()));
+        positions.insert(positions.end(), doc_positions.begin(), doc_positions.end());
+    }
+
+    // Дописывает postings с большими DocId в конец.
+    void append(const PostingsList& other) {
+        uint32_t shift = static_cast<uint32_t>(positions.size());
+        docs.insert(docs.end(), other.docs.begin(), other.docs.end());
+        tfs.insert(tfs.end(), other.tfs.begin(), other.tfs.end());
+        for (uint32_t offset : other.pos_offsets) pos_offsets.push_back(offset + shift);
+        positions.insert(positions.end(), other.positions.begin(), other.positions.end());
+    }
+
+    void clear() {
+        docs.clear();
+        tfs.clear();
+        positions.clear();
+        pos_offsets.clear();
+        bitmap.reset();
+    }
+};
+
+// Postings термина по полям, индекс - FieldId; пустой список - термина в поле нет.
+using FieldPostings = std::array<PostingsList, kNumFields>;
+
+// Обратный индекс в процессе построения: термин получает TermId при первой
+// встрече, postings лежат плоским массивом по (TermId, FieldId). Строки терминов
+// нужны только для поиска при добавлении документов; готовый индекс хранит их
+// в отсортированном TermDictionary (см. Index::build_postings_metadata).
+struct InvertedIndex {
+    struct TermHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view term) const { return std::hash<std::string_view>{}(term); }
+    };
+
+    std::unordered_map<Term, TermId, TermHash, std::equal_to<>> ids;
+    std::vector<FieldPostings> postings;
+
+    TermId intern(std::string_view term) {
+        auto it = ids.find(term);
+        if (it != ids.end()) return it->second;
+        TermId id = static_cast<TermId>(postings.size());
+        ids.emplace(term, id);
+        postings.emplace_back();
+        return id;
+    }
+
+    size_t size() const { return postings.size(); }
+    bool empty() const { return postings.empty(); }
+    void clear() {
+        ids.clear();
+        postings.clear();
+    }
+};
+
+inline void build_bitmap(PostingsList& postings, size_t num_docs) {
+    postings.bitmap.reset();
+    if (is_dense(postings.docs.size(), num_docs)) {
+        postings.bitmap = std::make_shared<const Bitmap>(Bitmap::from_sorted(postings.docs));
+    }
+}
+
+// Block-Max метаданные по нормам поля (norms[DocId]).
+inline void build_block_max(PostingsList& postings, const std::vector<uint8_t>& norms) {
+    auto norm = [&](DocId id) -> uint32_t { return id < norms.size() ? norms[id] : 0; };
+    postings.block_last.clear();
+    postings.block_max_tf.clear();
+    postings.block_min_norm.clear();
+    postings.max_tf = 0;
+    postings.min_norm = UINT32_MAX;
+    for (size_t begin = 0; begin < postings.docs.size(); begin += kBlockSize) {
+        size_t end = std::min(begin + kBlockSize, postings.docs.size());
+        uint32_t max_tf = 0;
+        uint32_t min_norm = UINT32_MAX;
+        for (size_t i = begin; i < end; ++i) {
+            max_tf = std::max(max_tf, postings.tfs[i]);
+            min_norm = std::min(min_norm, norm(postings.docs[i]));
+        }
+        postings.block_last.push_back(postings.docs[end - 1]);
+        postings.block_max_tf.push_back(max_tf);
+        postings.block_min_norm.push_back(min_norm);
+        postings.max_tf = std::max(postings.max_tf, max_tf);
+        postings.min_norm = std::min(postings.min_norm, min_norm);
+    }
+    if (postings.docs.empty()) postings.min_norm = 0;
+}
+
+// Число документов, где термин есть хотя бы в одном поле.
+inline uint32_t term_doc_freq(const FieldPostings& fields) {
+    const DocList* single = nullptr;
+    size_t non_empty = 0;
+    for (const auto& postings : fields) {
+        if (postings.docs.empty()) continue;
+        single = &postings.docs;
+        ++non_empty;
+    }
+    if (non_empty <= 1) return single ? static_cast<uint32_t>(single->size()) : 0;
+    DocList all;
+    for (const auto& postings : fields) all.insert(all.end(), postings.docs.begin(), postings.docs.end());
+    std::sort(all.begin(), all.end());
+    return static_cast<uint32_t>(std::unique(all.begin(), all.end()) - all.begin());
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Postings.h"
+#include <algorithm>
+#include <limits>
+
+constexpr DocId kEndDoc = std::numeric_limits<DocId>::max();
+
+// Курсор по postings одного поля. Двигается только вперёд; на текущем
+// документе сразу доступны tf и позиции.
+struct PostingsCursor {
+    const PostingsList* postings;
+    uint32_t field;  // номер поля в FieldNorms
+    size_t pos = 0;
+    size_t block = 0;
+
+    DocId doc() const { return pos < postings->docs.size() ? postings->docs[pos] : kEndDoc; }
+
+    // Галопирующий поиск первого документа >= target начиная с текущей позиции.
+    void advance(DocId target) {
+        const auto& docs = postings->docs;
+        if (pos >= docs.size() || docs[pos] >= target) return;
+        size_t step = 1;
+        size_t lo = pos;
+        size_t hi = pos + 1;
+        while (hi < docs.size() && docs[hi] < target) {
+            lo = hi;
+            step <<= 1;
+            hi = lo + step;
+        }
+        hi = std::min(hi, docs.size());
+        pos = std::lower_bound(docs.begin() + lo, docs.begin() + hi, target) - docs.begin();
+    }
+
+    // Сдвигает указатель блока на блок, который может содержать target.
+    bool shallow_advance(DocId target) {
+        const auto& last = postings->block_last;
+        while (block < last.size() && last[block] < target) ++block;
+        return block < last.size();
+    }
+
+    uint32_t tf() const { return postings->tfs[pos]; }
+    std::span<const uint32_t> positions() const { return postings->positions_of(pos); }
+};
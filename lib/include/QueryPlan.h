@@ -0,0 +1,49 @@
+#pragma once
+#include "Common.h"
+#include "Field.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Дерево выполнения булева запроса. Строится из RPN, затем оптимизируется:
+// вложенные AND/OR сливаются в n-арные узлы, AND сортируется по возрастанию
+// оценки мощности, AND с отрицаниями превращается в AND_NOT, пустые ветви
+// отбрасываются.
+struct PlanNode {
+    enum class Op { Term, And, Or, Not, AndNot, Prox, Empty };
+
+    Op op = Op::Empty;
+    // AndNot: children[0] — что берём, остальные — что вычитаем.
+    std::vector<std::unique_ptr<PlanNode>> children;
+
+    // Op::Term
+    Term term;
+    std::optional<std::string> field;
+    // Найдены в словаре при построении плана: term_id - kNoTerm, если термина
+    // нет в индексе; field_id - kNoField без квалификатора или для неизвестного поля.
+    TermId term_id = kNoTerm;
+    uint32_t field_id = kNoField;
+    // Op::Prox: оператор целиком, например "NEAR/3" или "ADJ".
+    std::string prox;
+
+    size_t estimate = 0;               // оценка мощности до выполнения
+    std::optional<size_t> actual;      // мощность после выполнения
+
+    // Ищется ли Op::Term в поле f: без квалификатора - во всех полях.
+    bool has_field(uint32_t f) const { return !field || field_id == f; }
+
+    static std::unique_ptr<PlanNode> make(Op op) {
+        auto node = std::make_unique<PlanNode>();
+        node->op = op;
+        return node;
+    }
+};
+
+// Текстовое представление плана: по узлу на строку, с отступами,
+// оценкой и фактической мощностью.
+std::string describe_plan(const PlanNode& node);
+
+// Каноническая запись поддерева без оценок, например "(AND title:a (OR b c))":
+// ключ для кэша промежуточных результатов.
+std::string plan_key(const PlanNode& node);
@@ -1,68 +1,142 @@
 #pragma once
 #include "Index.h"
+#include <array>
 #include <cmath>
 #include <vector>
 #include <algorithm>
-#include <iostream>
+#include <functional>
+#include <string_view>
 
+// Статистика коллекции, частью которой является индекс (сегмент живого индекса).
+// Если она задана, idf и средние длины полей считаются по всей коллекции, и score
+// документа не зависит от того, в каком сегменте он лежит.
+struct CollectionStats {
+    size_t num_docs = 0;
+    std::array<double, kNumFields> avg_length{};
+    // Число документов коллекции с термином.
+    std::function<uint32_t(std::string_view term)> doc_freq;
+};
+
+// BM25F: частоты термина по полям складываются в одну псевдо-частоту
+//   tf = sum_f w_f * tf_f / (1 - b + b * len_f / avg_len_f),
+// которая затем насыщается как в BM25: idf * tf * (k1 + 1) / (tf + k1).
+// w_f = w_title для title и 1 для остальных полей; len_f берётся из квантованных
+// норм, поэтому множитель поля для всех 256 значений нормы считается один раз
+// на запрос, а в цикле по документам остаётся чтение байта и таблицы.
 class Ranker {
 public:
-    explicit Ranker(const Index& index) : index_(index) {
-        avgdl_ = index_.get_forward_index().get_avg_dl();
-        total_docs_ = index_.get_forward_index().size();
-        if (avgdl_ <= 0.0001) avgdl_ = 1.0;
+    // Всё, что зависит только от запроса: postings по полям и idf.
+    // Считается один раз на запрос, а не на каждый документ.
+    struct PreparedField {
+        const PostingsList* postings;
+        uint32_t field;  // FieldId
+
+        bool operator==(const PreparedField&) const = default;
+    };
+    struct PreparedTerm {
+        double idf = 0.0;
+        std::vector<PreparedField> fields;
+    };
+    using PreparedQuery = std::vector<PreparedTerm>;
+
+    // stats - статистика всей коллекции или nullptr, если индекс и есть коллекция.
+    Ranker(const Index& index, double k1, double b, double w_title, const CollectionStats* stats = nullptr)
+        : index_(index), stats_(stats), k1_(k1) {
+        const auto& norms = index_.get_norms();
+        num_docs_ = index_.get_forward_index().size();
+        total_docs_ = stats_ ? stats_->num_docs : num_docs_;
         if (total_docs_ == 0) total_docs_ = 1;
+        for (uint32_t f = 0; f < kNumFields; ++f) {
+            double weight = f == kTitleField ? w_title : 1.0;
+            double avg = stats_ ? stats_->avg_length[f] : norms.avg_length(f);
+            if (avg <= 0.0001) avg = 1.0;
+            fields_[f].norms = norms.field_norms(f).data();
+            fields_[f].num_docs = norms.field_norms(f).size();
+            for (size_t n = 0; n < 256; ++n) {
+                fields_[f].scale[n] = weight / (1 - b + b * (norms::decode(static_cast<uint8_t>(n)) / avg));
+            }
+        }
     }
 
-    double score(DocId doc_id, const std::vector<Term>& query_terms, double k1, double b, double w_title) const {
-        double score = 0.0;
-        if (doc_id >= total_docs_) return 0.0;
+    // Термины вместе с их TermId, уже найденными в словаре (kNoTerm пропускаются).
+    PreparedQuery prepare(const std::vector<Term>& query_terms, const std::vector<TermId>& term_ids) const {
+        PreparedQuery prepared;
+        for (size_t i = 0; i < term_ids.size(); ++i) {
+            TermId id = term_ids[i];
+            if (id == kNoTerm) continue;
+            double doc_freq = stats_ ? stats_->doc_freq(query_terms[i]) : index_.doc_freq(id);
+            if (doc_freq == 0) continue;
+            const FieldPostings& term_fields = index_.postings(id);
+            PreparedTerm pt;
+            pt.idf = idf(doc_freq);
+            for (uint32_t f = 0; f < kNumFields; ++f) {
+                if (!term_fields[f].docs.empty()) pt.fields.push_back({&term_fields[f], f});
+            }
+            prepared.push_back(std::move(pt));
+        }
+        return prepared;
+    }
 
-        double dl = index_.get_forward_index().get_doc_length(doc_id);
+    PreparedQuery prepare(const std::vector<Term>& query_terms) const {
+        std::vector<TermId> ids;
+        ids.reserve(query_terms.size());
+        for (const auto& term : query_terms) ids.push_back(index_.term_id(term));
+        return prepare(query_terms, ids);
+    }
 
-        for (const auto& term : query_terms) {
-            const auto& inv_idx = index_.get_inverted_index();
-            auto it = inv_idx.find(term);
-            if (it == inv_idx.end()) continue;
+    double idf(double doc_freq) const {
+        double idf = std::log((total_docs_ - doc_freq + 0.5) / (doc_freq + 0.5) + 1.0);
+        return idf < 0 ? 0 : idf;
+    }
 
-            double doc_freq = 0;
-            const auto& fields = it->second;
-            for(const auto& [field, postings] : fields) {
-                if (postings.docs.size() > doc_freq) doc_freq = postings.docs.size();
-            }
-            
-            if (doc_freq == 0) continue;
-            double idf = std::log((total_docs_ - doc_freq + 0.5) / (doc_freq + 0.5) + 1.0);
-            if (idf < 0) idf = 0;
+    uint8_t norm(uint32_t field, DocId doc_id) const {
+        const auto& f = fields_[field];
+        return doc_id < f.num_docs ? f.norms[doc_id] : 0;
+    }
+
+    // Вклад поля в псевдо-частоту при данной норме поля.
+    double field_tf(uint32_t field, double tf, uint8_t norm) const { return tf * fields_[field].scale[norm]; }
+
+    // Вклад одного термина по его псевдо-частоте tf.
+    double term_score(double idf, double tf) const {
+        if (tf == 0) return 0.0;
+        return idf * (tf * (k1_ + 1) / (tf + k1_));
+    }
+
+    double score(DocId doc_id, const PreparedQuery& query) const {
+        double score = 0.0;
+        if (doc_id >= num_docs_) return 0.0;
 
+        for (const auto& term : query) {
             double tf = 0;
-            for (const auto& [field, postings] : fields) {
-                if (postings.docs.empty()) continue;
-
-                auto it_doc = std::lower_bound(postings.docs.begin(), postings.docs.end(), doc_id);
-                
-                if (it_doc != postings.docs.end() && *it_doc == doc_id) {
-                    size_t idx = std::distance(postings.docs.begin(), it_doc);
-                    if (idx < postings.positions.size()) {
-                        double field_tf = postings.positions[idx].size();
-                        if (field == "title") {
-                            field_tf *= w_title;
-                        }
-                        
-                        tf += field_tf;
-                    } 
+            for (const auto& [postings, field] : term.fields) {
+                auto it_doc = std::lower_bound(postings->docs.begin(), postings->docs.end(), doc_id);
+
+                if (it_doc != postings->docs.end() && *it_doc == doc_id) {
+                    size_t idx = std::distance(postings->docs.begin(), it_doc);
+                    if (idx < postings->tfs.size()) tf += field_tf(field, postings->tfs[idx], norm(field, doc_id));
                 }
             }
-
-            double num = tf * (k1 + 1);
-            double den = tf + k1 * (1 - b + b * (dl / avgdl_));
-            score += idf * (num / den);
+            score += term_score(term.idf, tf);
         }
         return score;
     }
 
+    double score(DocId doc_id, const std::vector<Term>& query_terms) const {
+        return score(doc_id, prepare(query_terms));
+    }
+
 private:
+    struct FieldScale {
+        const uint8_t* norms = nullptr;
+        size_t num_docs = 0;
+        std::array<double, 256> scale{};
+    };
+
     const Index& index_;
-    double avgdl_;
-    size_t total_docs_;
-};
\ No newline at end of file
+    const CollectionStats* stats_;
+    double k1_;
+    size_t num_docs_;    // документов в индексе
+    size_t total_docs_;  // документов в коллекции, для idf
+    std::array<FieldScale, kNumFields> fields_;
+};
@@ -2,13 +2,78 @@
 #include "Index.h"
 #include "Tokenizer.h"
 #include "Common.h"
+#include "DocSet.h"
+#include "LruCache.h"
+#include "Parallel.h"
+#include "QueryPlan.h"
+#include "Ranker.h"
 #include <optional>
+#include <unordered_map>
 #include <variant>
 
 class SearchEngine {
 public:
     explicit SearchEngine(const Index& index);//добавить проксимити
     DocList search(const std::string& query_str, double k1 = 1.2, double b = 0.75, double w_title = 5.0) const;
+    // Ранжированная выдача: только документы [offset, offset + k) по убыванию BM25.
+    ScoredDocs search_top_k(const std::string& query_str, size_t k, size_t offset = 0,
+                            double k1 = 1.2, double b = 0.75, double w_title = 5.0) const;
+    // Ранжированный OR по ключевым словам (Block-Max WAND). Запросы с операторами,
+    // скобками или полями выполняются как обычный булев поиск.
+    ScoredDocs search_ranked_or(const std::string& query_str, size_t k, size_t offset = 0,
+                                double k1 = 1.2, double b = 0.75, double w_title = 5.0) const;
+    // Ранжированный OR score-at-a-time по квантованным вкладам (Index::impacts):
+    // обход останавливается после postings_budget postings (0 - без ограничения).
+    // Если вкладов нет, они посчитаны для других k1/b/w_title или в запросе есть
+    // операторы, запрос выполняется точно через search_ranked_or.
+    ScoredDocs search_impacts(const std::string& query_str, size_t k, size_t offset = 0,
+                              double k1 = 1.2, double b = 0.75, double w_title = 5.0,
+                              size_t postings_budget = 0) const;
+    struct BatchQuery {
+        std::string query;
+        size_t k = 20;
+        size_t offset = 0;
+    };
+    // Пачка запросов search_top_k с общими k1/b/w_title в num_threads потоках
+    // (0 - по числу ядер или по размеру пула set_thread_pool). Общая работа делается один раз на пачку: таблицы
+    // Ranker, поиск терминов в словаре, распаковка их postings и idf; одинаковые
+    // запросы выполняются один раз. Результаты - в порядке queries.
+    std::vector<ScoredDocs> search_batch(const std::vector<BatchQuery>& queries,
+                                         double k1 = 1.2, double b = 0.75, double w_title = 5.0,
+                                         size_t num_threads = 0) const;
+
+    // Запрос после tokenize_query/parse_query_token: операторы в верхнем регистре,
+    // термины нормализованы токенизатором, пустой термин (стоп-слово) - "∅".
+    // Запросы с одинаковой нормальной формой дают одинаковую выдачу - годится
+    // как ключ кэша результатов.
+    std::string normalize_query(const std::string& query_str) const;
+
+    // Кэш списков документов узлов AND по plan_key; nullptr - без кэша.
+    // Кэш должен жить дольше SearchEngine. key_prefix отделяет записи разных
+    // индексов (сегментов), если кэш у них общий.
+    using ConjunctionCache = ShardedLruCache<std::shared_ptr<const DocList>>;
+    void set_conjunction_cache(ConjunctionCache* cache, std::string key_prefix = {}) {
+        conjunction_cache_ = cache;
+        conjunction_key_prefix_ = std::move(key_prefix);
+    }
+
+    // Индекс - часть коллекции (сегмент LiveIndex): BM25 по статистике всей
+    // коллекции; nullptr - по статистике индекса. Должна жить дольше SearchEngine.
+    void set_collection_stats(const CollectionStats* stats) { collection_stats_ = stats; }
+    // Удалённые документы (tombstones): не попадают в ранжированную выдачу;
+    // nullptr - удалённых нет. Должны жить дольше SearchEngine.
+    void set_deleted(const Bitmap* deleted) { deleted_ = deleted; }
+    // Потоки для search_batch; nullptr - свои потоки на каждую пачку. Пул должен
+    // жить дольше SearchEngine.
+    void set_thread_pool(ThreadPool* pool) { thread_pool_ = pool; }
+
+    // Выполняет булеву часть запроса и возвращает выбранный план с оценками
+    // и фактическими мощностями узлов.
+    std::string explain(const std::string& query_str) const;
+
+    // Термины запроса, по которым считается BM25: без операторов и скобок,
+    // квалификатор поля отбрасывается.
+    Tokens scoring_terms(const std::string& query_str) const;
 
     struct QueryTerm {
         Term term;
@@ -16,22 +81,41 @@ public:
     };
 
 private:
+    // TermId терминов одного запроса: термин, который встречается и в плане,
+    // и среди терминов BM25, ищется в словаре один раз. shared - TermId, уже
+    // найденные для всей пачки запросов.
+    class TermLookup {
+    public:
+        explicit TermLookup(const Index& index, const std::unordered_map<Term, TermId>* shared = nullptr)
+            : index_(index), shared_(shared) {}
+        TermId operator()(const Term& term);
+        std::vector<TermId> operator()(const Tokens& terms);
+
+    private:
+        const Index& index_;
+        const std::unordered_map<Term, TermId>* shared_;
+        std::vector<std::pair<Term, TermId>> resolved_;
+    };
+
     Tokens tokenize_query(const std::string& s) const;
     Tokens insert_implicit_and(const Tokens& tokens) const;
     Tokens to_rpn(const Tokens& tokens) const;
-    DocList evaluate_rpn(const Tokens& rpn) const;
 
-    const PostingsList* get_postings(const QueryTerm& q_term) const;
-    DocList get_doc_ids(const QueryTerm& q_term) const;
+    std::unique_ptr<PlanNode> plan(const std::string& query_str, TermLookup& lookup) const;
+    std::unique_ptr<PlanNode> build_plan(const Tokens& rpn, TermLookup& lookup) const;
+    std::unique_ptr<PlanNode> optimize(std::unique_ptr<PlanNode> node) const;
+    std::unique_ptr<PlanNode> finish_and(std::vector<std::unique_ptr<PlanNode>> children) const;
+    std::unique_ptr<PlanNode> finish_or(std::vector<std::unique_ptr<PlanNode>> children) const;
+    ScoredDocs search_plan(PlanNode& root, const Ranker& ranker, const Ranker::PreparedQuery& prepared,
+                           size_t k, size_t offset) const;
+    DocSet execute(PlanNode& node) const;
+    std::shared_ptr<const DocList> cached_conjunction(PlanNode& node) const;
 
-    DocList execute_intersect(const PostingsList* left, const PostingsList* right) const;
-    DocList execute_intersect_vec(const DocList& left, const PostingsList* right) const;
-    DocList execute_intersect_vec_vec(const DocList& left, const DocList& right) const;
+    DocSet get_doc_set(const PlanNode& term_node) const;
+    // fn(0..n-1) в пуле или в своих потоках.
+    void run_workers(size_t n, const std::function<void(size_t)>& fn) const;
 
-    DocList execute_union(const DocList& a, const DocList& b) const;
-    DocList execute_not(const DocList& operand) const;
-    
-    DocList execute_prox(const std::string& op_token, const QueryTerm& left, const QueryTerm& right, const DocList& l_docs, const DocList& r_docs) const;
+    DocList execute_prox(const std::string& op_token, const PlanNode& left, const PlanNode& right, const DocList& common_docs) const;
 
     QueryTerm parse_query_token(const std::string& token) const;
     static bool is_operator(const std::string& token);
@@ -39,4 +123,9 @@ private:
 
     const Index& index_;
     Tokenizer tokenizer_;
+    ConjunctionCache* conjunction_cache_ = nullptr;
+    std::string conjunction_key_prefix_;
+    const CollectionStats* collection_stats_ = nullptr;
+    const Bitmap* deleted_ = nullptr;
+    ThreadPool* thread_pool_ = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+#include "Postings.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <string_view>
+
+// Неизменяемый сегмент обратного индекса.
+// Раскладка файла (целые числа little-endian):
+//   [заголовок][имена полей][postings][positions][словарь][строки терминов]
+// Словарь - отсортированный массив записей фиксированного размера, поэтому термин
+// ищется бинарным поиском прямо по отображённой памяти, а postings декодируются
+// только для тех терминов, которые встретились в запросах.
+//
+// Запись словаря: строка термина, df термина (документы хотя бы с одним полем)
+// и по записи на поле; поля в файле идут по имени и сопоставляются с FieldId
+// при чтении.
+//
+// Postings одного поля хранятся блоками по kBlockSize документов: метаданные
+// блоков (last, max_tf, min_norm по uint32), таблица смещений блоков (uint32),
+// затем для каждого блока дельты DocId и tf - 1, сжатые block_codec.
+// Positions: таблица смещений блоков (uint64), затем для каждого блока все
+// дельты позиций его документов одним потоком block_codec. Каждый блок
+// декодируется независимо.
+class SegmentWriter {
+public:
+    SegmentWriter(const std::string& path, uint32_t num_docs);
+    ~SegmentWriter();
+
+    SegmentWriter(const SegmentWriter&) = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    // Термины должны добавляться строго по возрастанию.
+    void add_term(std::string_view term, const FieldPostings& postings);
+    void finish();
+
+private:
+    std::string path_;
+    std::string positions_path_;
+    std::vector<uint32_t> fields_;  // FieldId в порядке файла
+    uint32_t num_docs_;
+    std::ofstream out_;
+    std::ofstream positions_out_;
+    uint64_t postings_size_ = 0;
+    uint64_t positions_size_ = 0;
+    std::string dictionary_;
+    std::string strings_;
+    uint32_t num_terms_ = 0;
+    Term last_term_;
+    bool finished_ = false;
+};
+
+class SegmentReader {
+public:
+    explicit SegmentReader(const std::string& path);
+
+    uint32_t num_terms() const { return num_terms_; }
+    uint32_t num_docs() const { return num_docs_; }
+    // Сегменты версии 2 писали min_dl по длине документа и не хранили df.
+    uint32_t version() const { return version_; }
+
+    std::string_view term(uint32_t ordinal) const;
+    // Номер термина, он же TermId индекса, или kNoTerm.
+    TermId find(std::string_view term) const;
+    // 0 для сегментов версии 2.
+    uint32_t doc_freq(uint32_t ordinal) const;
+    FieldPostings decode(uint32_t ordinal) const;
+
+private:
+    const uint8_t* entry(uint32_t ordinal) const { return dictionary_ + ordinal * entry_size_; }
+    void decode_field(const uint8_t* field_entry, PostingsList& postings) const;
+
+    MappedFile file_;
+    std::vector<uint32_t> fields_;  // FieldId полей файла, kNoField для неизвестных
+    uint32_t num_terms_ = 0;
+    uint32_t num_docs_ = 0;
+    uint32_t version_ = 0;
+    size_t entry_size_ = 0;
+    const uint8_t* postings_ = nullptr;
+    const uint8_t* positions_ = nullptr;
+    const uint8_t* dictionary_ = nullptr;
+    const uint8_t* strings_ = nullptr;
+    const uint8_t* end_ = nullptr;
+};
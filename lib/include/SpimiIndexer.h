@@ -0,0 +1,50 @@
+#pragma once
+#include "Common.h"
+#include "DocStore.h"
+#include "Document.h"
+#include "Norms.h"
+#include "Postings.h"
+#include "Tokenizer.h"
+#include <string>
+#include <vector>
+
+// Однопроходная индексация с ограниченной памятью (SPIMI).
+// Документы сразу пишутся в хранилище .store, а postings копятся в памяти, пока их оценка
+// не превысит memory_budget; тогда отсортированный по терминам блок сбрасывается
+// во временный файл. finish() сливает все блоки k-путевым слиянием прямо в сегмент
+// (если блоков слишком много - сначала группами в промежуточные блоки).
+// В памяти всё время живут только текущий блок и нормы полей (байт на поле и документ).
+class SpimiIndexer {
+public:
+    SpimiIndexer(const std::string& base_name, size_t memory_budget, const std::string& temp_dir = "");
+    ~SpimiIndexer();
+
+    SpimiIndexer(const SpimiIndexer&) = delete;
+    SpimiIndexer& operator=(const SpimiIndexer&) = delete;
+
+    void add_document(const DocumentView& doc);
+    // Пишет base_name.store, base_name.norms и base_name.seg.
+    void finish();
+
+    size_t runs() const { return run_paths_.size(); }
+
+private:
+    // Возвращает число токенов поля.
+    uint32_t add_field(DocId doc_id, uint32_t field, std::string_view text);
+    void flush_run();
+    void merge_runs();
+    std::string next_run_path();
+
+    std::string base_name_;
+    std::string temp_prefix_;
+    size_t memory_budget_;
+    DocStoreWriter docs_writer_;
+    FieldNorms norms_;
+    Tokenizer tokenizer_;
+    TokenBuffer token_buffer_;
+
+    InvertedIndex block_;
+    size_t block_bytes_ = 0;
+    std::vector<std::string> run_paths_;
+    size_t runs_created_ = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include "Common.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Отсортированный словарь терминов с front coding. Термины идут блоками по
+// kBlockTerms: первый термин блока записан целиком (varint длины и байты),
+// остальные - varint длины общего префикса с предыдущим термином, varint длины
+// суффикса и суффикс. TermId - номер термина по возрастанию. Поиск - бинарный
+// по первым терминам блоков и проход по одному блоку без сборки строк.
+class TermDictionary {
+public:
+    static constexpr uint32_t kBlockTerms = 16;
+
+    // Термины добавляются строго по возрастанию; возвращает TermId.
+    TermId add(std::string_view term);
+    void clear();
+    // Отдаёт лишнюю ёмкость буферов после построения.
+    void shrink_to_fit();
+
+    uint32_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // kNoTerm, если термина нет.
+    TermId find(std::string_view term) const;
+    std::string term(TermId id) const;
+    // Все термины по возрастанию; строка действительна до возврата из fn.
+    void for_each(const std::function<void(TermId, std::string_view)>& fn) const;
+
+    size_t memory_bytes() const { return data_.capacity() + block_offsets_.capacity() * sizeof(uint32_t); }
+
+private:
+    std::string_view block_first(uint32_t block, const uint8_t*& p) const;
+
+    std::string data_;
+    std::vector<uint32_t> block_offsets_;
+    std::string last_;
+    uint32_t size_ = 0;
+};
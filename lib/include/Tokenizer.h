@@ -1,13 +1,110 @@
 #pragma once
 #include "Common.h"
-#include <unordered_set>
+#include <array>
+#include <string_view>
+
+// Токены - максимальные последовательности ASCII-букв и цифр в нижнем регистре;
+// всё остальное, включая байты UTF-8 старше 0x7F, - разделители. Стоп-слова
+// отбрасываются. Символы классифицируются таблицей на 256 байт, стоп-слова
+// ищутся в совершенной хеш-таблице, построенной при компиляции. Токены отдаются
+// как string_view без выделения памяти на каждый токен.
+namespace tokenizer_detail {
+
+enum CharClass : uint8_t { kSeparator = 0, kLower = 1, kUpper = 2 };
+
+constexpr std::array<uint8_t, 256> make_char_classes() {
+    std::array<uint8_t, 256> classes{};
+    for (int c = '0'; c <= '9'; ++c) classes[c] = kLower;
+    for (int c = 'a'; c <= 'z'; ++c) classes[c] = kLower;
+    for (int c = 'A'; c <= 'Z'; ++c) classes[c] = kUpper;
+    return classes;
+}
+
+inline constexpr std::array<uint8_t, 256> kCharClasses = make_char_classes();
+
+inline constexpr std::string_view kStopWords[] = {
+    "a", "an", "the", "in", "on", "of", "for", "with", "is", "are", "was",
+    "were", "it", "he", "she", "they", "i", "you", "and", "or", "but"};
+constexpr size_t kMaxStopWordLength = 4;
+
+// Хеш без коллизий на kStopWords (проверяется static_assert ниже): первая и
+// последняя буквы и длина.
+constexpr size_t stop_word_hash(std::string_view word) {
+    return (static_cast<uint8_t>(word.front()) + 4 * static_cast<uint8_t>(word.back()) + 13 * word.size()) & 63;
+}
+
+struct StopWordTable {
+    std::array<std::string_view, 64> slots{};
+    bool perfect = true;
+};
+
+constexpr StopWordTable make_stop_word_table() {
+    StopWordTable table;
+    for (auto word : kStopWords) {
+        auto& slot = table.slots[stop_word_hash(word)];
+        if (!slot.empty()) table.perfect = false;
+        slot = word;
+    }
+    return table;
+}
+
+inline constexpr StopWordTable kStopWordTable = make_stop_word_table();
+static_assert(kStopWordTable.perfect, "stop_word_hash has collisions on kStopWords");
+
+// word уже в нижнем регистре.
+constexpr bool is_stop_word(std::string_view word) {
+    if (word.empty() || word.size() > kMaxStopWordLength) return false;
+    return kStopWordTable.slots[stop_word_hash(word)] == word;
+}
+
+}  // namespace tokenizer_detail
+
+// Токены одного текста: представления указывают в arena, которая
+// перезаписывается при следующем разборе в тот же буфер. Буфер стоит держать
+// между вызовами: после разогрева память больше не выделяется.
+struct TokenBuffer {
+    std::string arena;
+    std::vector<std::string_view> tokens;
+};
 
 class Tokenizer {
 public:
-    Tokenizer();
-    Tokens tokenize(const std::string& text) const;
+    // callback(std::string_view) для каждого токена по порядку. Токен указывает
+    // в text, если в нём не было заглавных букв, иначе во внутренний буфер потока;
+    // действителен до возврата из callback.
+    template <typename Callback>
+    void for_each_token(std::string_view text, Callback&& callback) const;
+
+    // Токены text в buffer.tokens (прежнее содержимое buffer теряется).
+    void tokenize(std::string_view text, TokenBuffer& buffer) const;
+    size_t count_tokens(std::string_view text) const;
+    Tokens tokenize(std::string_view text) const;
 
 private:
-    std::string to_lower(const std::string& str) const;
-    std::unordered_set<std::string> stop_words_;
-};
\ No newline at end of file
+    static std::string& lower_buffer();
+};
+
+template <typename Callback>
+void Tokenizer::for_each_token(std::string_view text, Callback&& callback) const {
+    using namespace tokenizer_detail;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        while (p < end && kCharClasses[static_cast<uint8_t>(*p)] == kSeparator) ++p;
+        if (p == end) break;
+        const char* begin = p;
+        uint8_t seen = 0;
+        for (uint8_t c; p < end && (c = kCharClasses[static_cast<uint8_t>(*p)]) != kSeparator; ++p) seen |= c;
+
+        std::string_view token(begin, p - begin);
+        if (seen & kUpper) {
+            std::string& lower = lower_buffer();
+            lower.assign(token);
+            for (char& ch : lower) {
+                if (kCharClasses[static_cast<uint8_t>(ch)] == kUpper) ch += 'a' - 'A';
+            }
+            token = lower;
+        }
+        if (!is_stop_word(token)) callback(token);
+    }
+}
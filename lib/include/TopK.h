@@ -0,0 +1,50 @@
+#pragma once
+#include "Common.h"
+#include <algorithm>
+#include <cstddef>
+
+// Ограниченная куча лучших k документов. Порядок: score по убыванию,
+// при равенстве - DocId по возрастанию, чтобы выдача была детерминированной.
+class TopK {
+public:
+    explicit TopK(size_t k) : k_(k) {
+        heap_.reserve(std::min<size_t>(k, 1024));
+    }
+
+    static bool better(const ScoredDoc& a, const ScoredDoc& b) {
+        return a.score != b.score ? a.score > b.score : a.id < b.id;
+    }
+
+    // Минимальный score, с которым документ ещё может попасть в выдачу.
+    double threshold() const {
+        return full() ? heap_.front().score : -1.0;
+    }
+
+    bool full() const { return k_ > 0 && heap_.size() >= k_; }
+    size_t size() const { return heap_.size(); }
+
+    void push(double score, DocId id) {
+        if (k_ == 0) return;
+        ScoredDoc cand{score, id};
+        if (heap_.size() < k_) {
+            heap_.push_back(cand);
+            std::push_heap(heap_.begin(), heap_.end(), better);
+        } else if (better(cand, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), better);
+            heap_.back() = cand;
+            std::push_heap(heap_.begin(), heap_.end(), better);
+        }
+    }
+
+    // Забирает результат в порядке ранжирования, пропуская первые offset.
+    ScoredDocs take(size_t offset = 0) {
+        std::sort_heap(heap_.begin(), heap_.end(), better);
+        if (offset >= heap_.size()) return {};
+        heap_.erase(heap_.begin(), heap_.begin() + offset);
+        return std::move(heap_);
+    }
+
+private:
+    size_t k_;
+    ScoredDocs heap_;  // на вершине - худший из лучших
+};
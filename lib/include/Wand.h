@@ -0,0 +1,29 @@
+#pragma once
+#include "Index.h"
+#include "Bitmap.h"
+#include "Ranker.h"
+
+// Ранжированный OR-поиск с динамическим отсечением Block-Max WAND.
+// Обходит postings терминов документ за документом и пропускает документы
+// (и целые блоки), чья верхняя оценка BM25 не дотягивает до порога top-k.
+// Результат совпадает с полным перебором через Ranker::score.
+class BlockMaxWand {
+public:
+    // deleted - документы, которые не попадают в выдачу (nullptr - таких нет).
+    BlockMaxWand(const Index& index, const Ranker& ranker, const Bitmap* deleted = nullptr)
+        : index_(index), ranker_(ranker), deleted_(deleted) {}
+
+    // Верхние оценки корректны только при k1 > 0, 0 <= b <= 1, w_title >= 0:
+    // тогда вклад поля растёт с tf и не растёт с нормой поля.
+    static bool supports(double k1, double b, double w_title) {
+        return k1 > 0 && b >= 0 && b <= 1 && w_title >= 0;
+    }
+
+    // Параметры BM25F берутся из ranker.
+    ScoredDocs search(const Ranker::PreparedQuery& query, size_t k, size_t offset) const;
+
+private:
+    const Index& index_;
+    const Ranker& ranker_;
+    const Bitmap* deleted_;
+};
@@ -0,0 +1,193 @@
+#include "Bitmap.h"
+#include <algorithm>
+#include <iterator>
+
+bool Bitmap::Container::contains(uint16_t low) const {
+    if (is_bitset()) return (bits[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+// Битсет с малым числом единиц превращается в массив, пустой — отбрасывается.
+void Bitmap::push_bits(Bitmap& out, uint16_t key, std::vector<uint64_t>&& bits) {
+    size_t card = 0;
+    for (uint64_t w : bits) card += __builtin_popcountll(w);
+    if (card == 0) return;
+    Container c;
+    c.key = key;
+    c.cardinality = card;
+    if (card <= kArrayMax) {
+        c.array.reserve(card);
+        for (size_t w = 0; w < kWords; ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                c.array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+            }
+        }
+    } else {
+        c.bits = std::move(bits);
+    }
+    out.containers_.push_back(std::move(c));
+}
+
+// Массив длиннее kArrayMax превращается в битсет, пустой — отбрасывается.
+void Bitmap::push_array(Bitmap& out, uint16_t key, std::vector<uint16_t>&& array) {
+    if (array.empty()) return;
+    Container c;
+    c.key = key;
+    c.cardinality = array.size();
+    if (array.size() > kArrayMax) {
+        c.bits.assign(kWords, 0);
+        for (uint16_t low : array) c.bits[low >> 6] |= uint64_t{1} << (low & 63);
+    } else {
+        c.array = std::move(array);
+    }
+    out.containers_.push_back(std::move(c));
+}
+
+std::vector<uint64_t> Bitmap::to_bits(const Container& c) {
+    if (c.is_bitset()) return c.bits;
+    std::vector<uint64_t> bits(kWords, 0);
+    for (uint16_t low : c.array) bits[low >> 6] |= uint64_t{1} << (low & 63);
+    return bits;
+}
+
+Bitmap Bitmap::from_sorted(std::span<const DocId> docs) {
+    Bitmap result;
+    size_t i = 0;
+    while (i < docs.size()) {
+        uint16_t key = docs[i] >> 16;
+        size_t end = i;
+        while (end < docs.size() && (docs[end] >> 16) == key) ++end;
+        std::vector<uint16_t> array;
+        array.reserve(end - i);
+        for (; i < end; ++i) array.push_back(static_cast<uint16_t>(docs[i]));
+        push_array(result, key, std::move(array));
+    }
+    return result;
+}
+
+Bitmap Bitmap::intersect(const Bitmap& a, const Bitmap& b) {
+    Bitmap result;
+    size_t i = 0, j = 0;
+    while (i < a.containers_.size() && j < b.containers_.size()) {
+        const Container& x = a.containers_[i];
+        const Container& y = b.containers_[j];
+        if (x.key != y.key) {
+            x.key < y.key ? ++i : ++j;
+            continue;
+        }
+        if (x.is_bitset() && y.is_bitset()) {
+            std::vector<uint64_t> bits(kWords);
+            for (size_t w = 0; w < kWords; ++w) bits[w] = x.bits[w] & y.bits[w];
+            push_bits(result, x.key, std::move(bits));
+        } else if (x.is_bitset() || y.is_bitset()) {
+            const Container& arr = x.is_bitset() ? y : x;
+            const Container& set = x.is_bitset() ? x : y;
+            std::vector<uint16_t> array;
+            for (uint16_t low : arr.array) {
+                if (set.contains(low)) array.push_back(low);
+            }
+            push_array(result, x.key, std::move(array));
+        } else {
+            std::vector<uint16_t> array;
+            std::set_intersection(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(),
+                                  std::back_inserter(array));
+            push_array(result, x.key, std::move(array));
+        }
+        ++i;
+        ++j;
+    }
+    return result;
+}
+
+Bitmap Bitmap::unite(const Bitmap& a, const Bitmap& b) {
+    Bitmap result;
+    size_t i = 0, j = 0;
+    while (i < a.containers_.size() || j < b.containers_.size()) {
+        if (j == b.containers_.size() || (i < a.containers_.size() && a.containers_[i].key < b.containers_[j].key)) {
+            result.containers_.push_back(a.containers_[i++]);
+            continue;
+        }
+        if (i == a.containers_.size() || b.containers_[j].key < a.containers_[i].key) {
+            result.containers_.push_back(b.containers_[j++]);
+            continue;
+        }
+        const Container& x = a.containers_[i++];
+        const Container& y = b.containers_[j++];
+        if (!x.is_bitset() && !y.is_bitset() && x.array.size() + y.array.size() <= kArrayMax) {
+            std::vector<uint16_t> array;
+            array.reserve(x.array.size() + y.array.size());
+            std::set_union(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(),
+                           std::back_inserter(array));
+            push_array(result, x.key, std::move(array));
+            continue;
+        }
+        std::vector<uint64_t> bits = to_bits(x);
+        if (y.is_bitset()) {
+            for (size_t w = 0; w < kWords; ++w) bits[w] |= y.bits[w];
+        } else {
+            for (uint16_t low : y.array) bits[low >> 6] |= uint64_t{1} << (low & 63);
+        }
+        push_bits(result, x.key, std::move(bits));
+    }
+    return result;
+}
+
+Bitmap Bitmap::difference(const Bitmap& a, const Bitmap& b) {
+    Bitmap result;
+    size_t j = 0;
+    for (const Container& x : a.containers_) {
+        while (j < b.containers_.size() && b.containers_[j].key < x.key) ++j;
+        if (j == b.containers_.size() || b.containers_[j].key != x.key) {
+            result.containers_.push_back(x);
+            continue;
+        }
+        const Container& y = b.containers_[j];
+        if (x.is_bitset()) {
+            std::vector<uint64_t> bits = x.bits;
+            if (y.is_bitset()) {
+                for (size_t w = 0; w < kWords; ++w) bits[w] &= ~y.bits[w];
+            } else {
+                for (uint16_t low : y.array) bits[low >> 6] &= ~(uint64_t{1} << (low & 63));
+            }
+            push_bits(result, x.key, std::move(bits));
+            continue;
+        }
+        std::vector<uint16_t> array;
+        if (y.is_bitset()) {
+            for (uint16_t low : x.array) {
+                if (!y.contains(low)) array.push_back(low);
+            }
+        } else {
+            std::set_difference(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(),
+                                std::back_inserter(array));
+        }
+        push_array(result, x.key, std::move(array));
+    }
+    return result;
+}
+
+bool Bitmap::contains(DocId id) const {
+    uint16_t key = id >> 16;
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    return it != containers_.end() && it->key == key && it->contains(static_cast<uint16_t>(id));
+}
+
+size_t Bitmap::cardinality() const {
+    size_t total = 0;
+    for (const auto& c : containers_) total += c.cardinality;
+    return total;
+}
+
+DocList Bitmap::filter(std::span<const DocId> docs, bool keep) const {
+    DocList result;
+    size_t c = 0;
+    for (DocId id : docs) {
+        uint16_t key = id >> 16;
+        while (c < containers_.size() && containers_[c].key < key) ++c;
+        bool member = c < containers_.size() && containers_[c].key == key &&
+                      containers_[c].contains(static_cast<uint16_t>(id));
+        if (member == keep) result.push_back(id);
+    }
+    return result;
+}
@@ -0,0 +1,234 @@
+#include "BlockCodec.h"
+#include "Encoding.h"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <immintrin.h>
+
+namespace block_codec {
+
+namespace {
+
+constexpr size_t kLanes = 8;
+constexpr size_t kSteps = kChunkSize / kLanes;
+
+// Размер упакованного куска в байтах (без байта ширины): на дорожку 16 * b бит,
+// округлённые до целых 32-битных слов.
+size_t packed_bytes(uint32_t bits) {
+    return kLanes * sizeof(uint32_t) * ((kSteps * bits + 31) / 32);
+}
+
+uint32_t bit_width(uint32_t value) {
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+void pack(const uint32_t* values, uint32_t bits, std::string& out) {
+    if (bits == 0) return;
+    size_t words_per_lane = (kSteps * bits + 31) / 32;
+    std::vector<uint32_t> words(words_per_lane * kLanes, 0);
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        size_t pos = 0;
+        for (size_t k = 0; k < kSteps; ++k, pos += bits) {
+            uint32_t value = values[k * kLanes + lane];
+            size_t w = pos / 32;
+            size_t off = pos % 32;
+            words[w * kLanes + lane] |= value << off;
+            if (off + bits > 32) words[(w + 1) * kLanes + lane] |= value >> (32 - off);
+        }
+    }
+    out.append(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+}
+
+template <bool kDelta>
+uint32_t unpack_scalar(const uint8_t* data, uint32_t bits, uint32_t prev, uint32_t* out) {
+    uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        size_t pos = 0;
+        for (size_t k = 0; k < kSteps; ++k, pos += bits) {
+            size_t w = pos / 32;
+            size_t off = pos % 32;
+            uint32_t value = bits == 0 ? 0 : load_raw<uint32_t>(data + (w * kLanes + lane) * 4) >> off;
+            if (off + bits > 32) value |= load_raw<uint32_t>(data + ((w + 1) * kLanes + lane) * 4) << (32 - off);
+            out[k * kLanes + lane] = value & mask;
+        }
+    }
+    if constexpr (kDelta) {
+        for (size_t i = 0; i < kChunkSize; ++i) {
+            prev += out[i];
+            out[i] = prev;
+        }
+    }
+    return prev;
+}
+
+template <bool kDelta>
+__attribute__((target("sse2"))) uint32_t unpack_sse(const uint8_t* data, uint32_t bits, uint32_t prev,
+                                                    uint32_t* out) {
+    const __m128i mask = _mm_set1_epi32(bits == 32 ? -1 : static_cast<int>((1u << bits) - 1));
+    __m128i carry = _mm_set1_epi32(static_cast<int>(prev));
+    size_t pos = 0;
+    for (size_t k = 0; k < kSteps; ++k, pos += bits) {
+        size_t w = pos / 32;
+        __m128i shift = _mm_cvtsi32_si128(static_cast<int>(pos % 32));
+        __m128i spill = _mm_cvtsi32_si128(static_cast<int>(32 - pos % 32));
+        bool spills = pos % 32 + bits > 32;
+        __m128i v[2];
+        for (size_t h = 0; h < 2; ++h) {
+            const uint8_t* word = data + (w * kLanes + h * 4) * 4;
+            __m128i value = bits == 0 ? _mm_setzero_si128()
+                                      : _mm_srl_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(word)), shift);
+            if (spills) {
+                __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word + kLanes * 4));
+                value = _mm_or_si128(value, _mm_sll_epi32(next, spill));
+            }
+            v[h] = _mm_and_si128(value, mask);
+        }
+        if constexpr (kDelta) {
+            for (auto& x : v) {
+                x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+                x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+                x = _mm_add_epi32(x, carry);
+                carry = _mm_shuffle_epi32(x, 0xFF);
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k * kLanes), v[0]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k * kLanes + 4), v[1]);
+    }
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+}
+
+template <bool kDelta>
+__attribute__((target("avx2"))) uint32_t unpack_avx2(const uint8_t* data, uint32_t bits, uint32_t prev,
+                                                     uint32_t* out) {
+    const __m256i mask = _mm256_set1_epi32(bits == 32 ? -1 : static_cast<int>((1u << bits) - 1));
+    const __m256i lane_carry_idx = _mm256_setr_epi32(0, 0, 0, 0, 3, 3, 3, 3);
+    const __m256i last_idx = _mm256_set1_epi32(7);
+    __m256i carry = _mm256_set1_epi32(static_cast<int>(prev));
+    size_t pos = 0;
+    for (size_t k = 0; k < kSteps; ++k, pos += bits) {
+        const uint8_t* word = data + (pos / 32) * kLanes * 4;
+        __m256i value = bits == 0 ? _mm256_setzero_si256()
+                                  : _mm256_srl_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(word)),
+                                                     _mm_cvtsi32_si128(static_cast<int>(pos % 32)));
+        if (pos % 32 + bits > 32) {
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(word + kLanes * 4));
+            value = _mm256_or_si256(value, _mm256_sll_epi32(next, _mm_cvtsi32_si128(static_cast<int>(32 - pos % 32))));
+        }
+        value = _mm256_and_si256(value, mask);
+        if constexpr (kDelta) {
+            value = _mm256_add_epi32(value, _mm256_slli_si256(value, 4));
+            value = _mm256_add_epi32(value, _mm256_slli_si256(value, 8));
+            __m256i low_total = _mm256_permutevar8x32_epi32(value, lane_carry_idx);
+            value = _mm256_add_epi32(value, _mm256_blend_epi32(_mm256_setzero_si256(), low_total, 0xF0));
+            value = _mm256_add_epi32(value, carry);
+            carry = _mm256_permutevar8x32_epi32(value, last_idx);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k * kLanes), value);
+    }
+    return static_cast<uint32_t>(_mm256_cvtsi256_si32(carry));
+}
+
+template <bool kDelta>
+const uint8_t* decode_impl(Kernel kernel, const uint8_t* in, const uint8_t* end, size_t n, uint32_t prev,
+                           uint32_t* out) {
+    size_t i = 0;
+    for (; i + kChunkSize <= n; i += kChunkSize) {
+        if (in >= end) throw std::runtime_error("Block codec: truncated chunk");
+        uint32_t bits = *in++;
+        if (bits > 32 || static_cast<size_t>(end - in) < packed_bytes(bits)) {
+            throw std::runtime_error("Block codec: corrupted chunk");
+        }
+        switch (kernel) {
+            case Kernel::kAvx2:
+                prev = unpack_avx2<kDelta>(in, bits, prev, out + i);
+                break;
+            case Kernel::kSse:
+                prev = unpack_sse<kDelta>(in, bits, prev, out + i);
+                break;
+            case Kernel::kScalar:
+                prev = unpack_scalar<kDelta>(in, bits, prev, out + i);
+                break;
+        }
+        in += packed_bytes(bits);
+    }
+    for (; i < n; ++i) {
+        uint32_t value = static_cast<uint32_t>(read_varint(in, end));
+        if constexpr (kDelta) {
+            prev += value;
+            value = prev;
+        }
+        out[i] = value;
+    }
+    return in;
+}
+
+void encode_impl(const uint32_t* in, size_t n, uint32_t prev, bool delta, std::string& out) {
+    uint32_t chunk[kChunkSize];
+    size_t i = 0;
+    for (; i + kChunkSize <= n; i += kChunkSize) {
+        uint32_t all = 0;
+        for (size_t j = 0; j < kChunkSize; ++j) {
+            chunk[j] = delta ? in[i + j] - prev : in[i + j];
+            prev = in[i + j];
+            all |= chunk[j];
+        }
+        uint32_t bits = bit_width(all);
+        out.push_back(static_cast<char>(bits));
+        pack(chunk, bits, out);
+    }
+    for (; i < n; ++i) {
+        append_varint(out, delta ? in[i] - prev : in[i]);
+        prev = in[i];
+    }
+}
+
+}  // namespace
+
+Kernel best_kernel() {
+    static const Kernel kBest = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return Kernel::kAvx2;
+        if (__builtin_cpu_supports("sse2")) return Kernel::kSse;
+        return Kernel::kScalar;
+    }();
+    return kBest;
+}
+
+const char* kernel_name(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::kAvx2:
+            return "avx2";
+        case Kernel::kSse:
+            return "sse";
+        case Kernel::kScalar:
+            return "scalar";
+    }
+    return "unknown";
+}
+
+void encode(const uint32_t* in, size_t n, std::string& out) {
+    encode_impl(in, n, 0, false, out);
+}
+
+void encode_delta(const uint32_t* in, size_t n, uint32_t prev, std::string& out) {
+    encode_impl(in, n, prev, true, out);
+}
+
+const uint8_t* decode(Kernel kernel, const uint8_t* in, const uint8_t* end, size_t n, uint32_t* out) {
+    return decode_impl<false>(kernel, in, end, n, 0, out);
+}
+
+const uint8_t* decode_delta(Kernel kernel, const uint8_t* in, const uint8_t* end, size_t n, uint32_t prev,
+                            uint32_t* out) {
+    return decode_impl<true>(kernel, in, end, n, prev, out);
+}
+
+const uint8_t* decode(const uint8_t* in, const uint8_t* end, size_t n, uint32_t* out) {
+    return decode(best_kernel(), in, end, n, out);
+}
+
+const uint8_t* decode_delta(const uint8_t* in, const uint8_t* end, size_t n, uint32_t prev, uint32_t* out) {
+    return decode_delta(best_kernel(), in, end, n, prev, out);
+}
+
+}  // namespace block_codec
@@ -0,0 +1,115 @@
+#include "CsvReader.h"
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Как часто возвращать ядру уже разобранную часть файла.
+constexpr size_t kReleaseInterval = 16 << 20;
+
+// Битовая маска позиций '"', ',' и '\n' в data[0..16).
+uint32_t special_mask(const char* data) {
+#if defined(__SSE2__)
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                                             _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))),
+                                _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+    return static_cast<uint32_t>(_mm_movemask_epi8(hits));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (data[i] == '"' || data[i] == ',' || data[i] == '\n') mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+struct FieldSpan {
+    size_t begin;
+    size_t end;
+    bool quoted;
+};
+
+}  // namespace
+
+void CsvReader::for_each_record(const std::function<void(const Row&)>& callback) {
+    const char* data = reinterpret_cast<const char*>(file_.data());
+    size_t size = file_.size();
+    if (size == 0) return;
+
+    const char* header_end = static_cast<const char*>(std::memchr(data, '\n', size));
+    if (!header_end) return;
+
+    std::vector<FieldSpan> spans;
+    Row row;
+    std::string unquoted;
+    size_t record_begin = header_end - data + 1;
+    size_t field_begin = record_begin;
+    bool field_quoted = false;
+    bool in_quotes = false;
+
+    auto emit = [&] {
+        size_t quoted_bytes = 0;
+        for (const auto& s : spans) {
+            if (s.quoted) quoted_bytes += s.end - s.begin;
+        }
+        unquoted.clear();
+        unquoted.reserve(quoted_bytes);  // дальше строка не перераспределяется
+        row.clear();
+        for (const auto& s : spans) {
+            if (!s.quoted) {
+                row.emplace_back(data + s.begin, s.end - s.begin);
+                continue;
+            }
+            size_t start = unquoted.size();
+            for (size_t i = s.begin; i < s.end; ++i) {
+                if (data[i] != '"') unquoted.push_back(data[i]);
+            }
+            row.emplace_back(unquoted.data() + start, unquoted.size() - start);
+        }
+        callback(row);
+        spans.clear();
+    };
+
+    auto handle = [&](size_t i) {
+        char c = data[i];
+        if (c == '"') {
+            in_quotes = !in_quotes;
+            field_quoted = true;
+        } else if (!in_quotes) {
+            spans.push_back({field_begin, i, field_quoted});
+            field_begin = i + 1;
+            field_quoted = false;
+            if (c == '\n') {
+                emit();
+                record_begin = i + 1;
+            }
+        }
+    };
+
+    size_t i = record_begin;
+    size_t released = 0;
+    for (; i + 16 <= size; i += 16) {
+        if (record_begin - released >= kReleaseInterval) {
+            file_.release_prefix(record_begin);
+            released = record_begin;
+        }
+        uint32_t mask = special_mask(data + i);
+        while (mask) {
+            handle(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < size; ++i) {
+        char c = data[i];
+        if (c == '"' || c == ',' || c == '\n') handle(i);
+    }
+
+    // Хвост без завершающего перевода строки.
+    if (record_begin < size) {
+        spans.push_back({field_begin, size, field_quoted});
+        emit();
+    }
+}
@@ -0,0 +1,402 @@
+#include "Daat.h"
+#include "Metrics.h"
+#include "PostingsCursor.h"
+#include "TopK.h"
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+
+// Курсор по документам, удовлетворяющим узлу плана. advance(target) ставит его
+// на первое совпадение >= target; цели у одного курсора не убывают.
+class MatchCursor {
+public:
+    virtual ~MatchCursor() = default;
+
+    DocId doc() const { return cur_; }
+
+    void advance(DocId target) {
+        if (started_ && cur_ >= target) return;
+        started_ = true;
+        seek(target);
+    }
+
+protected:
+    virtual void seek(DocId target) = 0;
+    DocId cur_ = kEndDoc;
+
+private:
+    bool started_ = false;
+};
+
+using CursorPtr = std::unique_ptr<MatchCursor>;
+
+class EmptyMatch : public MatchCursor {
+    void seek(DocId) override { cur_ = kEndDoc; }
+};
+
+// Термин: объединение курсоров его полей (или курсор одного поля).
+class TermMatch : public MatchCursor {
+public:
+    explicit TermMatch(std::vector<PostingsCursor*> fields) : fields_(std::move(fields)) {}
+
+    PostingsCursor* field(const PostingsList* postings) const {
+        for (auto* f : fields_) {
+            if (f->postings == postings) return f;
+        }
+        return nullptr;
+    }
+
+private:
+    void seek(DocId target) override {
+        cur_ = kEndDoc;
+        for (auto* f : fields_) {
+            f->advance(target);
+            cur_ = std::min(cur_, f->doc());
+        }
+    }
+
+    std::vector<PostingsCursor*> fields_;
+};
+
+// Leapfrog: кандидат — документ первого (самого редкого) операнда, остальные
+// догоняют его; если кто-то перескочил, кандидатом становится его документ.
+class AndMatch : public MatchCursor {
+public:
+    explicit AndMatch(std::vector<CursorPtr> children) : children_(std::move(children)) {}
+
+private:
+    void seek(DocId target) override {
+        DocId candidate = target;
+        while (true) {
+            bool agreed = true;
+            for (auto& child : children_) {
+                child->advance(candidate);
+                DocId d = child->doc();
+                if (d == kEndDoc) {
+                    cur_ = kEndDoc;
+                    return;
+                }
+                if (d != candidate) {
+                    candidate = d;
+                    agreed = false;
+                    break;
+                }
+            }
+            if (agreed) {
+                cur_ = candidate;
+                return;
+            }
+        }
+    }
+
+    std::vector<CursorPtr> children_;
+};
+
+class OrMatch : public MatchCursor {
+public:
+    explicit OrMatch(std::vector<CursorPtr> children) : children_(std::move(children)) {}
+
+private:
+    void seek(DocId target) override {
+        cur_ = kEndDoc;
+        for (auto& child : children_) {
+            child->advance(target);
+            cur_ = std::min(cur_, child->doc());
+        }
+    }
+
+    std::vector<CursorPtr> children_;
+};
+
+// Дополнение до [0, universe): документы, на которых операнд не стоит.
+class NotMatch : public MatchCursor {
+public:
+    NotMatch(CursorPtr child, DocId universe) : child_(std::move(child)), universe_(universe) {}
+
+private:
+    void seek(DocId target) override {
+        for (DocId candidate = target; candidate < universe_; ++candidate) {
+            child_->advance(candidate);
+            if (child_->doc() != candidate) {
+                cur_ = candidate;
+                return;
+            }
+        }
+        cur_ = kEndDoc;
+    }
+
+    CursorPtr child_;
+    DocId universe_;
+};
+
+// include AND NOT excluded...: исключаемые курсоры только проверяются на кандидате.
+class AndNotMatch : public MatchCursor {
+public:
+    AndNotMatch(CursorPtr include, std::vector<CursorPtr> excluded)
+        : include_(std::move(include)), excluded_(std::move(excluded)) {}
+
+private:
+    void seek(DocId target) override {
+        DocId candidate = target;
+        while (true) {
+            include_->advance(candidate);
+            candidate = include_->doc();
+            if (candidate == kEndDoc) break;
+            bool hit = false;
+            for (auto& ex : excluded_) {
+                ex->advance(candidate);
+                if (ex->doc() == candidate) {
+                    hit = true;
+                    break;
+                }
+            }
+            if (!hit) break;
+            ++candidate;
+        }
+        cur_ = candidate;
+    }
+
+    CursorPtr include_;
+    std::vector<CursorPtr> excluded_;
+};
+
+// Заранее вычисленное множество документов.
+class SetMatch : public MatchCursor {
+public:
+    explicit SetMatch(std::shared_ptr<const DocList> docs) : docs_(std::move(docs)) {}
+
+private:
+    void seek(DocId target) override {
+        pos_ = std::lower_bound(docs_->begin() + pos_, docs_->end(), target) - docs_->begin();
+        cur_ = pos_ < docs_->size() ? (*docs_)[pos_] : kEndDoc;
+    }
+
+    std::shared_ptr<const DocList> docs_;
+    size_t pos_ = 0;
+};
+
+bool has_prox(const PlanNode& node) {
+    if (node.op == PlanNode::Op::Prox) return true;
+    for (const auto& child : node.children) {
+        if (has_prox(*child)) return true;
+    }
+    return false;
+}
+
+// NEAR/k и ADJ/k: общий документ двух терминов и подходящая пара позиций в одном поле.
+// Позиции берутся с курсоров полей, которые уже стоят на документе.
+class ProxMatch : public MatchCursor {
+public:
+    using FieldPair = std::pair<PostingsCursor*, PostingsCursor*>;
+
+    ProxMatch(std::unique_ptr<TermMatch> left, std::unique_ptr<TermMatch> right, std::vector<FieldPair> fields,
+              long long dist, bool ordered)
+        : left_(std::move(left)), right_(std::move(right)), fields_(std::move(fields)), dist_(dist), ordered_(ordered) {}
+
+private:
+    void seek(DocId target) override {
+        DocId candidate = target;
+        while (true) {
+            left_->advance(candidate);
+            right_->advance(left_->doc());
+            candidate = right_->doc();
+            if (candidate == kEndDoc) break;
+            if (left_->doc() != candidate) continue;
+            if (positions_match(candidate)) break;
+            ++candidate;
+        }
+        cur_ = candidate;
+    }
+
+    bool positions_match(DocId doc) const {
+        for (const auto& [l, r] : fields_) {
+            if (l->doc() != doc || r->doc() != doc) continue;
+            auto pos_l = l->positions();
+            auto pos_r = r->positions();
+            auto pl = pos_l.begin();
+            auto pr = pos_r.begin();
+            while (pl != pos_l.end() && pr != pos_r.end()) {
+                long long p1 = *pl;
+                long long p2 = *pr;
+                long long diff = p2 - p1;
+                if (ordered_) {
+                    if (diff > 0 && diff <= dist_) return true;
+                    if (p2 <= p1) ++pr; else ++pl;
+                } else {
+                    if (std::abs(diff) <= dist_) return true;
+                    if (p1 < p2) ++pl; else ++pr;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::unique_ptr<TermMatch> left_;
+    std::unique_ptr<TermMatch> right_;
+    std::vector<FieldPair> fields_;
+    long long dist_;
+    bool ordered_;
+};
+
+// Строит курсоры по плану. У каждого листа свои курсоры postings: листы с одним
+// и тем же списком двигаются независимо. Для BM25 запоминается первый курсор
+// каждого списка — если он стоит на найденном документе, tf берётся с него.
+class CursorBuilder {
+public:
+    CursorBuilder(const Index& index, const DaatEvaluator::SetEvaluator& evaluate_set,
+                  const DaatEvaluator::CachedSet& cached_set)
+        : index_(index), evaluate_set_(evaluate_set), cached_set_(cached_set) {}
+
+    CursorPtr build(PlanNode& node) {
+        bool negation = node.op == PlanNode::Op::Not || node.op == PlanNode::Op::AndNot;
+        if (negation && !has_prox(node)) {
+            return std::make_unique<SetMatch>(std::make_shared<const DocList>(evaluate_set_(node).to_list()));
+        }
+        if (node.op == PlanNode::Op::And && cached_set_) {
+            if (auto docs = cached_set_(node)) return std::make_unique<SetMatch>(std::move(docs));
+        }
+
+        switch (node.op) {
+            case PlanNode::Op::Term: {
+                auto term = build_term(node);
+                if (!term) return std::make_unique<EmptyMatch>();
+                return term;
+            }
+            case PlanNode::Op::And:
+            case PlanNode::Op::Or: {
+                std::vector<CursorPtr> children;
+                for (const auto& child : node.children) children.push_back(build(*child));
+                if (node.op == PlanNode::Op::And) return std::make_unique<AndMatch>(std::move(children));
+                return std::make_unique<OrMatch>(std::move(children));
+            }
+            case PlanNode::Op::Not:
+                return std::make_unique<NotMatch>(build(*node.children[0]), index_.get_forward_index().size());
+            case PlanNode::Op::AndNot: {
+                auto include = build(*node.children[0]);
+                std::vector<CursorPtr> excluded;
+                for (size_t i = 1; i < node.children.size(); ++i) excluded.push_back(build(*node.children[i]));
+                return std::make_unique<AndNotMatch>(std::move(include), std::move(excluded));
+            }
+            case PlanNode::Op::Prox:
+                return build_prox(node);
+            case PlanNode::Op::Empty:
+                break;
+        }
+        return std::make_unique<EmptyMatch>();
+    }
+
+    // Курсор, из которого можно взять tf списка на текущем документе, или nullptr.
+    const PostingsCursor* first_cursor(const PostingsList* postings) const {
+        auto it = first_.find(postings);
+        return it == first_.end() ? nullptr : it->second;
+    }
+
+private:
+    PostingsCursor* make_cursor(const PostingsList& postings, uint32_t field) {
+        cursors_.push_back({&postings, field});
+        PostingsCursor* cursor = &cursors_.back();
+        first_.try_emplace(&postings, cursor);
+        return cursor;
+    }
+
+    std::unique_ptr<TermMatch> build_term(const PlanNode& node) {
+        if (node.term_id == kNoTerm) return nullptr;
+        const FieldPostings& fields = index_.postings(node.term_id);
+        std::vector<PostingsCursor*> cursors;
+        for (uint32_t f = 0; f < kNumFields; ++f) {
+            if (node.has_field(f) && !fields[f].docs.empty()) cursors.push_back(make_cursor(fields[f], f));
+        }
+        if (cursors.empty()) return nullptr;
+        return std::make_unique<TermMatch>(std::move(cursors));
+    }
+
+    CursorPtr build_prox(const PlanNode& node) {
+        const PlanNode& left = *node.children[0];
+        const PlanNode& right = *node.children[1];
+        auto left_match = build_term(left);
+        auto right_match = build_term(right);
+        if (!left_match || !right_match) return std::make_unique<EmptyMatch>();
+
+        size_t slash = node.prox.find('/');
+        long long dist = 1;
+        if (slash != std::string::npos) try { dist = std::stoi(node.prox.substr(slash + 1)); } catch(...) {}
+        bool ordered = node.prox.find("ADJ") == 0;
+
+        // Те же поля, что и в SearchEngine::execute_prox.
+        const FieldPostings& l_fields = index_.postings(left.term_id);
+        const FieldPostings& r_fields = index_.postings(right.term_id);
+        std::vector<ProxMatch::FieldPair> pairs;
+        for (uint32_t f = 0; f < kNumFields; ++f) {
+            if (!left.has_field(f) || !right.has_field(f)) continue;
+            auto* l = left_match->field(&l_fields[f]);
+            auto* r = right_match->field(&r_fields[f]);
+            if (l && r) pairs.emplace_back(l, r);
+        }
+        return std::make_unique<ProxMatch>(std::move(left_match), std::move(right_match), std::move(pairs), dist,
+                                           ordered);
+    }
+
+    const Index& index_;
+    const DaatEvaluator::SetEvaluator& evaluate_set_;
+    const DaatEvaluator::CachedSet& cached_set_;
+    std::deque<PostingsCursor> cursors_;
+    std::unordered_map<const PostingsList*, PostingsCursor*> first_;
+};
+
+// Курсор BM25 по одному полю термина запроса. Документы приходят по возрастанию,
+// поэтому он только догоняет; если курсор сопоставления уже на документе,
+// позиция копируется без поиска.
+struct ScoreCursor {
+    PostingsCursor own;
+    const PostingsCursor* match;
+
+    // 0, если документа нет в списке.
+    uint32_t tf(DocId doc) {
+        if (match && match->doc() == doc) own.pos = match->pos;
+        else own.advance(doc);
+        return own.doc() == doc ? own.tf() : 0;
+    }
+};
+
+}  // namespace
+
+ScoredDocs DaatEvaluator::search(PlanNode& plan, const Ranker::PreparedQuery& scoring, size_t k,
+                                 size_t offset) const {
+    if (k == 0) return {};
+
+    CursorBuilder builder(index_, evaluate_set_, cached_set_);
+    CursorPtr root = builder.build(plan);
+
+    std::vector<std::vector<ScoreCursor>> terms(scoring.size());
+    for (size_t i = 0; i < scoring.size(); ++i) {
+        for (const auto& [postings, field] : scoring[i].fields) {
+            terms[i].push_back({{postings, field}, builder.first_cursor(postings)});
+        }
+    }
+
+    TopK top(k > SIZE_MAX - offset ? SIZE_MAX : k + offset);
+    uint64_t scored = 0;
+    for (root->advance(0); root->doc() != kEndDoc; root->advance(root->doc() + 1)) {
+        DocId doc = root->doc();
+        if (deleted_ && deleted_->contains(doc)) continue;
+        ++scored;
+        // Тот же порядок суммирования, что и в Ranker::score.
+        double score = 0.0;
+        for (size_t i = 0; i < scoring.size(); ++i) {
+            double tf = 0;
+            for (auto& cursor : terms[i]) {
+                uint32_t field_tf = cursor.tf(doc);
+                if (field_tf == 0) continue;
+                uint32_t field = cursor.own.field;
+                tf += ranker_.field_tf(field, field_tf, ranker_.norm(field, doc));
+            }
+            score += ranker_.term_score(scoring[i].idf, tf);
+        }
+        top.push(score, doc);
+    }
+    QueryTrace::add_scored(scored);
+    return top.take(offset);
+}
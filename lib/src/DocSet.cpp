@@ -0,0 +1,119 @@
+#include "DocSet.h"
+#include "Intersect.h"
+#include <algorithm>
+#include <iterator>
+
+DocSet DocSet::from_list(DocList docs, size_t universe) {
+    if (is_dense(docs.size(), universe)) return from_bitmap(Bitmap::from_sorted(docs), universe);
+    DocSet set;
+    set.owned_ = std::move(docs);
+    set.universe_ = universe;
+    return set;
+}
+
+// Разреженный результат битовых операций переводится обратно в список.
+DocSet DocSet::from_bitmap(Bitmap bitmap, size_t universe) {
+    DocSet set;
+    set.universe_ = universe;
+    if (is_dense(bitmap.cardinality(), universe)) {
+        set.bitmap_ = std::make_shared<const Bitmap>(std::move(bitmap));
+    } else {
+        bitmap.append_to(set.owned_);
+    }
+    return set;
+}
+
+DocSet DocSet::from_postings(const PostingsList& postings, size_t universe) {
+    DocSet set;
+    set.universe_ = universe;
+    if (postings.bitmap) set.bitmap_ = postings.bitmap;
+    else set.borrowed_ = &postings.docs;
+    return set;
+}
+
+DocSet DocSet::complement() && {
+    negated_ = !negated_;
+    return std::move(*this);
+}
+
+size_t DocSet::size() const {
+    size_t positive = bitmap_ ? bitmap_->cardinality() : list().size();
+    return negated_ ? universe_ - positive : positive;
+}
+
+DocList DocSet::to_list() const {
+    DocList result;
+    if (!negated_) {
+        if (bitmap_) bitmap_->append_to(result);
+        else result.assign(list().begin(), list().end());
+        return result;
+    }
+    result.reserve(size());
+    DocId next = 0;
+    auto skip = [&](DocId member) {
+        while (next < member) result.push_back(next++);
+        next = member + 1;
+    };
+    if (bitmap_) bitmap_->for_each(skip);
+    else for (DocId id : list()) skip(id);
+    while (next < universe_) result.push_back(next++);
+    return result;
+}
+
+DocSet DocSet::intersect(const DocSet& a, const DocSet& b) {
+    return combine_and(a, a.negated_, b, b.negated_);
+}
+
+// a OR b = NOT (NOT a AND NOT b): дополнения так и остаются флагом.
+DocSet DocSet::unite(const DocSet& a, const DocSet& b) {
+    return combine_and(a, !a.negated_, b, !b.negated_).complement();
+}
+
+// Пересечение с учётом флагов дополнения; ни одно дополнение не раскрывается.
+DocSet DocSet::combine_and(const DocSet& a, bool a_neg, const DocSet& b, bool b_neg) {
+    DocSet result;
+    if (!a_neg && !b_neg) result = positive_and(a, b);
+    else if (!a_neg) result = positive_and_not(a, b);
+    else if (!b_neg) result = positive_and_not(b, a);
+    else result = positive_or(a, b).complement();
+    result.universe_ = std::max(a.universe_, b.universe_);
+    return result;
+}
+
+DocSet DocSet::positive_and(const DocSet& a, const DocSet& b) {
+    size_t universe = std::max(a.universe_, b.universe_);
+    if (a.bitmap_ && b.bitmap_) return from_bitmap(Bitmap::intersect(*a.bitmap_, *b.bitmap_), universe);
+    if (a.bitmap_) return from_list(a.bitmap_->filter(b.list(), true), universe);
+    if (b.bitmap_) return from_list(b.bitmap_->filter(a.list(), true), universe);
+    auto x = a.list();
+    auto y = b.list();
+    DocList result(std::min(x.size(), y.size()));
+    result.resize(intersect::intersect(x.data(), x.size(), y.data(), y.size(), result.data()));
+    return from_list(std::move(result), universe);
+}
+
+DocSet DocSet::positive_or(const DocSet& a, const DocSet& b) {
+    size_t universe = std::max(a.universe_, b.universe_);
+    if (a.bitmap_ && b.bitmap_) return from_bitmap(Bitmap::unite(*a.bitmap_, *b.bitmap_), universe);
+    if (a.bitmap_) return from_bitmap(Bitmap::unite(*a.bitmap_, Bitmap::from_sorted(b.list())), universe);
+    if (b.bitmap_) return from_bitmap(Bitmap::unite(Bitmap::from_sorted(a.list()), *b.bitmap_), universe);
+    auto x = a.list();
+    auto y = b.list();
+    DocList result;
+    result.reserve(x.size() + y.size());
+    std::set_union(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(result));
+    return from_list(std::move(result), universe);
+}
+
+DocSet DocSet::positive_and_not(const DocSet& a, const DocSet& b) {
+    size_t universe = std::max(a.universe_, b.universe_);
+    if (a.bitmap_ && b.bitmap_) return from_bitmap(Bitmap::difference(*a.bitmap_, *b.bitmap_), universe);
+    if (a.bitmap_) return from_bitmap(Bitmap::difference(*a.bitmap_, Bitmap::from_sorted(b.list())), universe);
+    if (b.bitmap_) return from_list(b.bitmap_->filter(a.list(), false), universe);
+    auto x = a.list();
+    auto y = b.list();
+    DocList result;
+    result.reserve(x.size());
+    std::set_difference(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(result));
+    return from_list(std::move(result), universe);
+}
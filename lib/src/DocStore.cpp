@@ -0,0 +1,151 @@
+#include "DocStore.h"
+#include "Encoding.h"
+#include "Lz.h"
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t kStoreMagic = 0x45524F54;  // "TORE"
+constexpr uint32_t kStoreVersion = 1;
+constexpr size_t kHeaderSize = 32;
+constexpr size_t kTableEntrySize = 12;
+
+}  // namespace
+
+DocStoreWriter::DocStoreWriter(const std::string& path) : path_(path) {
+    out_.open(path_, std::ios::binary | std::ios::trunc);
+    if (!out_.is_open()) throw std::runtime_error("Cannot create " + path_);
+    out_.write(std::string(kHeaderSize, '\0').data(), kHeaderSize);
+    offset_ = kHeaderSize;
+}
+
+void DocStoreWriter::add_document(const DocumentView& doc) {
+    if (doc.id != num_docs_) throw std::runtime_error("Document store expects consecutive DocIds");
+    append_varint(block_, doc.title.size());
+    block_ += doc.title;
+    append_varint(block_, doc.plot.size());
+    block_ += doc.plot;
+    ++num_docs_;
+    if (block_.size() >= kStoreBlockSize) flush_block();
+}
+
+void DocStoreWriter::flush_block() {
+    if (block_first_ == num_docs_) return;
+    std::string packed;
+    append_raw<uint32_t>(packed, block_.size());
+    append_raw<uint32_t>(packed, 0);
+    lz::compress(block_.data(), block_.size(), packed);
+    uint32_t compressed = static_cast<uint32_t>(packed.size() - 8);
+    std::memcpy(&packed[4], &compressed, sizeof(compressed));
+    out_.write(packed.data(), packed.size());
+
+    append_raw<uint64_t>(table_, offset_);
+    append_raw<uint32_t>(table_, block_first_);
+    offset_ += packed.size();
+    block_first_ = num_docs_;
+    ++num_blocks_;
+    block_.clear();
+}
+
+void DocStoreWriter::finish() {
+    if (finished_) return;
+    finished_ = true;
+    flush_block();
+    out_.write(table_.data(), table_.size());
+
+    std::string head;
+    append_raw<uint32_t>(head, kStoreMagic);
+    append_raw<uint32_t>(head, kStoreVersion);
+    append_raw<uint32_t>(head, num_docs_);
+    append_raw<uint32_t>(head, num_blocks_);
+    append_raw<uint64_t>(head, offset_);
+    append_raw<uint64_t>(head, offset_ + table_.size());
+    out_.seekp(0);
+    out_.write(head.data(), head.size());
+    out_.close();
+    if (!out_) throw std::runtime_error("Failed to write " + path_);
+}
+
+DocStoreReader::DocStoreReader(const std::string& path, size_t cache_blocks)
+    : file_(path), cache_blocks_(std::max<size_t>(1, cache_blocks)) {
+    const uint8_t* base = file_.data();
+    if (file_.size() < kHeaderSize || load_raw<uint32_t>(base) != kStoreMagic) {
+        throw std::runtime_error("Invalid document store header");
+    }
+    if (load_raw<uint32_t>(base + 4) != kStoreVersion) throw std::runtime_error("Unsupported document store version");
+    num_docs_ = load_raw<uint32_t>(base + 8);
+    num_blocks_ = load_raw<uint32_t>(base + 12);
+    uint64_t table_offset = load_raw<uint64_t>(base + 16);
+    uint64_t file_size = load_raw<uint64_t>(base + 24);
+    if (file_size != file_.size() || table_offset < kHeaderSize ||
+        table_offset + uint64_t{num_blocks_} * kTableEntrySize != file_size) {
+        throw std::runtime_error("Corrupted document store layout");
+    }
+    blocks_ = base;
+    table_ = base + table_offset;
+    file_.advise_random();
+}
+
+Document DocStoreReader::get_document(DocId id) const {
+    if (id >= num_docs_) throw std::out_of_range("DocId out of range");
+    // Последний блок, у которого первый DocId не больше id.
+    uint32_t lo = 0;
+    uint32_t hi = num_blocks_;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (load_raw<uint32_t>(table_ + mid * kTableEntrySize + 8) <= id) lo = mid;
+        else hi = mid;
+    }
+    Block data = block(lo);
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data->data());
+    const uint8_t* end = p + data->size();
+    auto read_field = [&](std::string* out) {
+        uint64_t len = read_varint(p, end);
+        if (len > static_cast<uint64_t>(end - p)) throw std::runtime_error("Corrupted document store block");
+        if (out) out->assign(reinterpret_cast<const char*>(p), len);
+        p += len;
+    };
+    Document doc{id, {}, {}};
+    for (uint32_t d = load_raw<uint32_t>(table_ + lo * kTableEntrySize + 8); d < id; ++d) {
+        read_field(nullptr);
+        read_field(nullptr);
+    }
+    read_field(&doc.title);
+    read_field(&doc.plot);
+    return doc;
+}
+
+DocStoreReader::Block DocStoreReader::block(uint32_t index) const {
+    {
+        std::lock_guard lock(mutex_);
+        auto it = cached_.find(index);
+        if (it != cached_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->second;
+        }
+    }
+    // Распаковка вне блокировки; если два потока распаковали один блок, в кэше остаётся первый.
+    Block data = decompress(index);
+    std::lock_guard lock(mutex_);
+    auto [it, inserted] = cached_.try_emplace(index);
+    if (!inserted) return it->second->second;
+    lru_.emplace_front(index, data);
+    it->second = lru_.begin();
+    if (lru_.size() > cache_blocks_) {
+        cached_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+    return data;
+}
+
+DocStoreReader::Block DocStoreReader::decompress(uint32_t index) const {
+    uint64_t offset = load_raw<uint64_t>(table_ + index * kTableEntrySize);
+    if (offset + 8 > static_cast<uint64_t>(table_ - blocks_)) throw std::runtime_error("Corrupted document store");
+    const uint8_t* p = blocks_ + offset;
+    uint32_t raw_size = load_raw<uint32_t>(p);
+    uint32_t compressed = load_raw<uint32_t>(p + 4);
+    if (compressed > static_cast<uint64_t>(table_ - p - 8)) throw std::runtime_error("Corrupted document store");
+    auto data = std::make_shared<std::string>(raw_size, '\0');
+    lz::decompress(p + 8, p + 8 + compressed, data->data(), raw_size);
+    return data;
+}
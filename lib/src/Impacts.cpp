@@ -0,0 +1,249 @@
+#include "Impacts.h"
+#include "BlockCodec.h"
+#include "Encoding.h"
+#include "Index.h"
+#include "Metrics.h"
+#include "Ranker.h"
+#include "TopK.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+
+namespace {
+
+constexpr uint32_t kImpactsMagic = 0x53504D49;  // "IMPS"
+constexpr uint32_t kImpactsVersion = 1;
+constexpr size_t kHeaderSize = 80;
+constexpr size_t kEntrySize = 24;
+
+// Страница аккумуляторов, которая обнуляется при первом обращении за запрос.
+constexpr size_t kPageBits = 12;
+
+// Точные вклады термина по документам, DocId по возрастанию.
+std::vector<std::pair<DocId, double>> term_scores(const Ranker& ranker, const FieldPostings& fields) {
+    std::vector<std::pair<DocId, double>> tfs;
+    for (uint32_t f = 0; f < kNumFields; ++f) {
+        const PostingsList& postings = fields[f];
+        for (size_t i = 0; i < postings.size(); ++i) {
+            DocId doc = postings.docs[i];
+            tfs.emplace_back(doc, ranker.field_tf(f, postings.tfs[i], ranker.norm(f, doc)));
+        }
+    }
+    std::sort(tfs.begin(), tfs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    double idf = ranker.idf(term_doc_freq(fields));
+    std::vector<std::pair<DocId, double>> scores;
+    for (size_t i = 0; i < tfs.size();) {
+        DocId doc = tfs[i].first;
+        double tf = 0;
+        for (; i < tfs.size() && tfs[i].first == doc; ++i) tf += tfs[i].second;
+        scores.emplace_back(doc, ranker.term_score(idf, tf));
+    }
+    return scores;
+}
+
+}  // namespace
+
+void write_impacts(const Index& index, const std::string& path, double k1, double b, double w_title) {
+    Ranker ranker(index, k1, b, w_title);
+
+    double max_score = 0;
+    index.for_each_term([&](std::string_view, const FieldPostings& fields) {
+        for (const auto& [doc, score] : term_scores(ranker, fields)) max_score = std::max(max_score, score);
+    });
+    double scale = max_score > 0 ? max_score / 255 : 1.0;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) throw std::runtime_error("Cannot create " + path);
+    out.write(std::string(kHeaderSize, '\0').data(), kHeaderSize);
+
+    std::string dictionary;
+    std::string strings;
+    std::string groups;
+    std::string docs_buf;
+    uint64_t groups_size = 0;
+    uint32_t num_terms = 0;
+    std::vector<std::pair<uint8_t, DocId>> postings;
+    index.for_each_term([&](std::string_view term, const FieldPostings& fields) {
+        postings.clear();
+        for (const auto& [doc, score] : term_scores(ranker, fields)) {
+            long impact = std::lround(score / scale);
+            postings.emplace_back(static_cast<uint8_t>(std::clamp<long>(impact, 1, 255)), doc);
+        }
+        if (postings.empty()) return;
+        std::sort(postings.begin(), postings.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+        groups.clear();
+        uint32_t num_groups = 0;
+        std::vector<DocId> docs;
+        for (size_t i = 0; i < postings.size();) {
+            uint8_t impact = postings[i].first;
+            docs.clear();
+            for (; i < postings.size() && postings[i].first == impact; ++i) docs.push_back(postings[i].second);
+            docs_buf.clear();
+            block_codec::encode_delta(docs.data(), docs.size(), 0, docs_buf);
+            groups.push_back(static_cast<char>(impact));
+            append_varint(groups, docs.size());
+            append_varint(groups, docs_buf.size());
+            groups += docs_buf;
+            ++num_groups;
+        }
+
+        append_raw<uint64_t>(dictionary, strings.size());
+        append_raw<uint32_t>(dictionary, term.size());
+        append_raw<uint32_t>(dictionary, num_groups);
+        append_raw<uint64_t>(dictionary, groups_size);
+        strings += term;
+        out.write(groups.data(), groups.size());
+        groups_size += groups.size();
+        ++num_terms;
+    });
+
+    uint64_t dictionary_offset = kHeaderSize + groups_size;
+    uint64_t strings_offset = dictionary_offset + dictionary.size();
+    uint64_t file_size = strings_offset + strings.size();
+    out.write(dictionary.data(), dictionary.size());
+    out.write(strings.data(), strings.size());
+
+    std::string head;
+    append_raw<uint32_t>(head, kImpactsMagic);
+    append_raw<uint32_t>(head, kImpactsVersion);
+    append_raw<uint32_t>(head, num_terms);
+    append_raw<uint32_t>(head, index.get_forward_index().size());
+    append_raw<double>(head, k1);
+    append_raw<double>(head, b);
+    append_raw<double>(head, w_title);
+    append_raw<double>(head, scale);
+    append_raw<uint64_t>(head, kHeaderSize);
+    append_raw<uint64_t>(head, dictionary_offset);
+    append_raw<uint64_t>(head, strings_offset);
+    append_raw<uint64_t>(head, file_size);
+    out.seekp(0);
+    out.write(head.data(), head.size());
+    out.close();
+    if (!out) throw std::runtime_error("Failed to write " + path);
+}
+
+ImpactReader::ImpactReader(const std::string& path) : file_(path) {
+    const uint8_t* base = file_.data();
+    if (file_.size() < kHeaderSize || load_raw<uint32_t>(base) != kImpactsMagic) {
+        throw std::runtime_error("Invalid impacts header");
+    }
+    if (load_raw<uint32_t>(base + 4) != kImpactsVersion) throw std::runtime_error("Unsupported impacts version");
+    num_terms_ = load_raw<uint32_t>(base + 8);
+    num_docs_ = load_raw<uint32_t>(base + 12);
+    k1_ = load_raw<double>(base + 16);
+    b_ = load_raw<double>(base + 24);
+    w_title_ = load_raw<double>(base + 32);
+    scale_ = load_raw<double>(base + 40);
+    uint64_t groups_offset = load_raw<uint64_t>(base + 48);
+    uint64_t dictionary_offset = load_raw<uint64_t>(base + 56);
+    uint64_t strings_offset = load_raw<uint64_t>(base + 64);
+    uint64_t file_size = load_raw<uint64_t>(base + 72);
+    if (file_size != file_.size() || groups_offset > dictionary_offset ||
+        dictionary_offset + uint64_t{num_terms_} * kEntrySize != strings_offset || strings_offset > file_size) {
+        throw std::runtime_error("Corrupted impacts layout");
+    }
+    groups_ = base + groups_offset;
+    dictionary_ = base + dictionary_offset;
+    strings_ = base + strings_offset;
+    end_ = base + file_size;
+    file_.advise_random();
+}
+
+bool ImpactReader::matches(double k1, double b, double w_title) const {
+    auto same = [](double x, double y) { return std::fabs(x - y) <= 1e-9; };
+    return same(k1, k1_) && same(b, b_) && same(w_title, w_title_);
+}
+
+std::string_view ImpactReader::term(uint32_t ordinal) const {
+    const uint8_t* e = dictionary_ + ordinal * kEntrySize;
+    uint64_t offset = load_raw<uint64_t>(e);
+    uint32_t len = load_raw<uint32_t>(e + 8);
+    if (strings_ + offset + len > end_) throw std::runtime_error("Corrupted impacts dictionary");
+    return {reinterpret_cast<const char*>(strings_ + offset), len};
+}
+
+std::vector<ImpactReader::Group> ImpactReader::find(std::string_view term_str) const {
+    uint32_t lo = 0;
+    uint32_t hi = num_terms_;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (term(mid) < term_str) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == num_terms_ || term(lo) != term_str) return {};
+
+    const uint8_t* e = dictionary_ + lo * kEntrySize;
+    uint32_t num_groups = load_raw<uint32_t>(e + 12);
+    const uint8_t* p = groups_ + load_raw<uint64_t>(e + 16);
+    std::vector<Group> result;
+    result.reserve(num_groups);
+    for (uint32_t g = 0; g < num_groups; ++g) {
+        if (p >= dictionary_) throw std::runtime_error("Corrupted impacts groups");
+        Group group;
+        group.impact = *p++;
+        group.count = static_cast<uint32_t>(read_varint(p, dictionary_));
+        uint64_t bytes = read_varint(p, dictionary_);
+        if (bytes > static_cast<uint64_t>(dictionary_ - p)) throw std::runtime_error("Corrupted impacts groups");
+        group.data = p;
+        group.end = p + bytes;
+        p = group.end;
+        result.push_back(group);
+    }
+    return result;
+}
+
+void ImpactReader::decode(const Group& group, DocId* out) const {
+    block_codec::decode_delta(group.data, group.end, group.count, 0, out);
+    for (uint32_t i = 0; i < group.count; ++i) {
+        if (out[i] >= num_docs_) throw std::runtime_error("Corrupted impacts groups");
+    }
+}
+
+ScoredDocs ScoreAtATime::search(const std::vector<Term>& terms, size_t k, size_t offset,
+                                size_t postings_budget) const {
+    if (k == 0) return {};
+    std::vector<ImpactReader::Group> groups;
+    for (const auto& term : terms) {
+        auto term_groups = impacts_.find(term);
+        groups.insert(groups.end(), term_groups.begin(), term_groups.end());
+    }
+    std::stable_sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) { return a.impact > b.impact; });
+
+    // Аккумуляторы не обнуляются целиком: страница чистится при первом обращении.
+    size_t num_docs = impacts_.num_docs();
+    auto acc = std::make_unique_for_overwrite<uint32_t[]>(num_docs);
+    std::vector<uint8_t> dirty((num_docs >> kPageBits) + 1, 0);
+    std::vector<DocId> touched;
+    std::vector<DocId> docs;
+
+    size_t budget = postings_budget == 0 ? SIZE_MAX : postings_budget;
+    for (const auto& group : groups) {
+        if (budget == 0) break;
+        docs.resize(group.count);
+        impacts_.decode(group, docs.data());
+        size_t n = std::min<size_t>(group.count, budget);
+        budget -= n;
+        for (size_t i = 0; i < n; ++i) {
+            DocId doc = docs[i];
+            size_t page = doc >> kPageBits;
+            if (!dirty[page]) {
+                dirty[page] = 1;
+                size_t begin = page << kPageBits;
+                std::fill(acc.get() + begin, acc.get() + std::min(num_docs, begin + (size_t{1} << kPageBits)), 0);
+            }
+            if (acc[doc] == 0) touched.push_back(doc);
+            acc[doc] += group.impact;
+        }
+    }
+
+    QueryTrace::add_postings((postings_budget == 0 ? SIZE_MAX : postings_budget) - budget);
+    QueryTrace::add_scored(touched.size());
+    TopK top(k > SIZE_MAX - offset ? SIZE_MAX : k + offset);
+    for (DocId doc : touched) top.push(acc[doc] * impacts_.scale(), doc);
+    return top.take(offset);
+}
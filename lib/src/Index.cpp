@@ -1,86 +1,340 @@
 #include "Index.h"
 #include "Encoding.h"
+#include "Parallel.h"
+#include "Segment.h"
 #include <algorithm>
 #include <cmath>
-#include <map>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <string_view>
 
-void Index::add_document(const Document& doc) {
+Index::Index() = default;
+Index::~Index() = default;
+
+void Index::add_document(const DocumentView& doc) {
+    unseal_dictionary();
     forward_index_.add_document(doc);
-    add_field_to_index(doc.id, "title", doc.title);
-    add_field_to_index(doc.id, "plot", doc.plot);
+    norms_.set(kTitleField, doc.id, add_field_to_index(inverted_index_, doc.id, kTitleField, doc.title));
+    norms_.set(kPlotField, doc.id, add_field_to_index(inverted_index_, doc.id, kPlotField, doc.plot));
 }
 
-void Index::add_field_to_index(DocId doc_id, const std::string& field_name, const std::string& text) {
-    auto tokens = tokenizer_.tokenize(text);
-    std::map<std::string, std::vector<uint32_t>> term_positions;
+void Index::add_documents(const std::vector<Document>& docs, size_t num_threads) {
+    num_threads = std::max<size_t>(1, std::min(num_threads, docs.size()));
+    if (num_threads == 1) {
+        for (const auto& doc : docs) add_document(doc);
+        return;
+    }
+    unseal_dictionary();
+    for (const auto& doc : docs) forward_index_.add_document(doc);
+
+    // Каждый поток строит частичный индекс над своим непрерывным диапазоном документов.
+    std::vector<InvertedIndex> partial(num_threads);
+    std::vector<uint32_t> title_lengths(docs.size());
+    std::vector<uint32_t> plot_lengths(docs.size());
+    size_t chunk = (docs.size() + num_threads - 1) / num_threads;
+    run_parallel(num_threads, [&](size_t t) {
+        size_t end = std::min(docs.size(), (t + 1) * chunk);
+        for (size_t i = t * chunk; i < end; ++i) {
+            title_lengths[i] = add_field_to_index(partial[t], docs[i].id, kTitleField, docs[i].title);
+            plot_lengths[i] = add_field_to_index(partial[t], docs[i].id, kPlotField, docs[i].plot);
+        }
+    });
+    for (size_t i = 0; i < docs.size(); ++i) {
+        norms_.set(kTitleField, docs[i].id, title_lengths[i]);
+        norms_.set(kPlotField, docs[i].id, plot_lengths[i]);
+    }
+
+    // Слияние: термины делятся между потоками по хешу, postings частичных индексов
+    // дописываются в порядке диапазонов, поэтому остаются отсортированными.
+    std::vector<InvertedIndex> merged(num_threads);
+    InvertedIndex::TermHash hasher;
+    run_parallel(num_threads, [&](size_t t) {
+        for (auto& part : partial) {
+            for (const auto& [term, id] : part.ids) {
+                if (hasher(term) % num_threads != t) continue;
+                TermId target = merged[t].intern(term);
+                for (uint32_t f = 0; f < kNumFields; ++f) {
+                    append_postings(merged[t].postings[target][f], std::move(part.postings[id][f]));
+                }
+            }
+        }
+    });
+    partial.clear();
+
+    // Строки терминов переезжают вместе с узлами хеш-таблицы, без копирования.
+    for (auto& part : merged) {
+        while (!part.ids.empty()) {
+            auto node = part.ids.extract(part.ids.begin());
+            FieldPostings& source = part.postings[node.mapped()];
+            auto it = inverted_index_.ids.find(node.key());
+            if (it == inverted_index_.ids.end()) {
+                node.mapped() = static_cast<TermId>(inverted_index_.postings.size());
+                inverted_index_.postings.push_back(std::move(source));
+                inverted_index_.ids.insert(std::move(node));
+            } else {
+                for (uint32_t f = 0; f < kNumFields; ++f) {
+                    append_postings(inverted_index_.postings[it->second][f], std::move(source[f]));
+                }
+            }
+        }
+    }
+}
+
+void Index::append_postings(PostingsList& target, PostingsList&& source) {
+    if (target.docs.empty()) {
+        target = std::move(source);
+        return;
+    }
+    target.append(source);
+}
+
+uint32_t Index::add_field_to_index(InvertedIndex& target, DocId doc_id, uint32_t field, std::string_view text) const {
+    thread_local TokenBuffer buffer;  // вызывается параллельно из потоков построения
+    tokenizer_.tokenize(text, buffer);
+    const auto& tokens = buffer.tokens;
+    std::unordered_map<std::string_view, std::vector<uint32_t>> term_positions;
     for (size_t i = 0; i < tokens.size(); ++i) {
         term_positions[tokens[i]].push_back(i);
     }
     for (const auto& [term, positions] : term_positions) {
-        auto& list = inverted_index_[term][field_name];
-        list.docs.push_back(doc_id);
-        list.positions.push_back(positions);
+        TermId id = target.intern(term);
+        target.postings[id][field].add(doc_id, positions);
     }
+    return static_cast<uint32_t>(tokens.size());
 }
 
-void Index::build_skip_pointers() {
-    for (auto& [term, fields] : inverted_index_) {
-        for (auto& [field, postings] : fields) {
-            if (postings.docs.size() > 4) {
-                postings.skip_step = static_cast<size_t>(std::sqrt(postings.docs.size()));
-                postings.skips.clear();
-                for (size_t i = postings.skip_step; i < postings.docs.size(); i += postings.skip_step) {
-                    postings.skips.push_back(i);
-                }
-            }
-        }
+void Index::build_block_max_for(FieldPostings& fields) const {
+    for (uint32_t f = 0; f < kNumFields; ++f) build_block_max(fields[f], norms_.field_norms(f));
+}
+
+void Index::seal_dictionary() {
+    if (inverted_index_.ids.empty()) return;
+    std::vector<std::pair<std::string_view, TermId>> terms;
+    terms.reserve(inverted_index_.ids.size());
+    for (const auto& [term, id] : inverted_index_.ids) terms.emplace_back(term, id);
+    std::sort(terms.begin(), terms.end());
+
+    std::vector<FieldPostings> sorted;
+    sorted.reserve(terms.size());
+    dictionary_.clear();
+    for (const auto& [term, id] : terms) {
+        dictionary_.add(term);
+        sorted.push_back(std::move(inverted_index_.postings[id]));
     }
+    dictionary_.shrink_to_fit();
+    inverted_index_.postings = std::move(sorted);
+    inverted_index_.ids = {};
 }
 
-void Index::save(const std::string& base_name) const {
-    forward_index_.save(base_name + ".docs");
-
-    std::ofstream out(base_name + ".inv", std::ios::binary);
-    write_varint(out, 0xCAFEBABE);
-    write_varint(out, inverted_index_.size());
-    
-    for (const auto& [term, fields_map] : inverted_index_) {
-        write_string(out, term);
-        write_varint(out, fields_map.size());
-        
-        for (const auto& [field, postings] : fields_map) {
-            write_string(out, field);
-            write_delta_vector(out, postings.docs);
-            write_varint(out, postings.positions.size());
-            for (auto pos_vec : postings.positions) {
-                std::sort(pos_vec.begin(), pos_vec.end()); 
-                write_delta_vector(out, pos_vec);
-            }
-            std::vector<uint32_t> skip_vec;
-            for(auto s : postings.skips) skip_vec.push_back(static_cast<uint32_t>(s));
-            write_delta_vector(out, skip_vec);
-            
-            write_varint(out, postings.skip_step);
-        }
+void Index::unseal_dictionary() {
+    if (dictionary_.empty()) return;
+    dictionary_.for_each([&](TermId id, std::string_view term) { inverted_index_.ids.emplace(term, id); });
+    dictionary_.clear();
+    doc_freqs_.clear();
+}
+
+void Index::build_postings_metadata() {
+    seal_dictionary();
+    doc_freqs_.assign(inverted_index_.size(), 0);
+    for (TermId id = 0; id < inverted_index_.size(); ++id) {
+        auto& fields = inverted_index_.postings[id];
+        build_block_max_for(fields);
+        for (auto& postings : fields) build_bitmap(postings, forward_index_.size());
+        doc_freqs_[id] = term_doc_freq(fields);
     }
-    write_varint(out, 0xDEADBEEF);
+}
+
+// Для индексов без .norms: длины полей восстанавливаются из текстов документов.
+void Index::rebuild_norms() {
+    norms_.clear();
+    for (DocId id = 0; id < forward_index_.size(); ++id) {
+        const auto& doc = forward_index_.get_document(id);
+        norms_.set(kTitleField, id, static_cast<uint32_t>(tokenizer_.count_tokens(doc.title)));
+        norms_.set(kPlotField, id, static_cast<uint32_t>(tokenizer_.count_tokens(doc.plot)));
+    }
+}
+
+void Index::save(const std::string& base_name) const {
+    if (segment_) throw std::runtime_error("Index loaded from a segment is read-only");
+    forward_index_.save(base_name + ".store");
+    norms_.save(base_name + ".norms");
+
+    SegmentWriter writer(base_name + ".seg", forward_index_.size());
+    for_each_term([&](std::string_view term, const FieldPostings& fields) { writer.add_term(term, fields); });
+    writer.finish();
 }
 
 void Index::load(const std::string& base_name) {
     inverted_index_.clear();
-    forward_index_.load(base_name + ".docs");
-    size_t total_docs = forward_index_.size();
+    dictionary_.clear();
+    doc_freqs_.clear();
+    segment_.reset();
+    impacts_.reset();
+    if (std::ifstream(base_name + ".store").is_open()) forward_index_.open_store(base_name + ".store");
+    else forward_index_.load(base_name + ".docs");
+    if (!norms_.load(base_name + ".norms")) rebuild_norms();
+    if (std::ifstream(base_name + ".impacts").is_open()) {
+        impacts_ = std::make_unique<ImpactReader>(base_name + ".impacts");
+        if (impacts_->num_docs() != forward_index_.size()) throw std::runtime_error("Impacts do not match documents");
+    }
 
-    std::ifstream in(base_name + ".inv", std::ios::binary);
-    if (!in.is_open()) throw std::runtime_error("Cannot open .inv file");
+    std::ifstream probe(base_name + ".seg", std::ios::binary);
+    if (!probe.is_open()) {
+        load_legacy(base_name + ".inv");
+        return;
+    }
+    probe.close();
+
+    segment_ = std::make_unique<SegmentReader>(base_name + ".seg");
+    if (segment_->num_docs() != forward_index_.size()) throw std::runtime_error("Segment does not match documents");
+    decode_once_ = std::make_unique<std::once_flag[]>(segment_->num_terms());
+    decoded_ = std::make_unique<std::unique_ptr<FieldPostings>[]>(segment_->num_terms());
+}
+
+uint64_t Index::version(const std::string& base_name) {
+    std::ifstream in(base_name + ".version");
+    uint64_t version = 0;
+    if (in.is_open() && !(in >> version)) throw std::runtime_error("Invalid " + base_name + ".version");
+    return version;
+}
+
+uint64_t Index::publish_version(const std::string& base_name) {
+    uint64_t next = version(base_name) + 1;
+    std::string tmp = base_name + ".version.tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << next << '\n';
+        out.close();
+        if (!out) throw std::runtime_error("Cannot write " + tmp);
+    }
+    std::filesystem::rename(tmp, base_name + ".version");
+    return next;
+}
+
+std::vector<std::string> Index::shards(const std::string& base_name) {
+    std::vector<std::string> names;
+    std::ifstream in(base_name + ".shards");
+    if (!in.is_open()) return names;
+    std::string key;
+    size_t count = 0;
+    if (!(in >> key >> count) || key != "shards") throw std::runtime_error("Invalid " + base_name + ".shards");
+    names.resize(count);
+    for (auto& name : names) {
+        if (!(in >> name)) throw std::runtime_error("Invalid " + base_name + ".shards");
+    }
+    return names;
+}
+
+void Index::save_shards(const std::string& base_name, const std::vector<std::string>& names) {
+    std::string tmp = base_name + ".shards.tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << "shards " << names.size() << '\n';
+        for (const auto& name : names) out << name << '\n';
+        out.close();
+        if (!out) throw std::runtime_error("Cannot write " + tmp);
+    }
+    std::filesystem::rename(tmp, base_name + ".shards");
+}
+
+TermId Index::term_id(std::string_view term) const {
+    if (segment_) return segment_->find(term);
+    if (!inverted_index_.ids.empty()) {
+        auto it = inverted_index_.ids.find(term);
+        return it == inverted_index_.ids.end() ? kNoTerm : it->second;
+    }
+    return dictionary_.find(term);
+}
+
+uint32_t Index::num_terms() const {
+    return segment_ ? segment_->num_terms() : static_cast<uint32_t>(inverted_index_.size());
+}
+
+const FieldPostings& Index::postings(TermId id) const {
+    if (!segment_) return inverted_index_.postings[id];
+    std::call_once(decode_once_[id], [&] {
+        decoded_[id] = std::make_unique<FieldPostings>(segment_->decode(id));
+        // В сегментах версии 2 минимумы блоков посчитаны по длинам документов.
+        if (segment_->version() < 3) build_block_max_for(*decoded_[id]);
+    });
+    return *decoded_[id];
+}
 
+uint32_t Index::doc_freq(TermId id) const {
+    if (id < doc_freqs_.size()) return doc_freqs_[id];
+    if (segment_) {
+        if (uint32_t df = segment_->doc_freq(id)) return df;
+    }
+    return term_doc_freq(postings(id));
+}
+
+// Словарь сегмента отображён из файла и в куче места не занимает; считаются
+// только таблицы ленивой распаковки.
+size_t Index::dictionary_bytes() const {
+    if (segment_) return segment_->num_terms() * (sizeof(std::once_flag) + sizeof(std::unique_ptr<FieldPostings>));
+    size_t bytes = dictionary_.memory_bytes() + doc_freqs_.capacity() * sizeof(uint32_t);
+    const auto& ids = inverted_index_.ids;
+    bytes += ids.bucket_count() * sizeof(void*);
+    for (const auto& [term, id] : ids) {
+        bytes += sizeof(void*) + sizeof(size_t) + sizeof(Term) + sizeof(TermId);
+        if (term.capacity() > 15) bytes += term.capacity() + 1;
+    }
+    return bytes;
+}
+
+void Index::for_each_term(const std::function<void(std::string_view, const FieldPostings&)>& fn) const {
+    if (segment_) {
+        for (uint32_t ordinal = 0; ordinal < segment_->num_terms(); ++ordinal) {
+            fn(segment_->term(ordinal), segment_->decode(ordinal));
+        }
+        return;
+    }
+    if (inverted_index_.ids.empty()) {
+        dictionary_.for_each([&](TermId id, std::string_view term) { fn(term, inverted_index_.postings[id]); });
+        return;
+    }
+    std::vector<std::pair<std::string_view, TermId>> terms;
+    terms.reserve(inverted_index_.ids.size());
+    for (const auto& [term, id] : inverted_index_.ids) terms.emplace_back(term, id);
+    std::sort(terms.begin(), terms.end());
+    for (const auto& [term, id] : terms) fn(term, inverted_index_.postings[id]);
+}
+
+// Старый формат .inv: последовательные varint-записи, читается целиком.
+// Записанные метаданные блоков посчитаны по длинам документов, поэтому
+// пересчитываются по нормам полей, как и для файлов без номера версии.
+void Index::load_legacy(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) throw std::runtime_error("Cannot open .inv file");
     if (read_varint(in) != 0xCAFEBABE) throw std::runtime_error("Invalid magic header");
 
+    // Версия 2 (с block-max) пишет 2 сразу после магического числа, а исходный
+    // формат - число терминов, так что индекс ровно из двух терминов выглядит
+    // так же. Поэтому 2 проверяется пробным разбором: версия 2, только если
+    // после неё файл читается до 0xDEADBEEF.
+    std::streampos body = in.tellg();
+    bool has_block_max = false;
+    if (read_varint(in) == kLegacyFormatVersion) {
+        try {
+            has_block_max = read_legacy_terms(in, true, false);
+        } catch (const std::exception&) {}
+    }
+    in.clear();
+    in.seekg(body);
+    if (has_block_max) read_varint(in);
+    if (!read_legacy_terms(in, has_block_max, true)) throw std::runtime_error("Invalid magic footer");
+    build_postings_metadata();
+}
+
+bool Index::read_legacy_terms(std::ifstream& in, bool has_block_max, bool store) {
+    size_t total_docs = forward_index_.size();
     size_t inv_size = read_varint(in);
     for (size_t i = 0; i < inv_size; ++i) {
         Term term;
         read_string(in, term);
+        if (!in) return false;
+        TermId id = store ? inverted_index_.intern(term) : kNoTerm;
         size_t fields_count = read_varint(in);
         
         for (size_t j = 0; j < fields_count; ++j) {
@@ -88,28 +342,38 @@ void Index::load(const std::string& base_name) {
             read_string(in, field);
             PostingsList postings;
             
-            postings.docs = read_delta_vector(in);
-            if (!postings.docs.empty() && postings.docs.back() >= total_docs) {
-                 std::cerr << "CORRUPTION: " << term << " " << postings.docs.back() << std::endl;
-                 postings.docs.clear(); 
-            }
+            DocList docs = read_delta_vector(in);
+            bool corrupted = !docs.empty() && docs.back() >= total_docs;
+            if (corrupted && store) std::cerr << "CORRUPTION: " << term << " " << docs.back() << std::endl;
 
             size_t pos_vec_count = read_varint(in);
-            postings.positions.reserve(pos_vec_count);
+            if (!corrupted && pos_vec_count != docs.size()) throw std::runtime_error("Corrupted .inv positions");
+            if (store) {
+                postings.docs.reserve(pos_vec_count);
+                postings.tfs.reserve(pos_vec_count);
+                postings.pos_offsets.reserve(pos_vec_count);
+            }
             for (size_t k = 0; k < pos_vec_count; ++k) {
-                postings.positions.push_back(read_delta_vector(in));
+                auto positions = read_delta_vector(in);
+                if (!corrupted && store) postings.add(docs[k], positions);
             }
 
-            auto skip_vec = read_delta_vector(in);
-            postings.skips.reserve(skip_vec.size());
-            for(auto s : skip_vec) postings.skips.push_back(s);
-            
-            postings.skip_step = read_varint(in);
+            // Skip-указатели старого формата больше не нужны: пересечение идёт галопом.
+            read_delta_vector(in);
+            read_varint(in);
 
-            inverted_index_[term][field] = std::move(postings);
+            if (has_block_max) {
+                read_delta_vector(in);
+                read_vector(in);
+                read_vector(in);
+                read_varint(in);
+                read_varint(in);
+            }
+            if (!in) return false;
+            if (uint32_t f = field_id(field); store && f != kNoField) inverted_index_.postings[id][f] = std::move(postings);
         }
     }
-    if (read_varint(in) != 0xDEADBEEF) throw std::runtime_error("Invalid magic footer");
+    return in && read_varint(in) == 0xDEADBEEF;
 }
 /*
   Обратный индекс
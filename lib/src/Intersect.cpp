@@ -0,0 +1,188 @@
+#include "Intersect.h"
+#include <cstdint>
+#include <immintrin.h>
+#include <utility>
+
+namespace intersect {
+
+namespace {
+
+size_t merge_tail(const DocId* a, size_t n, size_t i, const DocId* b, size_t m, size_t j, DocId* out, size_t count) {
+    while (i < n && j < m) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            out[count++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+size_t merge_scalar(const DocId* a, size_t n, const DocId* b, size_t m, DocId* out) {
+    return merge_tail(a, n, 0, b, m, 0, out, 0);
+}
+
+// Блок из 4 элементов a сравнивается со всеми циклическими сдвигами блока b;
+// сдвигается тот блок, у которого меньше последний элемент.
+__attribute__((target("sse2"))) size_t merge_sse(const DocId* a, size_t n, const DocId* b, size_t m, DocId* out) {
+    size_t i = 0, j = 0, count = 0;
+    while (i + 4 <= n && j + 4 <= m) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        for (int mask = _mm_movemask_ps(_mm_castsi128_ps(hits)); mask; mask &= mask - 1) {
+            out[count++] = a[i + __builtin_ctz(mask)];
+        }
+        DocId a_last = a[i + 3];
+        DocId b_last = b[j + 3];
+        if (a_last <= b_last) i += 4;
+        if (b_last <= a_last) j += 4;
+    }
+    return merge_tail(a, n, i, b, m, j, out, count);
+}
+
+// То же блоками по 8: сдвиги блока b — перестановки _mm256_permutevar8x32_epi32.
+__attribute__((target("avx2"))) size_t merge_avx2(const DocId* a, size_t n, const DocId* b, size_t m, DocId* out) {
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    size_t i = 0, j = 0, count = 0;
+    while (i + 8 <= n && j + 8 <= m) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+        __m256i hits = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; ++r) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi32(va, vb));
+        }
+        for (int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hits)); mask; mask &= mask - 1) {
+            out[count++] = a[i + __builtin_ctz(mask)];
+        }
+        DocId a_last = a[i + 7];
+        DocId b_last = b[j + 7];
+        if (a_last <= b_last) i += 8;
+        if (b_last <= a_last) j += 8;
+    }
+    return merge_tail(a, n, i, b, m, j, out, count);
+}
+
+// Сколько из 8 элементов окна меньше target.
+size_t count_less_scalar(const DocId* window, DocId target) {
+    size_t less = 0;
+    for (size_t k = 0; k < 8; ++k) less += window[k] < target;
+    return less;
+}
+
+__attribute__((target("avx2"))) size_t count_less_avx2(const DocId* window, DocId target) {
+    // Беззнаковое сравнение через сдвиг в знаковый диапазон.
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(window)), bias);
+    __m256i t = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(target)), bias);
+    return __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t, v))));
+}
+
+// a — короткий список. Для каждого его элемента: экспоненциальный поиск в b от
+// предыдущей позиции, бинарный поиск до окна из 8 элементов, затем одно
+// сравнение окна целиком.
+template <size_t (*CountLess)(const DocId*, DocId)>
+size_t gallop(const DocId* a, size_t n, const DocId* b, size_t m, DocId* out) {
+    size_t lo = 0, count = 0;
+    for (size_t i = 0; i < n && lo < m; ++i) {
+        DocId target = a[i];
+        if (b[lo] >= target) {
+            if (b[lo] == target) out[count++] = target;
+            continue;
+        }
+        // b[lo] < target: ищем hi с b[hi] >= target (или hi == m).
+        size_t step = 1;
+        size_t hi = lo + 1;
+        while (hi < m && b[hi] < target) {
+            lo = hi;
+            hi += step;
+            step <<= 1;
+        }
+        hi = std::min(hi, m);
+        // Инвариант: b[lo] < target, а все элементы с индексом >= hi не меньше target.
+        while (hi - lo > 8) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (b[mid] < target) lo = mid;
+            else hi = mid;
+        }
+        size_t pos;
+        if (lo + 9 <= m) pos = lo + 1 + CountLess(b + lo + 1, target);
+        else for (pos = lo + 1; pos < hi && b[pos] < target; ++pos) {}
+        lo = pos;
+        if (pos < m && b[pos] == target) out[count++] = target;
+    }
+    return count;
+}
+
+bool has_avx2() {
+    static const bool kAvx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return kAvx2;
+}
+
+}  // namespace
+
+Kernel best_merge_kernel() {
+    static const Kernel kBest = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return Kernel::kAvx2Merge;
+        if (__builtin_cpu_supports("sse2")) return Kernel::kSseMerge;
+        return Kernel::kScalarMerge;
+    }();
+    return kBest;
+}
+
+Kernel choose(size_t n, size_t m) {
+    if (n > m) std::swap(n, m);
+    if (n > 0 && m / n >= kGallopRatio) return Kernel::kGallop;
+    return best_merge_kernel();
+}
+
+const char* kernel_name(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::kScalarMerge:
+            return "merge-scalar";
+        case Kernel::kSseMerge:
+            return "merge-sse";
+        case Kernel::kAvx2Merge:
+            return "merge-avx2";
+        case Kernel::kGallop:
+            return "gallop";
+    }
+    return "unknown";
+}
+
+size_t intersect(Kernel kernel, const DocId* a, size_t n, const DocId* b, size_t m, DocId* out) {
+    if (n > m) {
+        std::swap(a, b);
+        std::swap(n, m);
+    }
+    if (n == 0) return 0;
+    switch (kernel) {
+        case Kernel::kScalarMerge:
+            return merge_scalar(a, n, b, m, out);
+        case Kernel::kSseMerge:
+            return merge_sse(a, n, b, m, out);
+        case Kernel::kAvx2Merge:
+            return merge_avx2(a, n, b, m, out);
+        case Kernel::kGallop:
+            return has_avx2() ? gallop<count_less_avx2>(a, n, b, m, out) : gallop<count_less_scalar>(a, n, b, m, out);
+    }
+    return 0;
+}
+
+size_t intersect(const DocId* a, size_t n, const DocId* b, size_t m, DocId* out) {
+    return intersect(choose(n, m), a, n, b, m, out);
+}
+
+}  // namespace intersect
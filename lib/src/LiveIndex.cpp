@@ -0,0 +1,655 @@
+#include "LiveIndex.h"
+#include "Encoding.h"
+#include "Metrics.h"
+#include "TopK.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t kManifestVersion = 1;
+
+size_t result_depth(size_t k, size_t offset) { return k > SIZE_MAX - offset ? SIZE_MAX : k + offset; }
+
+void remove_file(const std::string& path) {
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+}
+
+// Исходный индекс и его шарды пишет индексатор, свои сегменты LiveIndex
+// называет _N. Файлы индексатора LiveIndex не удаляет.
+bool is_base_segment(const std::string& name) { return name.empty() || name.front() != '_'; }
+
+}  // namespace
+
+std::optional<DocId> LiveIndex::Segment::find(DocId global) const {
+    DocId local = global;
+    if (ids) {
+        auto it = std::lower_bound(ids->begin(), ids->end(), global);
+        if (it == ids->end() || *it != global) return std::nullopt;
+        local = static_cast<DocId>(it - ids->begin());
+    } else if (global >= num_docs()) {
+        return std::nullopt;
+    }
+    if (deleted && deleted->contains(local)) return std::nullopt;
+    return local;
+}
+
+LiveIndex::Snapshot::Snapshot(std::vector<Segment> segments, uint64_t generation, uint64_t base_version,
+                              SearchEngine::ConjunctionCache* cache, ThreadPool* pool)
+    : segments_(std::move(segments)), generation_(generation), base_version_(base_version), cache_(cache),
+      pool_(pool) {
+    // Удалённые документы остаются в статистике до слияния, как и в df их терминов.
+    for (const auto& segment : segments_) {
+        stats_.num_docs += segment.num_docs();
+        for (uint32_t f = 0; f < kNumFields; ++f) total_length_[f] += segment.index->get_norms().total_length(f);
+    }
+    for (uint32_t f = 0; f < kNumFields; ++f) {
+        stats_.avg_length[f] = stats_.num_docs ? static_cast<double>(total_length_[f]) / stats_.num_docs : 0.0;
+    }
+    stats_.doc_freq = [this](std::string_view term) {
+        uint32_t doc_freq = 0;
+        for (const auto& segment : segments_) {
+            TermId id = segment.index->term_id(term);
+            if (id != kNoTerm) doc_freq += segment.index->doc_freq(id);
+        }
+        return doc_freq;
+    };
+    // Единственный сегмент сам себе коллекция: статистика та же, и вклады saat годятся.
+    init_engines(segments_.size() > 1);
+}
+
+LiveIndex::Snapshot::Snapshot(const Snapshot& local, CollectionStats stats)
+    : segments_(local.segments_), stats_(std::move(stats)), total_length_(local.total_length_),
+      generation_(local.generation_), base_version_(local.base_version_), cache_(local.cache_),
+      pool_(local.pool_) {
+    init_engines(true);
+}
+
+void LiveIndex::Snapshot::init_engines(bool collection_stats) {
+    for (const auto& segment : segments_) {
+        auto engine = std::make_unique<SearchEngine>(*segment.index);
+        if (collection_stats) engine->set_collection_stats(&stats_);
+        engine->set_deleted(segment.deleted.get());
+        engine->set_thread_pool(pool_);
+        if (cache_) engine->set_conjunction_cache(cache_, std::to_string(base_version_) + '.' + segment.name + '|');
+        engines_.push_back(std::move(engine));
+    }
+}
+
+const SearchEngine& LiveIndex::Snapshot::parser() const {
+    if (!engines_.empty()) return *engines_.front();
+    static const Index empty;
+    static const SearchEngine parser(empty);
+    return parser;
+}
+
+size_t LiveIndex::Snapshot::num_docs() const {
+    size_t total = 0;
+    for (const auto& segment : segments_) total += segment.live_docs();
+    return total;
+}
+
+template <typename Search>
+ScoredDocs LiveIndex::Snapshot::gather(size_t k, size_t offset, Search&& search) const {
+    if (segments_.size() == 1) {
+        auto hits = search(*engines_[0], k, offset);
+        for (auto& hit : hits) hit.id = segments_[0].global_id(hit.id);
+        return hits;
+    }
+    if (k == 0) return {};
+    // Глобальные DocId сегмента растут вместе с локальными, поэтому порядок
+    // равных score внутри сегмента совпадает с общим.
+    size_t depth = result_depth(k, offset);
+    std::vector<ScoredDocs> hits(segments_.size());
+    // Трассировка запроса thread_local, потоки пула её не видят: каждый сегмент
+    // пишется в свою, итоги переносятся в трассировку запроса после поиска.
+    QueryTrace* trace = QueryTrace::current();
+    std::vector<QueryTrace::Part> parts(trace ? segments_.size() : 0);
+    auto search_segment = [&](size_t s) {
+        if (!trace) {
+            hits[s] = search(*engines_[s], depth, 0);
+            return;
+        }
+        QueryTrace segment_trace;
+        hits[s] = search(*engines_[s], depth, 0);
+        parts[s] = segment_trace.part();
+    };
+    if (pool_) {
+        pool_->run(segments_.size(), search_segment);
+    } else {
+        for (size_t s = 0; s < segments_.size(); ++s) search_segment(s);
+    }
+    if (trace) trace->mark_parts(parts);
+    TopK top(depth);
+    for (size_t s = 0; s < segments_.size(); ++s) {
+        for (const auto& hit : hits[s]) top.push(hit.score, segments_[s].global_id(hit.id));
+    }
+    return top.take(offset);
+}
+
+ScoredDocs LiveIndex::Snapshot::search_top_k(const std::string& query_str, size_t k, size_t offset,
+                                             double k1, double b, double w_title) const {
+    return gather(k, offset, [&](const SearchEngine& engine, size_t depth, size_t skip) {
+        return engine.search_top_k(query_str, depth, skip, k1, b, w_title);
+    });
+}
+
+ScoredDocs LiveIndex::Snapshot::search_ranked_or(const std::string& query_str, size_t k, size_t offset,
+                                                 double k1, double b, double w_title) const {
+    return gather(k, offset, [&](const SearchEngine& engine, size_t depth, size_t skip) {
+        return engine.search_ranked_or(query_str, depth, skip, k1, b, w_title);
+    });
+}
+
+ScoredDocs LiveIndex::Snapshot::search_impacts(const std::string& query_str, size_t k, size_t offset,
+                                               double k1, double b, double w_title, size_t postings_budget) const {
+    return gather(k, offset, [&](const SearchEngine& engine, size_t depth, size_t skip) {
+        return engine.search_impacts(query_str, depth, skip, k1, b, w_title, postings_budget);
+    });
+}
+
+std::vector<ScoredDocs> LiveIndex::Snapshot::search_batch(const std::vector<SearchEngine::BatchQuery>& queries,
+                                                          double k1, double b, double w_title,
+                                                          size_t num_threads) const {
+    std::vector<ScoredDocs> results(queries.size());
+    if (segments_.size() == 1) {
+        results = engines_[0]->search_batch(queries, k1, b, w_title, num_threads);
+        for (auto& hits : results) {
+            for (auto& hit : hits) hit.id = segments_[0].global_id(hit.id);
+        }
+        return results;
+    }
+
+    auto deep = queries;
+    for (auto& q : deep) {
+        q.k = q.k == 0 ? 0 : result_depth(q.k, q.offset);
+        q.offset = 0;
+    }
+    std::vector<TopK> tops;
+    tops.reserve(queries.size());
+    for (const auto& q : deep) tops.emplace_back(q.k);
+    for (size_t s = 0; s < segments_.size(); ++s) {
+        auto hits = engines_[s]->search_batch(deep, k1, b, w_title, num_threads);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            for (const auto& hit : hits[i]) tops[i].push(hit.score, segments_[s].global_id(hit.id));
+        }
+    }
+    for (size_t i = 0; i < queries.size(); ++i) results[i] = tops[i].take(queries[i].offset);
+    return results;
+}
+
+std::string LiveIndex::Snapshot::normalize_query(const std::string& query_str) const {
+    return parser().normalize_query(query_str);
+}
+
+Tokens LiveIndex::Snapshot::scoring_terms(const std::string& query_str) const {
+    return parser().scoring_terms(query_str);
+}
+
+std::string LiveIndex::Snapshot::explain(const std::string& query_str) const {
+    if (engines_.empty()) return "EMPTY\n";
+    if (engines_.size() == 1) return engines_.front()->explain(query_str);
+    std::string out;
+    for (size_t s = 0; s < segments_.size(); ++s) {
+        out += "segment " + (segments_[s].name.empty() ? std::string("base") : segments_[s].name) + ":\n";
+        out += engines_[s]->explain(query_str);
+    }
+    return out;
+}
+
+std::optional<Document> LiveIndex::Snapshot::document(DocId id) const {
+    for (const auto& segment : segments_) {
+        if (auto local = segment.find(id)) {
+            Document doc = segment.index->get_forward_index().get_document(*local);
+            doc.id = id;
+            return doc;
+        }
+    }
+    return std::nullopt;
+}
+
+LiveIndex::LiveIndex(std::string base_name, Options options)
+    : base_name_(std::move(base_name)), options_(options) {
+    load_manifest();
+    merge_requested_ = true;
+    start_threads();
+}
+
+void LiveIndex::start_threads() {
+    if (options_.refresh_interval.count() > 0) refresh_thread_ = std::thread([this] { refresh_loop(); });
+    merge_thread_ = std::thread([this] { merge_loop(); });
+}
+
+LiveIndex::~LiveIndex() { close(); }
+
+void LiveIndex::close() {
+    {
+        std::lock_guard lock(thread_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (refresh_thread_.joinable()) refresh_thread_.join();
+    if (merge_thread_.joinable()) merge_thread_.join();
+    {
+        // После этого буфер больше не пополняется, и последний refresh забирает всё.
+        std::lock_guard lock(pending_mutex_);
+        if (closed_.exchange(true)) return;
+    }
+    try {
+        refresh();
+    } catch (const std::exception& e) {
+        std::cerr << "Final refresh failed: " << e.what() << std::endl;
+    }
+}
+
+void LiveIndex::reopen() {
+    {
+        std::lock_guard lock(pending_mutex_);
+        if (!closed_.exchange(false)) return;
+    }
+    {
+        std::lock_guard lock(thread_mutex_);
+        stop_ = false;
+        merge_requested_ = true;
+    }
+    start_threads();
+}
+
+DocId LiveIndex::add_document(std::string title, std::string plot, std::optional<DocId> id) {
+    std::lock_guard lock(pending_mutex_);
+    if (closed_) throw std::runtime_error("LiveIndex is closed");
+    if (id && *id > kMaxDocId) throw std::out_of_range("DocId " + std::to_string(*id) + " is out of range");
+    if (!id && next_doc_ > kMaxDocId) throw std::length_error("No free DocIds left");
+    DocId doc_id = id ? *id : next_doc_;
+    if (doc_id >= next_doc_) next_doc_ = doc_id + 1;
+    pending_[doc_id] = Document{doc_id, std::move(title), std::move(plot)};
+    return doc_id;
+}
+
+bool LiveIndex::delete_document(DocId id) {
+    std::lock_guard lock(pending_mutex_);
+    if (closed_) throw std::runtime_error("LiveIndex is closed");
+    auto it = pending_.find(id);
+    bool exists = false;
+    if (it != pending_.end()) {
+        exists = it->second.has_value();
+    } else {
+        auto current = snapshot();
+        exists = std::any_of(current->segments().begin(), current->segments().end(),
+                             [&](const Segment& segment) { return segment.find(id).has_value(); });
+    }
+    if (exists) pending_[id] = std::nullopt;
+    return exists;
+}
+
+void LiveIndex::SegmentBuilder::add(DocId global, std::string_view title, std::string_view plot) {
+    index.add_document(DocumentView(static_cast<DocId>(ids.size()), title, plot));
+    ids.push_back(global);
+}
+
+std::string LiveIndex::segment_path(const std::string& name) const {
+    return name.empty() ? base_name_ : base_name_ + "." + name;
+}
+
+std::string LiveIndex::deleted_path(const std::string& name, uint64_t generation) const {
+    return segment_path(name) + "." + std::to_string(generation) + ".del";
+}
+
+std::string LiveIndex::next_segment_name() {
+    std::string name = "_";
+    name += std::to_string(next_segment_++);
+    return name;
+}
+
+LiveIndex::Segment LiveIndex::write_segment(SegmentBuilder& builder, const std::string& name) {
+    builder.index.build_postings_metadata();
+    std::string path = segment_path(name);
+    builder.index.save(path);
+    std::ofstream out(path + ".ids", std::ios::binary);
+    write_delta_vector(out, builder.ids);
+    out.close();
+    if (!out) throw std::runtime_error("Cannot write " + path + ".ids");
+    return open_segment(name, 0);
+}
+
+LiveIndex::Segment LiveIndex::open_segment(const std::string& name, uint64_t deleted_generation) const {
+    Segment segment;
+    segment.name = name;
+    std::string path = segment_path(name);
+    auto index = std::make_shared<Index>();
+    index->load(path);
+    segment.index = std::move(index);
+    // У исходного индекса .ids есть, только если он сам - шард другой коллекции.
+    if (!name.empty() || std::filesystem::exists(path + ".ids")) {
+        std::ifstream in(path + ".ids", std::ios::binary);
+        if (!in.is_open()) throw std::runtime_error("Cannot open " + path + ".ids");
+        auto ids = std::make_shared<const DocList>(read_delta_vector(in));
+        if (ids->size() != segment.num_docs()) throw std::runtime_error("Segment ids do not match documents");
+        segment.ids = std::move(ids);
+    }
+    segment.deleted_generation = deleted_generation;
+    if (deleted_generation != 0) {
+        std::ifstream in(deleted_path(name, deleted_generation), std::ios::binary);
+        if (!in.is_open()) throw std::runtime_error("Cannot open " + deleted_path(name, deleted_generation));
+        DocList docs = read_delta_vector(in);
+        segment.num_deleted = docs.size();
+        segment.deleted = std::make_shared<const Bitmap>(Bitmap::from_sorted(docs));
+    }
+    return segment;
+}
+
+void LiveIndex::remove_segment_files(const std::string& name) const {
+    if (is_base_segment(name)) return;
+    for (const char* ext : {".seg", ".store", ".norms", ".ids"}) remove_file(segment_path(name) + ext);
+}
+
+void LiveIndex::load_manifest() {
+    base_version_ = Index::version(base_name_);
+    std::vector<std::pair<std::string, uint64_t>> listed;  // имя сегмента и поколение .del
+    uint64_t manifest_base_version = 0;
+    std::ifstream in(base_name_ + ".manifest");
+    bool has_manifest = in.is_open();
+    if (has_manifest) {
+        std::string key;
+        uint64_t version = 0;
+        if (!(in >> key >> version) || key != "live-index" || version != kManifestVersion) {
+            throw std::runtime_error("Invalid manifest " + base_name_ + ".manifest");
+        }
+        while (in >> key) {
+            if (key == "generation") {
+                in >> generation_;
+            } else if (key == "next_doc") {
+                in >> committed_next_doc_;
+            } else if (key == "next_segment") {
+                in >> next_segment_;
+            } else if (key == "base_version") {
+                in >> manifest_base_version;
+            } else if (key == "segment") {
+                std::string name;
+                uint64_t deleted_generation = 0;
+                in >> name >> deleted_generation;
+                listed.emplace_back(name == "-" ? "" : name, deleted_generation);
+            } else {
+                throw std::runtime_error("Invalid manifest " + base_name_ + ".manifest");
+            }
+        }
+    }
+
+    std::vector<Segment> segments;
+    if (has_manifest && manifest_base_version == base_version_) {
+        for (const auto& [name, deleted_generation] : listed) segments.push_back(open_segment(name, deleted_generation));
+    } else {
+        if (has_manifest) {
+            // Индекс пересобран. Поколения и номера сегментов продолжаются, чтобы не
+            // переписать файлы, которые ещё читает снимок прежнего LiveIndex.
+            std::cerr << "Manifest " << base_name_ << ".manifest is for index version " << manifest_base_version
+                      << ", current is " << base_version_ << ": starting over" << std::endl;
+            for (const auto& [name, deleted_generation] : listed) {
+                if (deleted_generation != 0) remove_file(deleted_path(name, deleted_generation));
+                remove_segment_files(name);
+            }
+            committed_next_doc_ = 0;
+        }
+        auto shards = Index::shards(base_name_);
+        if (!shards.empty()) {
+            for (const auto& name : shards) segments.push_back(open_segment(name, 0));
+        } else if (std::filesystem::exists(base_name_ + ".seg") || std::filesystem::exists(base_name_ + ".inv")) {
+            segments.push_back(open_segment("", 0));
+        }
+        for (const auto& segment : segments) {
+            if (segment.num_docs() > 0) {
+                committed_next_doc_ = std::max(committed_next_doc_, segment.global_id(segment.num_docs() - 1) + 1);
+            }
+        }
+    }
+    next_doc_ = committed_next_doc_;
+    snapshot_.store(std::make_shared<const Snapshot>(std::move(segments), generation_, base_version_,
+                                                     options_.conjunction_cache, options_.search_pool));
+    // Устаревший манифест сразу заменяется, иначе следующее открытие снова
+    // начнёт сначала.
+    if (has_manifest && manifest_base_version != base_version_) commit(snapshot_.load()->segments());
+}
+
+void LiveIndex::commit(std::vector<Segment> segments) {
+    auto previous = snapshot_.load();
+    uint64_t generation = generation_ + 1;
+
+    for (auto& segment : segments) {
+        auto old = std::find_if(previous->segments().begin(), previous->segments().end(),
+                                [&](const Segment& s) { return s.name == segment.name; });
+        bool changed = old == previous->segments().end() ? segment.deleted != nullptr : old->deleted != segment.deleted;
+        if (!changed) continue;
+        DocList docs;
+        segment.deleted->append_to(docs);
+        std::ofstream out(deleted_path(segment.name, generation), std::ios::binary);
+        write_delta_vector(out, docs);
+        out.close();
+        if (!out) throw std::runtime_error("Cannot write " + deleted_path(segment.name, generation));
+        segment.deleted_generation = generation;
+    }
+
+    std::string manifest = base_name_ + ".manifest";
+    {
+        std::ofstream out(manifest + ".tmp");
+        out << "live-index " << kManifestVersion << '\n'
+            << "base_version " << base_version_ << '\n'
+            << "generation " << generation << '\n'
+            << "next_doc " << committed_next_doc_ << '\n'
+            << "next_segment " << next_segment_ << '\n';
+        for (const auto& segment : segments) {
+            out << "segment " << (segment.name.empty() ? "-" : segment.name) << ' ' << segment.deleted_generation
+                << '\n';
+        }
+        out.close();
+        if (!out) throw std::runtime_error("Cannot write " + manifest + ".tmp");
+    }
+    std::filesystem::rename(manifest + ".tmp", manifest);
+
+    generation_ = generation;
+    auto current = std::make_shared<const Snapshot>(std::move(segments), generation, base_version_,
+                                                    options_.conjunction_cache, options_.search_pool);
+    snapshot_.store(current);
+
+    // Запросы, которые ещё держат старый снимок, читают отображённые файлы:
+    // удаление имени файла им не мешает. Файлы исходного индекса не удаляются.
+    for (const auto& old : previous->segments()) {
+        auto it = std::find_if(current->segments().begin(), current->segments().end(),
+                               [&](const Segment& s) { return s.name == old.name; });
+        bool gone = it == current->segments().end();
+        if (old.deleted_generation != 0 && (gone || it->deleted_generation != old.deleted_generation)) {
+            remove_file(deleted_path(old.name, old.deleted_generation));
+        }
+        if (gone) remove_segment_files(old.name);
+    }
+}
+
+void LiveIndex::refresh() {
+    std::lock_guard commit_lock(commit_mutex_);
+    std::map<DocId, std::optional<Document>> ops;
+    DocId next_doc;
+    {
+        std::lock_guard lock(pending_mutex_);
+        ops.swap(pending_);
+        next_doc = next_doc_;
+    }
+    if (ops.empty()) return;
+
+    try {
+        auto segments = snapshot_.load()->segments();
+        // Заменённые и удалённые документы уже записанных сегментов - в tombstones.
+        for (auto& segment : segments) {
+            DocList local;
+            for (const auto& op : ops) {
+                if (auto doc = segment.find(op.first)) local.push_back(*doc);
+            }
+            if (local.empty()) continue;
+            Bitmap added = Bitmap::from_sorted(local);
+            segment.deleted = std::make_shared<const Bitmap>(segment.deleted ? Bitmap::unite(*segment.deleted, added)
+                                                                             : std::move(added));
+            segment.num_deleted += local.size();
+        }
+        SegmentBuilder builder;
+        for (const auto& [id, doc] : ops) {
+            if (doc) builder.add(id, doc->title, doc->plot);
+        }
+        if (!builder.ids.empty()) segments.push_back(write_segment(builder, next_segment_name()));
+        committed_next_doc_ = next_doc;
+        commit(std::move(segments));
+    } catch (...) {
+        // Изменения возвращаются в буфер; принятые за это время более новые остаются.
+        std::lock_guard lock(pending_mutex_);
+        pending_.insert(ops.begin(), ops.end());
+        throw;
+    }
+
+    {
+        std::lock_guard lock(thread_mutex_);
+        merge_requested_ = true;
+    }
+    wake_.notify_all();
+}
+
+std::vector<size_t> LiveIndex::pick_merge(const std::vector<Segment>& segments) const {
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (segments[i].num_deleted > 0 && segments[i].num_deleted * 2 >= segments[i].num_docs()) return {i};
+    }
+    // Уровень сегмента - floor(log_factor(неудалённые документы)). Сливаются
+    // factor самых маленьких сегментов нижнего заполненного уровня. Шарды
+    // индексатора по уровням не сливаются - иначе они снова стали бы одним индексом.
+    size_t factor = std::max<size_t>(2, options_.merge_factor);
+    std::map<int, std::vector<size_t>> tiers;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (!segments[i].name.empty() && is_base_segment(segments[i].name)) continue;
+        int tier = 0;
+        for (size_t docs = segments[i].live_docs(); docs >= factor; docs /= factor) ++tier;
+        tiers[tier].push_back(i);
+    }
+    for (auto& [tier, members] : tiers) {
+        if (members.size() < factor) continue;
+        std::stable_sort(members.begin(), members.end(), [&](size_t a, size_t b) {
+            return segments[a].live_docs() < segments[b].live_docs();
+        });
+        members.resize(factor);
+        std::sort(members.begin(), members.end());
+        return members;
+    }
+    return {};
+}
+
+bool LiveIndex::maybe_merge() {
+    if (closed_) return false;
+    auto snapshot = snapshot_.load();
+    auto picked = pick_merge(snapshot->segments());
+    if (picked.empty()) return false;
+    std::vector<Segment> sources;
+    for (size_t i : picked) sources.push_back(snapshot->segments()[i]);
+
+    // Неудалённые документы источников по возрастанию глобальных DocId.
+    struct Source {
+        DocId global;
+        size_t segment;
+        DocId local;
+    };
+    std::vector<Source> docs;
+    for (size_t s = 0; s < sources.size(); ++s) {
+        for (DocId local = 0; local < sources[s].num_docs(); ++local) {
+            if (!sources[s].deleted || !sources[s].deleted->contains(local)) {
+                docs.push_back({sources[s].global_id(local), s, local});
+            }
+        }
+    }
+    std::sort(docs.begin(), docs.end(), [](const Source& a, const Source& b) { return a.global < b.global; });
+    std::optional<Segment> merged;
+    {
+        SegmentBuilder builder;
+        for (size_t i = 0; i < docs.size(); ++i) {
+            // Остановка не ждёт долгого слияния.
+            if (i % 1024 == 0 && stopping()) return false;
+            const auto& doc = docs[i];
+            Document text = sources[doc.segment].index->get_forward_index().get_document(doc.local);
+            builder.add(doc.global, text.title, text.plot);
+        }
+        if (!builder.ids.empty()) {
+            std::string name;
+            {
+                std::lock_guard lock(commit_mutex_);
+                name = next_segment_name();
+            }
+            merged = write_segment(builder, name);
+        }
+    }
+
+    std::lock_guard lock(commit_mutex_);
+    if (closed_) {
+        if (merged) remove_segment_files(merged->name);
+        return false;
+    }
+    // Удаления, которые пришли в источники, пока шло слияние, переносятся в новый сегмент.
+    std::vector<Segment> segments;
+    size_t merged_at = SIZE_MAX;
+    DocList deleted_since;
+    for (const auto& segment : snapshot_.load()->segments()) {
+        auto source = std::find_if(sources.begin(), sources.end(), [&](const Segment& s) { return s.name == segment.name; });
+        if (source == sources.end()) {
+            segments.push_back(segment);
+            continue;
+        }
+        if (segment.deleted && segment.deleted != source->deleted) {
+            Bitmap fresh = source->deleted ? Bitmap::difference(*segment.deleted, *source->deleted) : *segment.deleted;
+            fresh.for_each([&](DocId local) { deleted_since.push_back(segment.global_id(local)); });
+        }
+        if (merged && merged_at == SIZE_MAX) {
+            merged_at = segments.size();
+            segments.push_back(*merged);
+        }
+    }
+    if (merged_at != SIZE_MAX && !deleted_since.empty()) {
+        Segment& target = segments[merged_at];
+        DocList local;
+        for (DocId global : deleted_since) {
+            if (auto doc = target.find(global)) local.push_back(*doc);
+        }
+        std::sort(local.begin(), local.end());
+        target.num_deleted = local.size();
+        target.deleted = std::make_shared<const Bitmap>(Bitmap::from_sorted(local));
+    }
+    commit(std::move(segments));
+    return true;
+}
+
+bool LiveIndex::stopping() {
+    std::lock_guard lock(thread_mutex_);
+    return stop_;
+}
+
+void LiveIndex::refresh_loop() {
+    std::unique_lock lock(thread_mutex_);
+    while (!wake_.wait_for(lock, options_.refresh_interval, [this] { return stop_; })) {
+        lock.unlock();
+        try {
+            refresh();
+        } catch (const std::exception& e) {
+            std::cerr << "Refresh failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+void LiveIndex::merge_loop() {
+    std::unique_lock lock(thread_mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stop_ || merge_requested_; });
+        if (stop_) return;
+        merge_requested_ = false;
+        lock.unlock();
+        try {
+            while (!stopping() && maybe_merge()) {}
+        } catch (const std::exception& e) {
+            std::cerr << "Merge failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
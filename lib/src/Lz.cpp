@@ -0,0 +1,110 @@
+#include "Lz.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace lz {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+
+uint32_t load32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash(uint32_t v) { return (v * 2654435761u) >> (32 - kHashBits); }
+
+void put_length(std::string& out, size_t len) {
+    for (; len >= 255; len -= 255) out.push_back(static_cast<char>(255));
+    out.push_back(static_cast<char>(len));
+}
+
+void put_sequence(std::string& out, const char* literals, size_t lit_len, size_t offset, size_t match_len) {
+    size_t match_code = match_len ? match_len - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(lit_len, 15) << 4) | std::min<size_t>(match_code, 15));
+    out.push_back(static_cast<char>(token));
+    if (lit_len >= 15) put_length(out, lit_len - 15);
+    out.append(literals, lit_len);
+    if (match_len == 0) return;
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) put_length(out, match_code - 15);
+}
+
+[[noreturn]] void corrupted() { throw std::runtime_error("Corrupted LZ block"); }
+
+size_t get_length(const uint8_t*& p, const uint8_t* end, size_t len) {
+    while (true) {
+        if (p >= end) corrupted();
+        uint8_t byte = *p++;
+        len += byte;
+        if (byte != 255) return len;
+    }
+}
+
+}  // namespace
+
+void compress(const char* in, size_t n, std::string& out) {
+    std::vector<int32_t> table(size_t{1} << kHashBits, -1);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + kMinMatch <= n) {
+        uint32_t seq = load32(in + i);
+        uint32_t h = hash(seq);
+        int32_t cand = table[h];
+        table[h] = static_cast<int32_t>(i);
+        if (cand < 0 || i - cand > kMaxOffset || load32(in + cand) != seq) {
+            ++i;
+            continue;
+        }
+        size_t len = kMinMatch;
+        while (i + len < n && in[cand + len] == in[i + len]) ++len;
+        put_sequence(out, in + anchor, i - anchor, i - cand, len);
+        i += len;
+        anchor = i;
+        // Позиция перед концом совпадения тоже попадает в таблицу.
+        if (i >= 2 && i + 2 <= n) table[hash(load32(in + i - 2))] = static_cast<int32_t>(i - 2);
+    }
+    put_sequence(out, in + anchor, n - anchor, 0, 0);
+}
+
+void decompress(const uint8_t* in, const uint8_t* end, char* out, size_t raw_size) {
+    const uint8_t* p = in;
+    size_t op = 0;
+    while (true) {
+        if (p >= end) corrupted();
+        uint8_t token = *p++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) lit_len = get_length(p, end, lit_len);
+        if (lit_len > static_cast<size_t>(end - p) || lit_len > raw_size - op) corrupted();
+        std::memcpy(out + op, p, lit_len);
+        p += lit_len;
+        op += lit_len;
+        if (op == raw_size) break;
+
+        if (end - p < 2) corrupted();
+        size_t offset = p[0] | (size_t{p[1]} << 8);
+        p += 2;
+        size_t match_len = token & 0x0F;
+        if (match_len == 15) match_len = get_length(p, end, match_len);
+        match_len += kMinMatch;
+        if (offset == 0 || offset > op || match_len > raw_size - op) corrupted();
+        char* dst = out + op;
+        const char* src = dst - offset;
+        if (offset >= match_len) {
+            std::memcpy(dst, src, match_len);
+        } else {
+            for (size_t k = 0; k < match_len; ++k) dst[k] = src[k];
+        }
+        op += match_len;
+    }
+    if (p != end) corrupted();
+}
+
+}  // namespace lz
@@ -0,0 +1,195 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+thread_local QueryTrace* QueryTrace::current_ = nullptr;
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::Cache: return "cache";
+        case Stage::Parse: return "parse";
+        case Stage::Prepare: return "prepare";
+        case Stage::Evaluate: return "evaluate";
+        case Stage::Fetch: return "fetch";
+        case Stage::Serialize: return "serialize";
+        case Stage::Count: break;
+    }
+    return "unknown";
+}
+
+void QueryTrace::mark_parts(std::span<const Part> parts) {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+    last_ = now;
+
+    std::array<uint64_t, kNumStages> weights{};
+    uint64_t total = 0;
+    for (const auto& part : parts) {
+        postings += part.postings;
+        scored += part.scored;
+        for (size_t s = 0; s < kNumStages; ++s) {
+            weights[s] += part.stage_ns[s];
+            total += part.stage_ns[s];
+        }
+    }
+    uint64_t assigned = 0;
+    if (total > 0) {
+        for (size_t s = 0; s < kNumStages; ++s) {
+            uint64_t share = static_cast<uint64_t>(static_cast<double>(elapsed) * weights[s] / total);
+            stage_ns[s] += share;
+            assigned += share;
+        }
+    }
+    // Остаток округления и ожидание без отметок в частях - сопоставление.
+    stage_ns[static_cast<size_t>(Stage::Evaluate)] += elapsed - std::min(assigned, elapsed);
+}
+
+size_t metric_stripe() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % kMetricStripes;
+    return stripe;
+}
+
+uint64_t StripedCounter::value() const {
+    uint64_t total = 0;
+    for (const auto& s : stripes_) total += s.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+size_t LatencyHistogram::bucket(uint64_t ns) {
+    if (ns < kSubBuckets) return ns;
+    int exponent = std::bit_width(ns) - 1;
+    if (exponent > kMaxExponent) return kBuckets - 1;
+    int shift = exponent - kSubBucketBits;
+    return ((shift + 1) << kSubBucketBits) + ((ns >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    int shift = static_cast<int>(bucket >> kSubBucketBits) - 1;
+    uint64_t lower = (kSubBuckets + (bucket & (kSubBuckets - 1))) << shift;
+    return lower + (uint64_t{1} << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    Stripe& s = stripes_[metric_stripe()];
+    s.counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    s.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snap;
+    snap.counts.assign(kBuckets, 0);
+    for (const auto& s : stripes_) {
+        for (size_t b = 0; b < kBuckets; ++b) {
+            uint64_t c = s.counts[b].load(std::memory_order_relaxed);
+            snap.counts[b] += c;
+            snap.count += c;
+        }
+        snap.sum_ns += s.sum_ns.load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+uint64_t LatencyHistogram::Snapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * count);
+    if (rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < counts.size(); ++b) {
+        seen += counts[b];
+        if (seen > rank) return bucket_upper(b);
+    }
+    return bucket_upper(counts.size() - 1);
+}
+
+void QueryMetrics::record(const QueryTrace& trace, uint64_t total_ns) {
+    queries_.add(1);
+    for (size_t s = 0; s < kNumStages; ++s) {
+        if (trace.stage_ns[s] > 0) stages_[s].record(trace.stage_ns[s]);
+    }
+    total_.record(total_ns);
+    postings_.add(trace.postings);
+    scored_.add(trace.scored);
+    results_.add(trace.results);
+}
+
+namespace {
+
+void append(std::string& out, const char* fmt, auto... args) {
+    char line[256];
+    int n = std::snprintf(line, sizeof(line), fmt, args...);
+    if (n > 0) out.append(line, std::min<size_t>(n, sizeof(line) - 1));
+}
+
+// Корзины Prometheus - по степеням двойки от ~1 мкс до ~68 с; счётчики
+// накопительные, как требует формат.
+void append_histogram(std::string& out, const char* name, const std::string& labels,
+                      const LatencyHistogram::Snapshot& snap) {
+    std::string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    size_t b = 0;
+    for (int power = 10; power <= 36; ++power) {
+        uint64_t bound = (uint64_t{1} << power) - 1;
+        while (b < snap.counts.size() && LatencyHistogram::bucket_upper(b) <= bound) cumulative += snap.counts[b++];
+        append(out, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, labels.c_str(), sep.c_str(), (bound + 1) * 1e-9,
+               static_cast<unsigned long long>(cumulative));
+    }
+    append(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels.c_str(), sep.c_str(),
+           static_cast<unsigned long long>(snap.count));
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    append(out, "%s_sum%s %.9f\n", name, braces.c_str(), snap.sum_ns * 1e-9);
+    append(out, "%s_count%s %llu\n", name, braces.c_str(), static_cast<unsigned long long>(snap.count));
+}
+
+void append_quantiles(std::string& out, const std::string& labels, const LatencyHistogram::Snapshot& snap) {
+    std::string sep = labels.empty() ? "" : ",";
+    for (double q : {0.5, 0.9, 0.99}) {
+        append(out, "search_query_duration_quantile_seconds{%s%squantile=\"%g\"} %.9f\n", labels.c_str(), sep.c_str(),
+               q, snap.quantile(q) * 1e-9);
+    }
+}
+
+void append_counter(std::string& out, const char* name, const char* help, uint64_t value) {
+    append(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name,
+           static_cast<unsigned long long>(value));
+}
+
+}  // namespace
+
+std::string QueryMetrics::prometheus() const {
+    std::string out;
+    auto total = total_.snapshot();
+    std::vector<LatencyHistogram::Snapshot> stages;
+    for (const auto& h : stages_) stages.push_back(h.snapshot());
+
+    out += "# HELP search_query_duration_seconds Time to answer /search, including cache hits.\n";
+    out += "# TYPE search_query_duration_seconds histogram\n";
+    append_histogram(out, "search_query_duration_seconds", "", total);
+
+    out += "# HELP search_stage_duration_seconds Time spent in each query stage.\n";
+    out += "# TYPE search_stage_duration_seconds histogram\n";
+    for (size_t s = 0; s < kNumStages; ++s) {
+        append_histogram(out, "search_stage_duration_seconds",
+                         std::string("stage=\"") + stage_name(static_cast<Stage>(s)) + "\"", stages[s]);
+    }
+
+    out += "# HELP search_query_duration_quantile_seconds Latency quantiles estimated from the histograms.\n";
+    out += "# TYPE search_query_duration_quantile_seconds gauge\n";
+    append_quantiles(out, "stage=\"total\"", total);
+    for (size_t s = 0; s < kNumStages; ++s) {
+        append_quantiles(out, std::string("stage=\"") + stage_name(static_cast<Stage>(s)) + "\"", stages[s]);
+    }
+
+    append_counter(out, "search_queries_total", "Queries executed (cache misses).", queries_.value());
+    append_counter(out, "search_queries_cached_total", "Queries answered from the result cache.", cache_hits_.value());
+    append_counter(out, "search_errors_total", "Queries that failed with status 500.", errors_.value());
+    append_counter(out, "search_postings_total",
+                   "Postings in the lists of query terms (for saat - postings actually processed).",
+                   postings_.value());
+    append_counter(out, "search_candidates_scored_total", "Documents whose full score was computed.",
+                   scored_.value());
+    append_counter(out, "search_results_total", "Documents returned in results.", results_.value());
+    return out;
+}
@@ -0,0 +1,111 @@
+#include "Norms.h"
+#include "Encoding.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t kNormsMagic = 0x534D524E;  // "NRMS"
+constexpr uint32_t kNormsVersion = 1;
+
+}  // namespace
+
+namespace norms {
+
+// Байт = 16 * shift + (length >> shift), где length >> shift лежит в [16, 32).
+uint8_t encode(uint32_t length) {
+    if (length < 32) return static_cast<uint8_t>(length);
+    uint32_t shift = std::bit_width(length) - 5;
+    if (shift > 14) return 255;
+    return static_cast<uint8_t>(16 * shift + (length >> shift));
+}
+
+uint32_t decode(uint8_t norm) {
+    if (norm < 32) return norm;
+    uint32_t shift = norm / 16 - 1;
+    return (16u + norm % 16) << shift;
+}
+
+}  // namespace norms
+
+void FieldNorms::set(uint32_t field, DocId doc, uint32_t length) {
+    if (doc >= num_docs_) {
+        num_docs_ = size_t{doc} + 1;
+        for (auto& field_norms : norms_) field_norms.resize(num_docs_, 0);
+    }
+    norms_[field][doc] = norms::encode(length);
+    total_length_[field] += length;
+}
+
+double FieldNorms::avg_length(uint32_t field) const {
+    if (field >= kNumFields || num_docs_ == 0) return 0.0;
+    return static_cast<double>(total_length_[field]) / num_docs_;
+}
+
+void FieldNorms::clear() {
+    for (auto& field_norms : norms_) field_norms.clear();
+    total_length_.fill(0);
+    num_docs_ = 0;
+}
+
+// Раскладка: magic, версия, число полей, число документов (u32); для каждого поля
+// длина имени (u32), имя и сумма длин (u64); затем нормы полей подряд.
+// Поля пишутся по FieldId, при чтении сопоставляются по имени.
+void FieldNorms::save(const std::string& filename) const {
+    std::string head;
+    append_raw<uint32_t>(head, kNormsMagic);
+    append_raw<uint32_t>(head, kNormsVersion);
+    append_raw<uint32_t>(head, kNumFields);
+    append_raw<uint32_t>(head, num_docs_);
+    for (uint32_t f = 0; f < kNumFields; ++f) {
+        append_raw<uint32_t>(head, field_name(f).size());
+        head += field_name(f);
+        append_raw<uint64_t>(head, total_length_[f]);
+    }
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(head.data(), head.size());
+    for (const auto& field_norms : norms_) {
+        out.write(reinterpret_cast<const char*>(field_norms.data()), field_norms.size());
+    }
+    if (!out) throw std::runtime_error("Failed to write " + filename);
+}
+
+bool FieldNorms::load(const std::string& filename) {
+    clear();
+    if (!std::ifstream(filename).is_open()) return false;
+
+    MappedFile file(filename);
+    const uint8_t* p = file.data();
+    const uint8_t* end = p + file.size();
+    auto need = [&](size_t bytes) {
+        if (static_cast<size_t>(end - p) < bytes) throw std::runtime_error("Corrupted norms file " + filename);
+    };
+    need(16);
+    if (load_raw<uint32_t>(p) != kNormsMagic) throw std::runtime_error("Invalid norms header");
+    if (load_raw<uint32_t>(p + 4) != kNormsVersion) throw std::runtime_error("Unsupported norms version");
+    uint32_t num_fields = load_raw<uint32_t>(p + 8);
+    num_docs_ = load_raw<uint32_t>(p + 12);
+    p += 16;
+    // Поля, которых нет в FieldId, пропускаются; отсутствующие в файле остаются нулевыми.
+    std::vector<uint32_t> ids;
+    for (uint32_t f = 0; f < num_fields; ++f) {
+        need(4);
+        uint32_t len = load_raw<uint32_t>(p);
+        p += 4;
+        need(len + 8);
+        ids.push_back(field_id({reinterpret_cast<const char*>(p), len}));
+        if (ids.back() != kNoField) total_length_[ids.back()] = load_raw<uint64_t>(p + len);
+        p += len + 8;
+    }
+    for (auto& field_norms : norms_) field_norms.assign(num_docs_, 0);
+    for (uint32_t id : ids) {
+        need(num_docs_);
+        if (id != kNoField) norms_[id].assign(p, p + num_docs_);
+        p += num_docs_;
+    }
+    return true;
+}
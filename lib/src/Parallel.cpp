@@ -0,0 +1,88 @@
+#include "Parallel.h"
+#include <atomic>
+
+// Задачи одного run: потоки разбирают номера через next, последний
+// завершивший будит вызывающего.
+struct ThreadPool::Batch {
+    const std::function<void(size_t)>* fn;
+    size_t n;
+    std::atomic<size_t> next{0};
+    std::vector<std::exception_ptr> errors;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t finished = 0;  // под mutex
+
+    Batch(const std::function<void(size_t)>& f, size_t count) : fn(&f), n(count), errors(count) {}
+
+    bool exhausted() const { return next.load(std::memory_order_relaxed) >= n; }
+
+    void work() {
+        for (size_t i; (i = next.fetch_add(1)) < n;) {
+            try {
+                (*fn)(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+            std::lock_guard lock(mutex);
+            if (++finished == n) done.notify_all();
+        }
+    }
+};
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) workers_.emplace_back([this] { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_) w.join();
+}
+
+void ThreadPool::run(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) return;
+    if (n == 1 || workers_.empty()) {
+        for (size_t i = 0; i < n; ++i) fn(i);
+        return;
+    }
+    auto batch = std::make_shared<Batch>(fn, n);
+    {
+        std::lock_guard lock(mutex_);
+        queue_.push_back(batch);
+    }
+    if (n - 1 >= workers_.size()) {
+        wake_.notify_all();
+    } else {
+        for (size_t i = 0; i + 1 < n; ++i) wake_.notify_one();
+    }
+    batch->work();
+    {
+        std::unique_lock lock(batch->mutex);
+        batch->done.wait(lock, [&] { return batch->finished == n; });
+    }
+    for (auto& e : batch->errors) {
+        if (e) std::rethrow_exception(e);
+    }
+}
+
+void ThreadPool::worker_loop() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (stop_) return;
+        // Разобранные до конца пачки снимаются с очереди; пачку с оставшимися
+        // задачами могут взять и другие потоки.
+        auto batch = queue_.front();
+        if (batch->exhausted()) {
+            queue_.pop_front();
+            continue;
+        }
+        lock.unlock();
+        batch->work();
+        lock.lock();
+    }
+}
@@ -0,0 +1,282 @@
+#include "QueryPlan.h"
+#include "SearchEngine.h"
+#include <algorithm>
+#include <sstream>
+#include <stack>
+
+namespace {
+
+const char* op_name(const PlanNode& node) {
+    switch (node.op) {
+        case PlanNode::Op::Term: return "TERM";
+        case PlanNode::Op::And: return "AND";
+        case PlanNode::Op::Or: return "OR";
+        case PlanNode::Op::Not: return "NOT";
+        case PlanNode::Op::AndNot: return "AND_NOT";
+        case PlanNode::Op::Prox: return node.prox.c_str();
+        case PlanNode::Op::Empty: return "EMPTY";
+    }
+    return "?";
+}
+
+void describe(const PlanNode& node, size_t depth, std::ostringstream& out) {
+    out << std::string(depth * 2, ' ') << op_name(node);
+    if (node.op == PlanNode::Op::Term) out << ' ' << (node.field ? *node.field + ":" : "") << node.term;
+    out << "  est=" << node.estimate << " actual=";
+    if (node.actual) out << *node.actual;
+    else out << '-';
+    out << '\n';
+    for (const auto& child : node.children) describe(*child, depth + 1, out);
+}
+
+}  // namespace
+
+std::string describe_plan(const PlanNode& node) {
+    std::ostringstream out;
+    describe(node, 0, out);
+    return out.str();
+}
+
+std::string plan_key(const PlanNode& node) {
+    if (node.op == PlanNode::Op::Term) return (node.field ? *node.field + ":" : "") + node.term;
+    std::string key = "(";
+    key += op_name(node);
+    for (const auto& child : node.children) key += ' ' + plan_key(*child);
+    return key + ')';
+}
+
+// RPN -> дерево. Некорректный запрос (оператору не хватает операндов) даёт nullptr;
+// если на стеке осталось несколько деревьев, берётся верхнее.
+std::unique_ptr<PlanNode> SearchEngine::build_plan(const Tokens& rpn, TermLookup& lookup) const {
+    std::stack<std::unique_ptr<PlanNode>> nodes;
+    for (const auto& token : rpn) {
+        if (!is_operator(token)) {
+            auto q_term = parse_query_token(token);
+            auto node = PlanNode::make(q_term.term.empty() ? PlanNode::Op::Empty : PlanNode::Op::Term);
+            node->term = q_term.term;
+            node->field = q_term.field;
+            if (!q_term.term.empty()) node->term_id = lookup(q_term.term);
+            if (q_term.field) node->field_id = field_id(*q_term.field);
+            nodes.push(std::move(node));
+            continue;
+        }
+        if (token == "NOT") {
+            if (nodes.empty()) return nullptr;
+            auto node = PlanNode::make(PlanNode::Op::Not);
+            node->children.push_back(std::move(nodes.top()));
+            nodes.pop();
+            nodes.push(std::move(node));
+            continue;
+        }
+        if (nodes.size() < 2) return nullptr;
+        auto right = std::move(nodes.top());
+        nodes.pop();
+        auto left = std::move(nodes.top());
+        nodes.pop();
+
+        std::unique_ptr<PlanNode> node;
+        if (token == "AND") {
+            node = PlanNode::make(PlanNode::Op::And);
+        } else if (token == "OR") {
+            node = PlanNode::make(PlanNode::Op::Or);
+        } else if (left->op == PlanNode::Op::Term && right->op == PlanNode::Op::Term) {
+            node = PlanNode::make(PlanNode::Op::Prox);
+            node->prox = token;
+        } else {
+            // NEAR/ADJ между подвыражениями вырождается в пересечение.
+            node = PlanNode::make(PlanNode::Op::And);
+        }
+        node->children.push_back(std::move(left));
+        node->children.push_back(std::move(right));
+        nodes.push(std::move(node));
+    }
+    if (nodes.empty()) return nullptr;
+    return std::move(nodes.top());
+}
+
+std::unique_ptr<PlanNode> SearchEngine::optimize(std::unique_ptr<PlanNode> node) const {
+    size_t universe = index_.get_forward_index().size();
+    switch (node->op) {
+        case PlanNode::Op::Empty:
+            node->estimate = 0;
+            return node;
+
+        case PlanNode::Op::Term: {
+            // Без поля термин — объединение полей; поля считаются независимыми.
+            double missing = 1.0;
+            size_t df = 0;
+            if (node->term_id != kNoTerm) {
+                const FieldPostings& fields = index_.postings(node->term_id);
+                for (uint32_t f = 0; f < kNumFields; ++f) {
+                    if (!node->has_field(f)) continue;
+                    df += fields[f].docs.size();
+                    if (universe > 0) missing *= 1.0 - std::min<double>(fields[f].docs.size(), universe) / universe;
+                }
+            }
+            if (df == 0) return PlanNode::make(PlanNode::Op::Empty);
+            node->estimate = std::max<size_t>(1, static_cast<size_t>(universe * (1.0 - missing)));
+            return node;
+        }
+
+        case PlanNode::Op::Not: {
+            auto child = optimize(std::move(node->children[0]));
+            if (child->op == PlanNode::Op::Not) return std::move(child->children[0]);
+            node->estimate = universe - std::min(child->estimate, universe);
+            node->children[0] = std::move(child);
+            return node;
+        }
+
+        case PlanNode::Op::Prox: {
+            for (auto& child : node->children) {
+                child = optimize(std::move(child));
+                if (child->op == PlanNode::Op::Empty) return PlanNode::make(PlanNode::Op::Empty);
+            }
+            node->estimate = std::min(node->children[0]->estimate, node->children[1]->estimate);
+            return node;
+        }
+
+        case PlanNode::Op::And:
+        case PlanNode::Op::Or: {
+            // Ассоциативные цепочки сливаются в один n-арный узел.
+            std::vector<std::unique_ptr<PlanNode>> children;
+            for (auto& child : node->children) {
+                child = optimize(std::move(child));
+                if (child->op == node->op) {
+                    for (auto& grandchild : child->children) children.push_back(std::move(grandchild));
+                } else {
+                    children.push_back(std::move(child));
+                }
+            }
+            return node->op == PlanNode::Op::And ? finish_and(std::move(children)) : finish_or(std::move(children));
+        }
+
+        case PlanNode::Op::AndNot:
+            return node;
+    }
+    return node;
+}
+
+// Дети уже оптимизированы и не являются AND.
+std::unique_ptr<PlanNode> SearchEngine::finish_and(std::vector<std::unique_ptr<PlanNode>> children) const {
+    double universe = index_.get_forward_index().size();
+    std::vector<std::unique_ptr<PlanNode>> positive;
+    std::vector<std::unique_ptr<PlanNode>> excluded;
+    auto add_positive = [&](std::unique_ptr<PlanNode> child) {
+        if (child->op != PlanNode::Op::And) {
+            positive.push_back(std::move(child));
+            return;
+        }
+        for (auto& grandchild : child->children) positive.push_back(std::move(grandchild));
+    };
+    for (auto& child : children) {
+        if (child->op == PlanNode::Op::Empty) return PlanNode::make(PlanNode::Op::Empty);
+        if (child->op == PlanNode::Op::AndNot) {
+            // Вложенный AND_NOT раскрывается, чтобы все операнды сортировались вместе.
+            add_positive(std::move(child->children[0]));
+            for (size_t i = 1; i < child->children.size(); ++i) excluded.push_back(std::move(child->children[i]));
+        } else if (child->op == PlanNode::Op::Not) {
+            auto& operand = child->children[0];
+            if (operand->op != PlanNode::Op::Empty) excluded.push_back(std::move(operand));
+        } else {
+            add_positive(std::move(child));
+        }
+    }
+
+    // Только отрицания: NOT a AND NOT b = NOT (a OR b), дополнение не раскрывается.
+    if (positive.empty()) {
+        auto node = PlanNode::make(PlanNode::Op::Not);
+        node->children.push_back(finish_or(std::move(excluded)));
+        node->estimate = universe - std::min<double>(node->children[0]->estimate, universe);
+        return node;
+    }
+
+    // Самые редкие операнды первыми: промежуточный результат не больше первого из них.
+    std::stable_sort(positive.begin(), positive.end(),
+                     [](const auto& a, const auto& b) { return a->estimate < b->estimate; });
+    std::unique_ptr<PlanNode> include;
+    if (positive.size() == 1) {
+        include = std::move(positive[0]);
+    } else {
+        include = PlanNode::make(PlanNode::Op::And);
+        double estimate = universe;
+        for (const auto& child : positive) estimate *= universe > 0 ? child->estimate / universe : 0.0;
+        include->estimate = static_cast<size_t>(estimate);
+        include->children = std::move(positive);
+    }
+    if (excluded.empty()) return include;
+
+    auto node = PlanNode::make(PlanNode::Op::AndNot);
+    double estimate = include->estimate;
+    for (const auto& child : excluded) estimate *= universe > 0 ? 1.0 - child->estimate / universe : 0.0;
+    node->estimate = static_cast<size_t>(estimate);
+    node->children.push_back(std::move(include));
+    for (auto& child : excluded) node->children.push_back(std::move(child));
+    return node;
+}
+
+// Дети уже оптимизированы и не являются OR.
+std::unique_ptr<PlanNode> SearchEngine::finish_or(std::vector<std::unique_ptr<PlanNode>> children) const {
+    size_t universe = index_.get_forward_index().size();
+    std::erase_if(children, [](const auto& child) { return child->op == PlanNode::Op::Empty; });
+    if (children.empty()) return PlanNode::make(PlanNode::Op::Empty);
+    if (children.size() == 1) return std::move(children[0]);
+
+    std::stable_sort(children.begin(), children.end(),
+                     [](const auto& a, const auto& b) { return a->estimate < b->estimate; });
+    auto node = PlanNode::make(PlanNode::Op::Or);
+    size_t estimate = 0;
+    for (const auto& child : children) estimate += child->estimate;
+    node->estimate = std::min(estimate, universe);
+    node->children = std::move(children);
+    return node;
+}
+
+DocSet SearchEngine::execute(PlanNode& node) const {
+    size_t universe = index_.get_forward_index().size();
+    DocSet result;
+    switch (node.op) {
+        case PlanNode::Op::Empty:
+            result = DocSet::from_list({}, universe);
+            break;
+
+        case PlanNode::Op::Term:
+            result = get_doc_set(node);
+            break;
+
+        case PlanNode::Op::Not:
+            result = execute(*node.children[0]).complement();
+            break;
+
+        case PlanNode::Op::And:
+            // Пустой промежуточный результат останавливает вычисление остальных операндов.
+            result = execute(*node.children[0]);
+            for (size_t i = 1; i < node.children.size() && result.size() > 0; ++i) {
+                result = DocSet::intersect(result, execute(*node.children[i]));
+            }
+            break;
+
+        case PlanNode::Op::Or:
+            result = execute(*node.children[0]);
+            for (size_t i = 1; i < node.children.size(); ++i) {
+                result = DocSet::unite(result, execute(*node.children[i]));
+            }
+            break;
+
+        case PlanNode::Op::AndNot:
+            result = execute(*node.children[0]);
+            for (size_t i = 1; i < node.children.size() && result.size() > 0; ++i) {
+                result = DocSet::intersect(result, execute(*node.children[i]).complement());
+            }
+            break;
+
+        case PlanNode::Op::Prox: {
+            auto& left = *node.children[0];
+            auto& right = *node.children[1];
+            DocSet common = DocSet::intersect(execute(left), execute(right));
+            result = DocSet::from_list(execute_prox(node.prox, left, right, common.to_list()), universe);
+            break;
+        }
+    }
+    node.actual = result.size();
+    return result;
+}
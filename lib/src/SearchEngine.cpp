@@ -1,5 +1,9 @@
 #include "SearchEngine.h"
-#include "Ranker.h"
+#include "Daat.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Wand.h"
+#include <atomic>
 #include <stack>
 #include <stdexcept>
 #include <algorithm>
@@ -7,6 +11,7 @@
 #include <sstream>
 #include <cmath>
 #include <map>
+#include <unordered_map>
 #include <iostream>
 #include <cctype>
 
@@ -18,10 +23,240 @@ std::string to_upper_str(std::string s) {
 }
 
 DocList SearchEngine::search(const std::string& query_str, double k1, double b, double w_title) const {
-    if (query_str.empty()) return {};
+    DocList ids;
+    for (const auto& hit : search_top_k(query_str, SIZE_MAX, 0, k1, b, w_title)) ids.push_back(hit.id);
+    return ids;
+}
+
+namespace {
+
+// Для метрик: сколько postings в списках терминов запроса.
+void trace_postings(const Ranker::PreparedQuery& prepared) {
+    if (!QueryTrace::current()) return;
+    uint64_t total = 0;
+    for (const auto& term : prepared) {
+        for (const auto& field : term.fields) total += field.postings->docs.size();
+    }
+    QueryTrace::add_postings(total);
+}
+
+}  // namespace
+
+TermId SearchEngine::TermLookup::operator()(const Term& term) {
+    for (const auto& [known, id] : resolved_) {
+        if (known == term) return id;
+    }
+    if (shared_) {
+        if (auto it = shared_->find(term); it != shared_->end()) return it->second;
+    }
+    TermId id = index_.term_id(term);
+    resolved_.emplace_back(term, id);
+    return id;
+}
+
+std::vector<TermId> SearchEngine::TermLookup::operator()(const Tokens& terms) {
+    std::vector<TermId> ids;
+    ids.reserve(terms.size());
+    for (const auto& term : terms) ids.push_back((*this)(term));
+    return ids;
+}
+
+ScoredDocs SearchEngine::search_top_k(const std::string& query_str, size_t k, size_t offset,
+                                      double k1, double b, double w_title) const {
+    TermLookup lookup(index_);
+    auto root = plan(query_str, lookup);
+    QueryTrace::mark(Stage::Parse);
+    if (!root || k == 0) return {};
+
+    Ranker ranker(index_, k1, b, w_title, collection_stats_);
+    auto terms = scoring_terms(query_str);
+    auto prepared = ranker.prepare(terms, lookup(terms));
+    trace_postings(prepared);
+    QueryTrace::mark(Stage::Prepare);
+    return search_plan(*root, ranker, prepared, k, offset);
+}
+
+ScoredDocs SearchEngine::search_plan(PlanNode& root, const Ranker& ranker, const Ranker::PreparedQuery& prepared,
+                                     size_t k, size_t offset) const {
+    // Сопоставление и BM25 за один проход курсоров; в куче только k + offset лучших.
+    DaatEvaluator::CachedSet cached_set;
+    if (conjunction_cache_) cached_set = [this](PlanNode& node) { return cached_conjunction(node); };
+    DaatEvaluator daat(index_, ranker, [this](PlanNode& node) { return execute(node); }, std::move(cached_set),
+                       deleted_);
+    auto hits = daat.search(root, prepared, k, offset);
+    QueryTrace::mark(Stage::Evaluate);
+    return hits;
+}
+
+std::vector<ScoredDocs> SearchEngine::search_batch(const std::vector<BatchQuery>& queries,
+                                                   double k1, double b, double w_title, size_t num_threads) const {
+    std::vector<ScoredDocs> results(queries.size());
+    if (queries.empty()) return results;
+    if (num_threads == 0) num_threads = thread_pool_ ? thread_pool_->size() + 1 : default_num_threads();
+    num_threads = std::min(num_threads, queries.size());
+
+    // Одинаковые запросы (с точностью до нормализации) выполняются один раз.
+    std::vector<size_t> unique;
+    std::vector<size_t> same_as(queries.size());
+    std::unordered_map<std::string, size_t> seen;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        std::string key = normalize_query(queries[i].query) + '|' + std::to_string(queries[i].k) + '|' +
+                          std::to_string(queries[i].offset);
+        auto [it, inserted] = seen.emplace(std::move(key), i);
+        same_as[i] = it->second;
+        if (inserted) unique.push_back(i);
+    }
+
+    // Термины всей пачки: словарь, распаковка postings и idf - по разу на термин,
+    // в тех же потоках, что потом выполняют запросы.
+    Ranker ranker(index_, k1, b, w_title, collection_stats_);
+    std::vector<Tokens> query_terms(queries.size());
+    std::unordered_map<Term, size_t> term_ids;
+    Tokens terms;
+    for (size_t i : unique) {
+        query_terms[i] = scoring_terms(queries[i].query);
+        for (const auto& term : query_terms[i]) {
+            if (term_ids.emplace(term, terms.size()).second) terms.push_back(term);
+        }
+    }
+    std::vector<Ranker::PreparedQuery> prepared_terms(terms.size());
+    std::vector<TermId> ids(terms.size());
+    std::atomic<size_t> next_term{0};
+    run_workers(std::min(num_threads, std::max<size_t>(1, terms.size())), [&](size_t) {
+        for (size_t t; (t = next_term.fetch_add(1)) < terms.size();) {
+            ids[t] = index_.term_id(terms[t]);
+            prepared_terms[t] = ranker.prepare({terms[t]}, {ids[t]});
+        }
+    });
+    // План запроса ищет те же термины - берёт TermId отсюда, не из словаря.
+    std::unordered_map<Term, TermId> resolved;
+    for (size_t t = 0; t < terms.size(); ++t) resolved.emplace(terms[t], ids[t]);
+
+    // Запросы раздаются потокам по одному: длинные не задерживают остальные.
+    std::atomic<size_t> next_query{0};
+    run_workers(std::min(num_threads, unique.size()), [&](size_t) {
+        for (size_t u; (u = next_query.fetch_add(1)) < unique.size();) {
+            size_t i = unique[u];
+            TermLookup lookup(index_, &resolved);
+            auto root = plan(queries[i].query, lookup);
+            if (!root || queries[i].k == 0) continue;
+            Ranker::PreparedQuery prepared;
+            for (const auto& term : query_terms[i]) {
+                const auto& pt = prepared_terms[term_ids.at(term)];
+                prepared.insert(prepared.end(), pt.begin(), pt.end());
+            }
+            results[i] = search_plan(*root, ranker, prepared, queries[i].k, queries[i].offset);
+        }
+    });
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (same_as[i] != i) results[i] = results[same_as[i]];
+    }
+    return results;
+}
+
+ScoredDocs SearchEngine::search_ranked_or(const std::string& query_str, size_t k, size_t offset,
+                                          double k1, double b, double w_title) const {
     auto tokens = tokenize_query(query_str);
-    if (tokens.empty()) return {};
-    
+    Tokens terms;
+    for (const auto& t : tokens) {
+        if (!is_term_like(t)) return search_top_k(query_str, k, offset, k1, b, w_title);
+        auto qt = parse_query_token(t);
+        if (!qt.term.empty()) terms.push_back(qt.term);
+    }
+    QueryTrace::mark(Stage::Parse);
+    if (terms.empty() || k == 0) return {};
+
+    if (!BlockMaxWand::supports(k1, b, w_title)) {
+        std::string disjunction;
+        for (const auto& t : terms) disjunction += (disjunction.empty() ? "" : " OR ") + t;
+        return search_top_k(disjunction, k, offset, k1, b, w_title);
+    }
+    Ranker ranker(index_, k1, b, w_title, collection_stats_);
+    auto prepared = ranker.prepare(terms);
+    trace_postings(prepared);
+    QueryTrace::mark(Stage::Prepare);
+    BlockMaxWand wand(index_, ranker, deleted_);
+    auto hits = wand.search(prepared, k, offset);
+    QueryTrace::mark(Stage::Evaluate);
+    return hits;
+}
+
+ScoredDocs SearchEngine::search_impacts(const std::string& query_str, size_t k, size_t offset,
+                                        double k1, double b, double w_title, size_t postings_budget) const {
+    // Вклады посчитаны по статистике самого индекса и не знают об удалённых документах.
+    const ImpactReader* impacts = index_.impacts();
+    if (!impacts || !impacts->matches(k1, b, w_title) || collection_stats_ || deleted_) {
+        return search_ranked_or(query_str, k, offset, k1, b, w_title);
+    }
+
+    Tokens terms;
+    for (const auto& t : tokenize_query(query_str)) {
+        if (!is_term_like(t)) return search_ranked_or(query_str, k, offset, k1, b, w_title);
+        auto qt = parse_query_token(t);
+        if (qt.field) return search_ranked_or(query_str, k, offset, k1, b, w_title);
+        if (!qt.term.empty()) terms.push_back(qt.term);
+    }
+    QueryTrace::mark(Stage::Parse);
+    if (terms.empty() || k == 0) return {};
+    auto hits = ScoreAtATime(*impacts).search(terms, k, offset, postings_budget);
+    QueryTrace::mark(Stage::Evaluate);
+    return hits;
+}
+
+std::shared_ptr<const DocList> SearchEngine::cached_conjunction(PlanNode& node) const {
+    std::string key = conjunction_key_prefix_ + plan_key(node);
+    if (auto docs = conjunction_cache_->get(key)) return *docs;
+    auto docs = std::make_shared<const DocList>(execute(node).to_list());
+    conjunction_cache_->put(key, docs, docs->size() * sizeof(DocId) + sizeof(DocList));
+    return docs;
+}
+
+void SearchEngine::run_workers(size_t n, const std::function<void(size_t)>& fn) const {
+    if (thread_pool_) {
+        thread_pool_->run(n, fn);
+    } else {
+        run_parallel(n, fn);
+    }
+}
+
+std::string SearchEngine::normalize_query(const std::string& query_str) const {
+    std::string normalized;
+    auto tokens = tokenize_query(query_str);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        std::string token = tokens[i];
+        if (i + 1 < tokens.size() && tokens[i + 1] == ":") {
+            token += ":" + (i + 2 < tokens.size() ? tokens[i + 2] : "");
+            i += 2;
+        }
+        if (!normalized.empty()) normalized += ' ';
+        if (is_operator(token)) {
+            normalized += to_upper_str(token);
+        } else if (is_term_like(token)) {
+            auto qt = parse_query_token(token);
+            // Термин из одних стоп-слов пуст, но не безразличен для выдачи (AND с
+            // ним пуст), поэтому в нормальной форме остаётся "∅" - токенизатор
+            // такого термина не выдаёт.
+            normalized += (qt.field ? *qt.field + ":" : "") + (qt.term.empty() ? "∅" : qt.term);
+        } else {
+            normalized += token;
+        }
+    }
+    return normalized;
+}
+
+std::string SearchEngine::explain(const std::string& query_str) const {
+    TermLookup lookup(index_);
+    auto root = plan(query_str, lookup);
+    if (!root) return "EMPTY\n";
+    execute(*root);
+    return describe_plan(*root);
+}
+
+std::unique_ptr<PlanNode> SearchEngine::plan(const std::string& query_str, TermLookup& lookup) const {
+    if (query_str.empty()) return nullptr;
+    auto tokens = tokenize_query(query_str);
+    if (tokens.empty()) return nullptr;
+
     Tokens processed;
     for(size_t i = 0; i < tokens.size(); ++i) {
         if (i + 1 < tokens.size() && tokens[i+1] == ":") {
@@ -33,24 +268,20 @@ DocList SearchEngine::search(const std::string& query_str, double k1, double b,
     }
 
     processed = insert_implicit_and(processed);
-    DocList results = evaluate_rpn(to_rpn(processed));
+    auto root = build_plan(to_rpn(processed), lookup);
+    return root ? optimize(std::move(root)) : nullptr;
+}
 
-    if (results.empty()) return {};
-    
-    Tokens scoring_terms;
-    for(const auto& t : tokens) {
+// BM25 считается по всем терминам запроса без учёта полей и операторов.
+Tokens SearchEngine::scoring_terms(const std::string& query_str) const {
+    Tokens terms;
+    for(const auto& t : tokenize_query(query_str)) {
         if (is_term_like(t)) {
             auto qt = parse_query_token(t);
-            if (!qt.term.empty()) scoring_terms.push_back(qt.term);
+            if (!qt.term.empty()) terms.push_back(qt.term);
         }
     }
-
-    Ranker ranker(index_);
-    std::sort(results.begin(), results.end(), [&](DocId a, DocId b) {
-        return ranker.score(a, scoring_terms, k1, b, w_title) > ranker.score(b, scoring_terms, k1, b, w_title);
-    });
-    
-    return results;
+    return terms;
 }
 
 Tokens SearchEngine::tokenize_query(const std::string& s) const {
@@ -113,60 +344,6 @@ Tokens SearchEngine::to_rpn(const Tokens& tokens) const {
     return rpn;
 }
 
-struct StackItem {
-    DocList calculated; 
-    const PostingsList* raw = nullptr;
-    std::optional<SearchEngine::QueryTerm> origin_term = std::nullopt;
-    const DocList& get_vector() const { return raw ? raw->docs : calculated; }
-};
-
-DocList SearchEngine::evaluate_rpn(const Tokens& rpn) const {
-    std::stack<StackItem> eval_stack;
-    for (const auto& token : rpn) {
-        if (is_operator(token)) {
-            if (token == "NOT") {
-                if(eval_stack.empty()) return {};
-                auto op = eval_stack.top(); eval_stack.pop();
-                eval_stack.push({execute_not(op.get_vector()), nullptr, std::nullopt});
-            } else {
-                if(eval_stack.size() < 2) return {};
-                auto right = eval_stack.top(); eval_stack.pop();
-                auto left = eval_stack.top(); eval_stack.pop();
-
-                if (token == "AND") {
-                    DocList res;
-                    if (left.raw && right.raw) res = execute_intersect(left.raw, right.raw);
-                    else if (left.raw) res = execute_intersect_vec(right.calculated, left.raw);
-                    else if (right.raw) res = execute_intersect_vec(left.calculated, right.raw);
-                    else res = execute_intersect_vec_vec(left.get_vector(), right.get_vector());
-                    eval_stack.push({std::move(res), nullptr, std::nullopt});
-                } else if (token == "OR") {
-                    eval_stack.push({execute_union(left.get_vector(), right.get_vector()), nullptr, std::nullopt});
-                } else if (token.find("NEAR") == 0 || token.find("ADJ") == 0) {
-                    DocList res;
-                    if (left.origin_term && right.origin_term) {
-                        res = execute_prox(token, *left.origin_term, *right.origin_term, left.get_vector(), right.get_vector());
-                    } else {
-                        res = execute_intersect_vec_vec(left.get_vector(), right.get_vector());
-                    }
-                    eval_stack.push({std::move(res), nullptr, std::nullopt});
-                }
-            }
-        } else {
-            auto q_term = parse_query_token(token);
-            if (!q_term.term.empty()) {
-                const PostingsList* pl = get_postings(q_term);
-                if (pl && q_term.field) eval_stack.push({{}, pl, q_term});
-                else eval_stack.push({get_doc_ids(q_term), nullptr, q_term});
-            } else {
-                eval_stack.push({{}, nullptr, std::nullopt});
-            }
-        }
-    }
-    if (eval_stack.empty()) return {};
-    return eval_stack.top().get_vector();
-}
-
 SearchEngine::QueryTerm SearchEngine::parse_query_token(const std::string& token) const {
     std::string term = token;
     std::optional<std::string> field;
@@ -175,73 +352,53 @@ SearchEngine::QueryTerm SearchEngine::parse_query_token(const std::string& token
         field = token.substr(0, pos);
         term = token.substr(pos + 1);
     }
-    auto toks = tokenizer_.tokenize(term);
-    return {toks.empty() ? "" : toks[0], field};
-}
-
-const PostingsList* SearchEngine::get_postings(const QueryTerm& q_term) const {
-    const auto& idx = index_.get_inverted_index();
-    auto it = idx.find(q_term.term);
-    if (it == idx.end()) return nullptr;
-    if (q_term.field) {
-        auto fit = it->second.find(*q_term.field);
-        return (fit != it->second.end()) ? &fit->second : nullptr;
-    }
-    return nullptr;
+    Term first;
+    bool found = false;
+    tokenizer_.for_each_token(term, [&](std::string_view token) {
+        if (!found) first = token;
+        found = true;
+    });
+    return {first, field};
 }
 
-std::vector<uint32_t> SearchEngine::get_doc_ids(const QueryTerm& q_term) const {
-    const auto& inv_index = index_.get_inverted_index();
-    auto term_it = inv_index.find(q_term.term);
-    if (term_it == inv_index.end()) return {};
-    if (q_term.field) {
-        auto field_it = term_it->second.find(*q_term.field);
-        if (field_it != term_it->second.end()) return field_it->second.docs;
-    } else {
-        DocList result;
-        for (const auto& [field, postings] : term_it->second) {
-            DocList temp;
-            temp.reserve(result.size() + postings.docs.size());
-            std::set_union(result.begin(), result.end(), 
-                           postings.docs.begin(), postings.docs.end(), 
-                           std::back_inserter(temp));
-            result = std::move(temp);
-        }
+DocSet SearchEngine::get_doc_set(const PlanNode& term_node) const {
+    size_t universe = index_.get_forward_index().size();
+    DocSet result = DocSet::from_list({}, universe);
+    if (term_node.term_id == kNoTerm) return result;
+    const FieldPostings& fields = index_.postings(term_node.term_id);
+    if (term_node.field) {
+        if (term_node.field_id != kNoField) result = DocSet::from_postings(fields[term_node.field_id], universe);
         return result;
     }
-    return {};
+    bool first = true;
+    for (const auto& postings : fields) {
+        DocSet field_set = DocSet::from_postings(postings, universe);
+        result = first ? std::move(field_set) : DocSet::unite(result, field_set);
+        first = false;
+    }
+    return result;
 }
 
-DocList SearchEngine::execute_prox(const std::string& op_token, const QueryTerm& left_term, const QueryTerm& right_term, const DocList& l_docs, const DocList& r_docs) const {
+DocList SearchEngine::execute_prox(const std::string& op_token, const PlanNode& left_term, const PlanNode& right_term, const DocList& common_docs) const {
     size_t slash = op_token.find('/');
     int dist = 1;
     if (slash != std::string::npos) try { dist = std::stoi(op_token.substr(slash + 1)); } catch(...) {}
     bool ordered = (op_token.find("ADJ") == 0);
 
-    const auto& idx = index_.get_inverted_index();
-    if (!idx.count(left_term.term) || !idx.count(right_term.term)) return {};
-
-    const auto& l_fields = idx.at(left_term.term);
-    const auto& r_fields = idx.at(right_term.term);
+    if (left_term.term_id == kNoTerm || right_term.term_id == kNoTerm) return {};
+    const auto& l_fields = index_.postings(left_term.term_id);
+    const auto& r_fields = index_.postings(right_term.term_id);
 
     DocList result;
-    DocList common_docs = execute_intersect_vec_vec(l_docs, r_docs);
 
     for (DocId doc_id : common_docs) {
         bool match = false;
-        std::vector<std::string> fields = {"title", "plot"};
-        if (left_term.field) fields = {*left_term.field};
-
-        for (const auto& field : fields) {
+        for (uint32_t field = 0; field < kNumFields; ++field) {
             if (match) break;
-            if (right_term.field && *right_term.field != field) continue;
+            if (!left_term.has_field(field) || !right_term.has_field(field)) continue;
 
-            auto l_map_it = l_fields.find(field);
-            auto r_map_it = r_fields.find(field);
-            if (l_map_it == l_fields.end() || r_map_it == r_fields.end()) continue;
-
-            auto& pl_l = l_map_it->second;
-            auto& pl_r = r_map_it->second;
+            auto& pl_l = l_fields[field];
+            auto& pl_r = r_fields[field];
 
             auto it_l = std::lower_bound(pl_l.docs.begin(), pl_l.docs.end(), doc_id);
             auto it_r = std::lower_bound(pl_r.docs.begin(), pl_r.docs.end(), doc_id);
@@ -252,10 +409,10 @@ DocList SearchEngine::execute_prox(const std::string& op_token, const QueryTerm&
             size_t idx_l = std::distance(pl_l.docs.begin(), it_l);
             size_t idx_r = std::distance(pl_r.docs.begin(), it_r);
 
-            if (idx_l >= pl_l.positions.size() || idx_r >= pl_r.positions.size()) continue;
+            if (idx_l >= pl_l.tfs.size() || idx_r >= pl_r.tfs.size()) continue;
 
-            const auto& pos_l = pl_l.positions[idx_l];
-            const auto& pos_r = pl_r.positions[idx_r];
+            auto pos_l = pl_l.positions_of(idx_l);
+            auto pos_r = pl_r.positions_of(idx_r);
 
             auto pl = pos_l.begin();
             auto pr = pos_r.begin();
@@ -277,54 +434,6 @@ DocList SearchEngine::execute_prox(const std::string& op_token, const QueryTerm&
     return result;
 }
 
-DocList SearchEngine::execute_intersect(const PostingsList* p1, const PostingsList* p2) const {
-    if (!p1 || !p2) return {};
-    DocList result;
-    if (p1->docs.size() > p2->docs.size()) std::swap(p1, p2);
-    const auto& small = p1->docs;
-    const auto& large = p2->docs;
-    const auto& skips = p2->skips;
-    size_t step = p2->skip_step;
-    size_t i = 0, j = 0;
-    while (i < small.size() && j < large.size()) {
-        if (small[i] == large[j]) {
-            result.push_back(small[i]); i++; j++;
-        } else if (small[i] < large[j]) {
-            i++;
-        } else {
-            if (step > 0 && !skips.empty()) {
-                size_t skip_idx = j / step;
-                while (skip_idx < skips.size() && large[skips[skip_idx]] <= small[i]) {
-                    j = skips[skip_idx]; skip_idx++;
-                }
-            }
-            while (j < large.size() && large[j] < small[i]) j++;
-        }
-    }
-    return result;
-}
-DocList SearchEngine::execute_intersect_vec(const DocList& small, const PostingsList* large) const {
-    if (!large) return {};
-    return execute_intersect_vec_vec(small, large->docs);
-}
-DocList SearchEngine::execute_intersect_vec_vec(const DocList& l1, const DocList& l2) const {
-    DocList result;
-    std::set_intersection(l1.begin(), l1.end(), l2.begin(), l2.end(), std::back_inserter(result));
-    return result;
-}
-DocList SearchEngine::execute_union(const DocList& a, const DocList& b) const {
-    DocList result;
-    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
-    return result;
-}
-DocList SearchEngine::execute_not(const DocList& operand) const {
-    DocList result;
-    size_t total = index_.get_forward_index().size();
-    for (DocId id = 0; id < total; ++id) {
-        if (!std::binary_search(operand.begin(), operand.end(), id)) result.push_back(id);
-    }
-    return result;
-}
 bool SearchEngine::is_operator(const std::string& token) {
     std::string up = to_upper_str(token);
     return up == "AND" || up == "OR" || up == "NOT" || up.find("NEAR") == 0 || up.find("ADJ") == 0;
@@ -0,0 +1,293 @@
+#include "Segment.h"
+#include "Encoding.h"
+#include "BlockCodec.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+constexpr uint32_t kSegmentMagic = 0x4D474553;  // "SEGM"
+constexpr uint32_t kSegmentVersion = 3;
+constexpr uint32_t kMinSegmentVersion = 2;
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kEntryHeaderSize = 16;  // u64 смещение строки, u32 длина, u32 df
+constexpr size_t kFieldEntrySize = 24;   // u64 postings, u64 positions, u32 df, u32 резерв
+
+}  // namespace
+
+SegmentWriter::SegmentWriter(const std::string& path, uint32_t num_docs)
+    : path_(path), positions_path_(path + ".positions.tmp"), num_docs_(num_docs) {
+    out_.open(path_, std::ios::binary | std::ios::trunc);
+    positions_out_.open(positions_path_, std::ios::binary | std::ios::trunc);
+    if (!out_.is_open() || !positions_out_.is_open()) throw std::runtime_error("Cannot create segment " + path_);
+
+    for (uint32_t f = 0; f < kNumFields; ++f) fields_.push_back(f);
+    std::sort(fields_.begin(), fields_.end(), [](uint32_t a, uint32_t b) { return field_name(a) < field_name(b); });
+    std::string head(kHeaderSize, '\0');
+    for (uint32_t field : fields_) {
+        append_raw<uint32_t>(head, field_name(field).size());
+        head += field_name(field);
+    }
+    out_.write(head.data(), head.size());
+}
+
+SegmentWriter::~SegmentWriter() {
+    if (positions_out_.is_open()) positions_out_.close();
+    std::remove(positions_path_.c_str());
+}
+
+void SegmentWriter::add_term(std::string_view term, const FieldPostings& postings) {
+    if (num_terms_ > 0 && !(last_term_ < term)) throw std::runtime_error("Segment terms must be sorted");
+    last_term_ = term;
+    ++num_terms_;
+
+    append_raw<uint64_t>(dictionary_, strings_.size());
+    append_raw<uint32_t>(dictionary_, term.size());
+    append_raw<uint32_t>(dictionary_, term_doc_freq(postings));
+    strings_ += term;
+
+    std::string docs_buf;
+    std::string pos_buf;
+    for (uint32_t field : fields_) {
+        const PostingsList& list = postings[field];
+        if (list.docs.empty()) {
+            append_raw<uint64_t>(dictionary_, 0);
+            append_raw<uint64_t>(dictionary_, 0);
+            append_raw<uint32_t>(dictionary_, 0);
+            append_raw<uint32_t>(dictionary_, 0);
+            continue;
+        }
+        size_t n = list.docs.size();
+        size_t blocks = (n + kBlockSize - 1) / kBlockSize;
+
+        docs_buf.clear();
+        for (size_t blk = 0; blk < blocks; ++blk) {
+            append_raw<uint32_t>(docs_buf, list.block_last[blk]);
+            append_raw<uint32_t>(docs_buf, list.block_max_tf[blk]);
+            append_raw<uint32_t>(docs_buf, list.block_min_norm[blk]);
+        }
+        size_t docs_table = docs_buf.size();
+        docs_buf.append(blocks * sizeof(uint32_t), '\0');
+        size_t docs_start = docs_buf.size();
+
+        pos_buf.assign(blocks * sizeof(uint64_t), '\0');
+        size_t pos_start = pos_buf.size();
+
+        std::vector<uint32_t> tfs;
+        std::vector<uint32_t> deltas;
+        std::vector<uint32_t> sorted;
+        for (size_t blk = 0; blk < blocks; ++blk) {
+            size_t begin = blk * kBlockSize;
+            size_t end = std::min(n, begin + kBlockSize);
+
+            uint32_t docs_offset = docs_buf.size() - docs_start;
+            std::memcpy(&docs_buf[docs_table + blk * sizeof(uint32_t)], &docs_offset, sizeof(uint32_t));
+            block_codec::encode_delta(list.docs.data() + begin, end - begin, blk ? list.block_last[blk - 1] : 0,
+                                      docs_buf);
+            tfs.clear();
+            deltas.clear();
+            for (size_t i = begin; i < end; ++i) {
+                tfs.push_back(list.tfs[i] - 1);
+                auto positions = list.positions_of(i);
+                sorted.assign(positions.begin(), positions.end());
+                std::sort(sorted.begin(), sorted.end());
+                uint32_t prev_pos = 0;
+                for (uint32_t p : sorted) {
+                    deltas.push_back(p - prev_pos);
+                    prev_pos = p;
+                }
+            }
+            block_codec::encode(tfs.data(), tfs.size(), docs_buf);
+
+            uint64_t pos_offset = pos_buf.size() - pos_start;
+            std::memcpy(&pos_buf[blk * sizeof(uint64_t)], &pos_offset, sizeof(uint64_t));
+            block_codec::encode(deltas.data(), deltas.size(), pos_buf);
+        }
+
+        append_raw<uint64_t>(dictionary_, postings_size_);
+        append_raw<uint64_t>(dictionary_, positions_size_);
+        append_raw<uint32_t>(dictionary_, n);
+        append_raw<uint32_t>(dictionary_, 0);
+
+        out_.write(docs_buf.data(), docs_buf.size());
+        positions_out_.write(pos_buf.data(), pos_buf.size());
+        postings_size_ += docs_buf.size();
+        positions_size_ += pos_buf.size();
+    }
+}
+
+void SegmentWriter::finish() {
+    if (finished_) return;
+    finished_ = true;
+
+    uint64_t postings_offset = static_cast<uint64_t>(out_.tellp()) - postings_size_;
+    uint64_t positions_offset = postings_offset + postings_size_;
+    positions_out_.close();
+    {
+        std::ifstream pos_in(positions_path_, std::ios::binary);
+        if (positions_size_ > 0) out_ << pos_in.rdbuf();
+    }
+    uint64_t dictionary_offset = positions_offset + positions_size_;
+    out_.write(dictionary_.data(), dictionary_.size());
+    uint64_t strings_offset = dictionary_offset + dictionary_.size();
+    out_.write(strings_.data(), strings_.size());
+    uint64_t file_size = strings_offset + strings_.size();
+
+    std::string head;
+    append_raw<uint32_t>(head, kSegmentMagic);
+    append_raw<uint32_t>(head, kSegmentVersion);
+    append_raw<uint32_t>(head, fields_.size());
+    append_raw<uint32_t>(head, num_terms_);
+    append_raw<uint32_t>(head, num_docs_);
+    append_raw<uint32_t>(head, 0);
+    append_raw<uint64_t>(head, postings_offset);
+    append_raw<uint64_t>(head, positions_offset);
+    append_raw<uint64_t>(head, dictionary_offset);
+    append_raw<uint64_t>(head, strings_offset);
+    append_raw<uint64_t>(head, file_size);
+    out_.seekp(0);
+    out_.write(head.data(), head.size());
+    out_.close();
+    if (!out_) throw std::runtime_error("Failed to write segment " + path_);
+}
+
+SegmentReader::SegmentReader(const std::string& path) : file_(path) {
+    const uint8_t* base = file_.data();
+    if (file_.size() < kHeaderSize || load_raw<uint32_t>(base) != kSegmentMagic) {
+        throw std::runtime_error("Invalid segment header");
+    }
+    version_ = load_raw<uint32_t>(base + 4);
+    if (version_ < kMinSegmentVersion || version_ > kSegmentVersion) {
+        throw std::runtime_error("Unsupported segment version");
+    }
+    uint32_t num_fields = load_raw<uint32_t>(base + 8);
+    num_terms_ = load_raw<uint32_t>(base + 12);
+    num_docs_ = load_raw<uint32_t>(base + 16);
+    uint64_t postings_offset = load_raw<uint64_t>(base + 24);
+    uint64_t positions_offset = load_raw<uint64_t>(base + 32);
+    uint64_t dictionary_offset = load_raw<uint64_t>(base + 40);
+    uint64_t strings_offset = load_raw<uint64_t>(base + 48);
+    uint64_t file_size = load_raw<uint64_t>(base + 56);
+    entry_size_ = kEntryHeaderSize + num_fields * kFieldEntrySize;
+    if (file_size != file_.size() || postings_offset > positions_offset || positions_offset > dictionary_offset ||
+        dictionary_offset + uint64_t{num_terms_} * entry_size_ != strings_offset || strings_offset > file_size) {
+        throw std::runtime_error("Corrupted segment layout");
+    }
+
+    const uint8_t* p = base + kHeaderSize;
+    for (uint32_t i = 0; i < num_fields; ++i) {
+        if (p + 4 > base + postings_offset) throw std::runtime_error("Corrupted segment fields");
+        uint32_t len = load_raw<uint32_t>(p);
+        p += 4;
+        if (p + len > base + postings_offset) throw std::runtime_error("Corrupted segment fields");
+        fields_.push_back(field_id({reinterpret_cast<const char*>(p), len}));
+        p += len;
+    }
+
+    postings_ = base + postings_offset;
+    positions_ = base + positions_offset;
+    dictionary_ = base + dictionary_offset;
+    strings_ = base + strings_offset;
+    end_ = base + file_size;
+    file_.advise_random();
+}
+
+std::string_view SegmentReader::term(uint32_t ordinal) const {
+    const uint8_t* e = entry(ordinal);
+    uint64_t offset = load_raw<uint64_t>(e);
+    uint32_t len = load_raw<uint32_t>(e + 8);
+    if (strings_ + offset + len > end_) throw std::runtime_error("Corrupted segment dictionary");
+    return {reinterpret_cast<const char*>(strings_ + offset), len};
+}
+
+TermId SegmentReader::find(std::string_view term_str) const {
+    uint32_t lo = 0;
+    uint32_t hi = num_terms_;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (term(mid) < term_str) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < num_terms_ && term(lo) == term_str) return lo;
+    return kNoTerm;
+}
+
+uint32_t SegmentReader::doc_freq(uint32_t ordinal) const {
+    return version_ < 3 ? 0 : load_raw<uint32_t>(entry(ordinal) + 12);
+}
+
+FieldPostings SegmentReader::decode(uint32_t ordinal) const {
+    FieldPostings result;
+    const uint8_t* e = entry(ordinal) + kEntryHeaderSize;
+    for (size_t f = 0; f < fields_.size(); ++f, e += kFieldEntrySize) {
+        if (fields_[f] == kNoField || load_raw<uint32_t>(e + 16) == 0) continue;
+        decode_field(e, result[fields_[f]]);
+    }
+    return result;
+}
+
+void SegmentReader::decode_field(const uint8_t* field_entry, PostingsList& postings) const {
+    uint64_t postings_offset = load_raw<uint64_t>(field_entry);
+    uint64_t positions_offset = load_raw<uint64_t>(field_entry + 8);
+    size_t n = load_raw<uint32_t>(field_entry + 16);
+    size_t blocks = (n + kBlockSize - 1) / kBlockSize;
+
+    const uint8_t* meta = postings_ + postings_offset;
+    const uint8_t* docs_table = meta + blocks * 3 * sizeof(uint32_t);
+    const uint8_t* docs_data = docs_table + blocks * sizeof(uint32_t);
+    const uint8_t* pos_table = positions_ + positions_offset;
+    const uint8_t* pos_data = pos_table + blocks * sizeof(uint64_t);
+    if (docs_data > positions_ || pos_data > dictionary_) throw std::runtime_error("Corrupted segment postings");
+
+    postings.max_tf = 0;
+    postings.min_norm = UINT32_MAX;
+    for (size_t blk = 0; blk < blocks; ++blk) {
+        const uint8_t* m = meta + blk * 3 * sizeof(uint32_t);
+        postings.block_last.push_back(load_raw<uint32_t>(m));
+        postings.block_max_tf.push_back(load_raw<uint32_t>(m + 4));
+        postings.block_min_norm.push_back(load_raw<uint32_t>(m + 8));
+        postings.max_tf = std::max(postings.max_tf, postings.block_max_tf.back());
+        postings.min_norm = std::min(postings.min_norm, postings.block_min_norm.back());
+    }
+
+    postings.docs.resize(n);
+    postings.tfs.resize(n);
+    postings.pos_offsets.resize(n);
+    for (size_t blk = 0; blk < blocks; ++blk) {
+        size_t begin = blk * kBlockSize;
+        size_t count = std::min(n, begin + kBlockSize) - begin;
+
+        const uint8_t* p = docs_data + load_raw<uint32_t>(docs_table + blk * sizeof(uint32_t));
+        if (p > positions_) throw std::runtime_error("Corrupted segment postings");
+        p = block_codec::decode_delta(p, positions_, count, blk ? postings.block_last[blk - 1] : 0,
+                                      postings.docs.data() + begin);
+        uint32_t* tfs = postings.tfs.data() + begin;
+        block_codec::decode(p, positions_, count, tfs);
+
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            postings.pos_offsets[begin + i] = static_cast<uint32_t>(postings.positions.size() + total);
+            total += ++tfs[i];
+        }
+        if (total > MAX_BLOCK_SIZE) throw std::runtime_error("Corrupted segment postings");
+        const uint8_t* q = pos_data + load_raw<uint64_t>(pos_table + blk * sizeof(uint64_t));
+        if (q > dictionary_) throw std::runtime_error("Corrupted segment positions");
+        size_t first = postings.positions.size();
+        postings.positions.resize(first + total);
+        block_codec::decode(q, dictionary_, total, postings.positions.data() + first);
+
+        // Дельты позиций восстанавливаются на месте, внутри каждого документа.
+        uint32_t* v = postings.positions.data() + first;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t acc = 0;
+            for (uint32_t k = 0; k < tfs[i]; ++k, ++v) {
+                acc += *v;
+                *v = acc;
+            }
+        }
+    }
+    build_bitmap(postings, num_docs_);
+}
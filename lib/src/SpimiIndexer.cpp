@@ -0,0 +1,201 @@
+#include "SpimiIndexer.h"
+#include "Encoding.h"
+#include "Segment.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// Грубая оценка накладных расходов контейнеров: узел хеш-таблицы со строкой
+// и postings всех полей на термин, вектор позиций на документ.
+constexpr size_t kTermOverhead = 64 + sizeof(FieldPostings);
+constexpr size_t kPostingOverhead = 48;
+
+// Сколько блоков сливается за раз. При большем числе блоков (маленький бюджет
+// памяти на большом корпусе) они сначала сливаются группами в промежуточные
+// блоки, чтобы не упереться в лимит открытых файлов.
+constexpr size_t kMaxMergeFanIn = 64;
+
+// Один термин блока: имя, число непустых полей и их postings с именами полей.
+void write_run_term(std::ofstream& out, std::string_view term, const FieldPostings& fields) {
+    write_string(out, term);
+    write_varint(out, std::count_if(fields.begin(), fields.end(), [](const auto& list) { return list.size() > 0; }));
+    for (uint32_t f = 0; f < kNumFields; ++f) {
+        const auto& list = fields[f];
+        if (list.size() == 0) continue;
+        write_string(out, field_name(f));
+        write_delta_vector(out, list.docs);
+        for (size_t i = 0; i < list.size(); ++i) write_delta_vector(out, list.positions_of(i));
+    }
+}
+
+// Последовательное чтение блока: термины по возрастанию до конца файла.
+class RunReader {
+public:
+    explicit RunReader(const std::string& path) : in_(path, std::ios::binary) {
+        if (!in_.is_open()) throw std::runtime_error("Cannot open run " + path);
+    }
+
+    bool next() {
+        if (in_.peek() == std::ifstream::traits_type::eof()) return false;
+        term_.clear();
+        for (auto& list : postings_) list.clear();
+        read_string(in_, term_);
+        size_t fields = read_varint(in_);
+        std::string field;
+        PostingsList skipped;
+        for (size_t f = 0; f < fields; ++f) {
+            read_string(in_, field);
+            uint32_t id = field_id(field);
+            PostingsList& list = id == kNoField ? skipped : postings_[id];
+            DocList docs = read_delta_vector(in_);
+            for (DocId doc : docs) list.add(doc, read_delta_vector(in_));
+        }
+        if (!in_) throw std::runtime_error("Truncated SPIMI run");
+        return true;
+    }
+
+    const Term& term() const { return term_; }
+    FieldPostings& postings() { return postings_; }
+
+private:
+    std::ifstream in_;
+    Term term_;
+    FieldPostings postings_;
+};
+
+// k-путевое слияние блоков: emit получает термины по возрастанию со сложенными postings.
+// Куча по (термин, номер блока): блоки идут по возрастанию DocId, поэтому
+// postings одного термина дописываются в порядке блоков и остаются отсортированными.
+void merge_run_files(std::span<const std::string> paths,
+                     const std::function<void(const Term&, FieldPostings&)>& emit) {
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const auto& path : paths) readers.push_back(std::make_unique<RunReader>(path));
+
+    auto cmp = [&](size_t a, size_t b) {
+        const Term& ta = readers[a]->term();
+        const Term& tb = readers[b]->term();
+        return ta != tb ? ta > tb : a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(cmp)> heap(cmp);
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (readers[i]->next()) heap.push(i);
+    }
+
+    FieldPostings merged;
+    while (!heap.empty()) {
+        Term term = readers[heap.top()]->term();
+        for (auto& list : merged) list.clear();
+        while (!heap.empty() && readers[heap.top()]->term() == term) {
+            size_t i = heap.top();
+            heap.pop();
+            for (uint32_t f = 0; f < kNumFields; ++f) merged[f].append(readers[i]->postings()[f]);
+            if (readers[i]->next()) heap.push(i);
+        }
+        emit(term, merged);
+    }
+}
+
+}  // namespace
+
+SpimiIndexer::SpimiIndexer(const std::string& base_name, size_t memory_budget, const std::string& temp_dir)
+    : base_name_(base_name),
+      temp_prefix_(temp_dir.empty() ? base_name : temp_dir + "/" + base_name.substr(base_name.rfind('/') + 1)),
+      memory_budget_(memory_budget),
+      docs_writer_(base_name + ".store") {}
+
+SpimiIndexer::~SpimiIndexer() {
+    for (const auto& path : run_paths_) std::remove(path.c_str());
+}
+
+void SpimiIndexer::add_document(const DocumentView& doc) {
+    docs_writer_.add_document(doc);
+    norms_.set(kTitleField, doc.id, add_field(doc.id, kTitleField, doc.title));
+    norms_.set(kPlotField, doc.id, add_field(doc.id, kPlotField, doc.plot));
+    if (block_bytes_ >= memory_budget_) flush_run();
+}
+
+uint32_t SpimiIndexer::add_field(DocId doc_id, uint32_t field, std::string_view text) {
+    tokenizer_.tokenize(text, token_buffer_);
+    const auto& tokens = token_buffer_.tokens;
+    std::unordered_map<std::string_view, std::vector<uint32_t>> term_positions;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        term_positions[tokens[i]].push_back(i);
+    }
+    for (const auto& [term, positions] : term_positions) {
+        size_t terms = block_.size();
+        TermId id = block_.intern(term);
+        if (block_.size() != terms) block_bytes_ += kTermOverhead + term.size();
+        auto& list = block_.postings[id][field];
+        block_bytes_ += kPostingOverhead + positions.size() * sizeof(uint32_t);
+        list.add(doc_id, positions);
+    }
+    return static_cast<uint32_t>(tokens.size());
+}
+
+void SpimiIndexer::flush_run() {
+    if (block_.empty()) return;
+    std::vector<std::pair<std::string_view, TermId>> terms;
+    terms.reserve(block_.size());
+    for (const auto& [term, id] : block_.ids) terms.emplace_back(term, id);
+    std::sort(terms.begin(), terms.end());
+
+    std::string path = next_run_path();
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Cannot create run " + path);
+    run_paths_.push_back(path);
+
+    for (const auto& [term, id] : terms) write_run_term(out, term, block_.postings[id]);
+    if (!out) throw std::runtime_error("Failed to write run " + path);
+    block_.clear();
+    block_bytes_ = 0;
+}
+
+void SpimiIndexer::finish() {
+    flush_run();
+    docs_writer_.finish();
+    norms_.save(base_name_ + ".norms");
+    merge_runs();
+    for (const auto& path : run_paths_) std::remove(path.c_str());
+    run_paths_.clear();
+}
+
+std::string SpimiIndexer::next_run_path() {
+    return temp_prefix_ + ".run" + std::to_string(runs_created_++);
+}
+
+void SpimiIndexer::merge_runs() {
+    // Промежуточные проходы: соседние блоки сливаются группами по kMaxMergeFanIn,
+    // пока блоков не станет не больше kMaxMergeFanIn. Результат группы встаёт
+    // на её место, так что порядок блоков по DocId сохраняется.
+    while (run_paths_.size() > kMaxMergeFanIn) {
+        for (size_t first = 0; first < run_paths_.size() && run_paths_.size() > kMaxMergeFanIn; ++first) {
+            size_t last = std::min(first + kMaxMergeFanIn, run_paths_.size());
+            std::string path = next_run_path();
+            std::ofstream out(path, std::ios::binary);
+            if (!out.is_open()) throw std::runtime_error("Cannot create run " + path);
+            run_paths_.insert(run_paths_.begin() + last, path);
+
+            merge_run_files(std::span(run_paths_).subspan(first, last - first),
+                            [&](const Term& term, FieldPostings& merged) { write_run_term(out, term, merged); });
+            out.close();
+            if (!out) throw std::runtime_error("Failed to write run " + path);
+
+            for (size_t i = first; i < last; ++i) std::remove(run_paths_[i].c_str());
+            run_paths_.erase(run_paths_.begin() + first, run_paths_.begin() + last);
+        }
+    }
+
+    SegmentWriter writer(base_name_ + ".seg", docs_writer_.size());
+    merge_run_files(run_paths_, [&](const Term& term, FieldPostings& merged) {
+        for (uint32_t f = 0; f < kNumFields; ++f) build_block_max(merged[f], norms_.field_norms(f));
+        writer.add_term(term, merged);
+    });
+    writer.finish();
+}
@@ -0,0 +1,122 @@
+#include "TermDictionary.h"
+#include "Encoding.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+size_t common_prefix(std::string_view a, std::string_view b) {
+    size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+}  // namespace
+
+TermId TermDictionary::add(std::string_view term) {
+    if (size_ > 0 && !(last_ < term)) throw std::runtime_error("Dictionary terms must be sorted");
+    if (size_ % kBlockTerms == 0) {
+        block_offsets_.push_back(static_cast<uint32_t>(data_.size()));
+        append_varint(data_, term.size());
+        data_ += term;
+    } else {
+        size_t prefix = common_prefix(last_, term);
+        append_varint(data_, prefix);
+        append_varint(data_, term.size() - prefix);
+        data_ += term.substr(prefix);
+    }
+    last_ = term;
+    return size_++;
+}
+
+void TermDictionary::clear() {
+    data_.clear();
+    block_offsets_.clear();
+    last_.clear();
+    size_ = 0;
+}
+
+void TermDictionary::shrink_to_fit() {
+    data_.shrink_to_fit();
+    block_offsets_.shrink_to_fit();
+}
+
+std::string_view TermDictionary::block_first(uint32_t block, const uint8_t*& p) const {
+    const auto* end = reinterpret_cast<const uint8_t*>(data_.data() + data_.size());
+    p = reinterpret_cast<const uint8_t*>(data_.data()) + block_offsets_[block];
+    size_t len = read_varint(p, end);
+    std::string_view first(reinterpret_cast<const char*>(p), len);
+    p += len;
+    return first;
+}
+
+// В блоке поддерживается длина общего префикса common предыдущего термина с term.
+// Если очередной термин делит с предыдущим больше common символов, он расходится
+// с term там же и тоже меньше него; если меньше - он уже больше term.
+TermId TermDictionary::find(std::string_view term) const {
+    if (size_ == 0) return kNoTerm;
+    uint32_t lo = 0;
+    uint32_t hi = static_cast<uint32_t>(block_offsets_.size());
+    const uint8_t* p;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (block_first(mid, p) <= term) lo = mid;
+        else hi = mid;
+    }
+    std::string_view first = block_first(lo, p);
+    TermId id = lo * kBlockTerms;
+    if (first == term) return id;
+    if (first > term) return kNoTerm;
+
+    const auto* end = reinterpret_cast<const uint8_t*>(data_.data() + data_.size());
+    size_t common = common_prefix(first, term);
+    TermId last = std::min(size_, id + kBlockTerms);
+    for (++id; id < last; ++id) {
+        size_t prefix = read_varint(p, end);
+        size_t len = read_varint(p, end);
+        std::string_view suffix(reinterpret_cast<const char*>(p), len);
+        p += len;
+        if (prefix > common) continue;
+        if (prefix < common) return kNoTerm;
+        std::string_view rest = term.substr(common);
+        size_t m = common_prefix(suffix, rest);
+        if (m == suffix.size() && m == rest.size()) return id;
+        if (m < suffix.size() &&
+            (m == rest.size() || static_cast<uint8_t>(suffix[m]) > static_cast<uint8_t>(rest[m]))) {
+            return kNoTerm;
+        }
+        common += m;
+    }
+    return kNoTerm;
+}
+
+std::string TermDictionary::term(TermId id) const {
+    if (id >= size_) throw std::out_of_range("TermId out of range");
+    const auto* end = reinterpret_cast<const uint8_t*>(data_.data() + data_.size());
+    const uint8_t* p;
+    std::string result(block_first(id / kBlockTerms, p));
+    for (uint32_t i = 0; i < id % kBlockTerms; ++i) {
+        size_t prefix = read_varint(p, end);
+        size_t len = read_varint(p, end);
+        result.resize(prefix);
+        result.append(reinterpret_cast<const char*>(p), len);
+        p += len;
+    }
+    return result;
+}
+
+void TermDictionary::for_each(const std::function<void(TermId, std::string_view)>& fn) const {
+    const auto* end = reinterpret_cast<const uint8_t*>(data_.data() + data_.size());
+    std::string current;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data_.data());
+    for (TermId id = 0; id < size_; ++id) {
+        size_t prefix = 0;
+        if (id % kBlockTerms != 0) prefix = read_varint(p, end);
+        size_t len = read_varint(p, end);
+        current.resize(prefix);
+        current.append(reinterpret_cast<const char*>(p), len);
+        p += len;
+        fn(id, current);
+    }
+}
@@ -1,47 +1,34 @@
 #include "Tokenizer.h"
-#include <algorithm>
-#include <cctype>
 
-Tokenizer::Tokenizer() {
-    stop_words_ = {
-        "a", "an", "the", "in", "on", "of", "for", "with", "is", "are", "was",
-        "were", "it", "he", "she", "they", "i", "you", "and", "or", "but"
-    };
+std::string& Tokenizer::lower_buffer() {
+    thread_local std::string buffer;
+    return buffer;
 }
 
-std::string Tokenizer::to_lower(const std::string& str) const {
-    std::string lower_str = str;
-    std::transform(lower_str.begin(), lower_str.end(), lower_str.begin(),
-                   [](unsigned char c){ return std::tolower(c); });
-    return lower_str;
+void Tokenizer::tokenize(std::string_view text, TokenBuffer& buffer) const {
+    // Токены не длиннее текста, поэтому arena не перераспределяется, пока
+    // в неё пишутся токены, и уже выданные представления остаются верными.
+    buffer.arena.resize(text.size());
+    buffer.tokens.clear();
+    size_t used = 0;
+    for_each_token(text, [&](std::string_view token) {
+        char* dst = buffer.arena.data() + used;
+        token.copy(dst, token.size());
+        buffer.tokens.emplace_back(dst, token.size());
+        used += token.size();
+    });
 }
 
-std::vector<std::string> Tokenizer::tokenize(const std::string& text) const {
-    std::vector<std::string> tokens;
-    std::string current_token;
-    
-    for (char ch : text) {
-        if (std::isalnum(ch)) {
-            current_token += ch;
-        } else {
-            if (!current_token.empty()) {
-                std::string lower_token = to_lower(current_token);
-                if (stop_words_.find(lower_token) == stop_words_.end()) {
-                    tokens.push_back(lower_token);
-                }
-                current_token.clear();
-            }
-        }
-    }
-    
-    if (!current_token.empty()) {
-        std::string lower_token = to_lower(current_token);
-        if (stop_words_.find(lower_token) == stop_words_.end()) {
-            tokens.push_back(lower_token);
-        }
-    }
-    
+size_t Tokenizer::count_tokens(std::string_view text) const {
+    size_t count = 0;
+    for_each_token(text, [&](std::string_view) { ++count; });
+    return count;
+}
+
+Tokens Tokenizer::tokenize(std::string_view text) const {
+    Tokens tokens;
+    for_each_token(text, [&](std::string_view token) { tokens.emplace_back(token); });
     return tokens;
 }
 
-// "A Man's Life: The Great War (1918)" для примера перейдёт в  ["man", "s", "life", "great", "war", "1918"]
\ No newline at end of file
+// "A Man's Life: The Great War (1918)" для примера перейдёт в  ["man", "s", "life", "great", "war", "1918"]
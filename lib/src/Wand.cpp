@@ -0,0 +1,147 @@
+#include "Wand.h"
+#include "Metrics.h"
+#include "PostingsCursor.h"
+#include "TopK.h"
+#include <algorithm>
+
+namespace {
+
+// Запас на ошибки округления: верхняя оценка не должна оказаться меньше точного score.
+constexpr double kBoundSlack = 1.0 + 1e-9;
+
+// Курсор термина: объединение курсоров его полей.
+struct TermCursor {
+    std::vector<PostingsCursor> fields;
+    double idf = 0.0;
+    double multiplicity = 0.0;  // сколько раз термин встречается в запросе
+    double max_score = 0.0;
+    DocId cur = kEndDoc;
+
+    void refresh() {
+        cur = kEndDoc;
+        for (const auto& f : fields) cur = std::min(cur, f.doc());
+    }
+
+    void advance(DocId target) {
+        for (auto& f : fields) f.advance(target);
+        refresh();
+    }
+
+    void next() { advance(cur + 1); }
+};
+
+}  // namespace
+
+ScoredDocs BlockMaxWand::search(const Ranker::PreparedQuery& query, size_t k, size_t offset) const {
+    if (query.empty() || k == 0) return {};
+
+    // Оценка вклада поля: наибольший tf при наименьшей норме.
+    auto field_bound = [&](const PostingsCursor& f, uint32_t max_tf, uint32_t min_norm) {
+        return ranker_.field_tf(f.field, max_tf, static_cast<uint8_t>(min_norm));
+    };
+    auto bound = [&](double idf, double tf) { return ranker_.term_score(idf, tf) * kBoundSlack; };
+
+    // Повторяющиеся термины запроса складываются в один курсор с кратностью.
+    std::vector<TermCursor> terms;
+    std::vector<size_t> term_of(query.size());
+    for (size_t i = 0; i < query.size(); ++i) {
+        size_t j = 0;
+        while (j < i && query[j].fields != query[i].fields) ++j;
+        if (j < i) {
+            term_of[i] = term_of[j];
+            terms[term_of[i]].multiplicity += 1.0;
+            continue;
+        }
+        term_of[i] = terms.size();
+        TermCursor tc;
+        tc.idf = query[i].idf;
+        tc.multiplicity = 1.0;
+        for (const auto& [postings, field] : query[i].fields) tc.fields.push_back({postings, field});
+        terms.push_back(std::move(tc));
+    }
+    for (auto& tc : terms) {
+        double tf = 0;
+        for (const auto& f : tc.fields) tf += field_bound(f, f.postings->max_tf, f.postings->min_norm);
+        tc.max_score = tc.multiplicity * bound(tc.idf, tf);
+        tc.refresh();
+    }
+
+    std::vector<TermCursor*> order;
+    for (auto& tc : terms) order.push_back(&tc);
+    auto by_doc = [](const TermCursor* a, const TermCursor* b) { return a->cur < b->cur; };
+    std::sort(order.begin(), order.end(), by_doc);
+
+    // Точный score в том же порядке суммирования, что и Ranker::score.
+    auto full_score = [&](DocId doc) {
+        double score = 0.0;
+        for (size_t i = 0; i < query.size(); ++i) {
+            const auto& tc = terms[term_of[i]];
+            double tf = 0;
+            for (const auto& f : tc.fields) {
+                if (f.doc() != doc) continue;
+                tf += ranker_.field_tf(f.field, f.tf(), ranker_.norm(f.field, doc));
+            }
+            score += ranker_.term_score(query[i].idf, tf);
+        }
+        return score;
+    };
+
+    // Верхняя оценка термина по блокам, покрывающим target, и правая граница этих блоков.
+    auto block_bound = [&](TermCursor& tc, DocId target, DocId& block_end) {
+        double tf = 0;
+        for (auto& f : tc.fields) {
+            if (!f.shallow_advance(target)) continue;
+            tf += field_bound(f, f.postings->block_max_tf[f.block], f.postings->block_min_norm[f.block]);
+            block_end = std::min(block_end, f.postings->block_last[f.block]);
+        }
+        if (tf == 0) return 0.0;
+        return tc.multiplicity * bound(tc.idf, tf);
+    };
+
+    TopK top(k > SIZE_MAX - offset ? SIZE_MAX : k + offset);
+    uint64_t scored = 0;
+    while (true) {
+        double theta = top.threshold();
+
+        // Pivot: первый курсор, на котором сумма верхних оценок превышает порог.
+        double acc = 0;
+        size_t pivot = order.size();
+        for (size_t i = 0; i < order.size() && order[i]->cur != kEndDoc; ++i) {
+            acc += order[i]->max_score;
+            if (acc > theta) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == order.size()) break;
+        DocId pivot_doc = order[pivot]->cur;
+        while (pivot + 1 < order.size() && order[pivot + 1]->cur == pivot_doc) ++pivot;
+
+        DocId block_end = kEndDoc;
+        double block_acc = 0;
+        for (size_t i = 0; i <= pivot; ++i) block_acc += block_bound(*order[i], pivot_doc, block_end);
+
+        if (block_acc > theta) {
+            if (order[0]->cur == pivot_doc) {
+                if (!deleted_ || !deleted_->contains(pivot_doc)) {
+                    top.push(full_score(pivot_doc), pivot_doc);
+                    ++scored;
+                }
+                for (size_t i = 0; i <= pivot; ++i) order[i]->next();
+            } else {
+                for (size_t i = 0; i < pivot; ++i) {
+                    if (order[i]->cur < pivot_doc) order[i]->advance(pivot_doc);
+                }
+            }
+        } else {
+            // Ни один документ до конца текущих блоков не пройдёт порог.
+            DocId next = block_end == kEndDoc ? kEndDoc : block_end + 1;
+            if (pivot + 1 < order.size()) next = std::min(next, order[pivot + 1]->cur);
+            if (next <= pivot_doc) next = pivot_doc + 1;
+            for (size_t i = 0; i <= pivot; ++i) order[i]->advance(next);
+        }
+        std::sort(order.begin(), order.end(), by_doc);
+    }
+    QueryTrace::add_scored(scored);
+    return top.take(offset);
+}
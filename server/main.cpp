@@ -1,11 +1,21 @@
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include "httplib.h"
 #include "json.hpp"
-#include "Index.h"
-#include "SearchEngine.h"
+#include "LiveIndex.h"
+#include "Metrics.h"
+#include "TopK.h"
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <limits>
 #include <fstream>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 
 using json = nlohmann::json;
 
@@ -15,14 +25,464 @@ std::string utf8_truncate(const std::string& str, size_t len) {
     return str.substr(0, len);
 }
 
-int main() {
-    Index index;
+DocId parse_doc_id(const std::string& s) {
+    unsigned long id = std::stoul(s);
+    if (id > std::numeric_limits<DocId>::max()) throw std::out_of_range("DocId out of range");
+    return static_cast<DocId>(id);
+}
+
+// Загруженная версия индекса. Запрос берёт указатель на текущую версию один раз
+// и работает с ней до конца; перезагрузка публикует новую версию атомарно, а
+// старая освобождается, когда её отпустит последний запрос.
+struct LoadedIndex {
+    std::unique_ptr<LiveIndex> index;
+    uint64_t epoch = 0;  // номер загрузки в этом процессе, входит в ключ кэша ответов
+    std::chrono::system_clock::time_point loaded_at;
+    double load_ms = 0;
+    double warmup_ms = 0;
+    size_t warmup_queries = 0;
+};
+
+// Параметры /search.
+struct SearchRequest {
+    std::string mode;
+    std::string query;
+    double k1, b, w_title;
+    size_t limit, offset, budget;
+};
+
+SearchRequest parse_search_request(const httplib::Request& req) {
+    SearchRequest q{"", req.get_param_value("q"), 1.2, 0.75, 5.0, 20, 0, 0};
+    if (req.has_param("k1")) try { q.k1 = std::stod(req.get_param_value("k1")); } catch(...) {}
+    if (req.has_param("b")) try { q.b = std::stod(req.get_param_value("b")); } catch(...) {}
+    if (req.has_param("w_title")) try { q.w_title = std::stod(req.get_param_value("w_title")); } catch(...) {}
+    if (req.has_param("limit")) try { q.limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), 1000); } catch(...) {}
+    if (req.has_param("offset")) try { q.offset = std::stoul(req.get_param_value("offset")); } catch(...) {}
+    // mode=saat: score-at-a-time по вкладам; budget - сколько postings можно обойти.
+    if (req.has_param("budget")) try { q.budget = std::stoul(req.get_param_value("budget")); } catch(...) {}
+    if (req.has_param("mode")) q.mode = req.get_param_value("mode");
+    return q;
+}
+
+// Последние запросы /search. Новая версия индекса прогревается ими перед
+// публикацией, чтобы первые запросы к ней не ждали чтения postings с диска.
+
+class RecentQueries {
+public:
+    explicit RecentQueries(size_t capacity) : ring_(capacity) {}
+
+    void add(SearchRequest query) {
+        if (ring_.empty()) return;
+        std::lock_guard lock(mutex_);
+        ring_[next_++ % ring_.size()] = std::move(query);
+    }
+
+    std::vector<SearchRequest> list() const {
+        std::lock_guard lock(mutex_);
+        size_t count = std::min(next_, ring_.size());
+        return {ring_.begin(), ring_.begin() + count};
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<SearchRequest> ring_;
+    size_t next_ = 0;
+};
+
+std::string iso_time(std::chrono::system_clock::time_point t) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(t);
+    std::tm tm{};
+    gmtime_r(&seconds, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buf;
+}
+
+volatile std::sig_atomic_t reload_signal = 0;
+
+json cache_stats_json(const CacheStats& stats) {
+    return {{"hits", stats.hits}, {"misses", stats.misses}, {"insertions", stats.insertions},
+            {"evictions", stats.evictions}, {"expirations", stats.expirations},
+            {"entries", stats.entries}, {"bytes", stats.bytes}};
+}
+
+// Распределённый поиск: шарды - отдельные процессы, каждый со своим индексом
+// (search_server --index index.shard<i>), координатор (--shard-urls) рассылает
+// им запрос в два шага. POST /shard/stats {"q"} - статистика BM25 шарда по
+// терминам запроса; координатор складывает её и передаёт с запросом в
+// POST /shard/search, так что все шарды ранжируют по статистике всей коллекции
+// и score совпадают с одним общим индексом.
+json shard_stats_json(const LiveIndex::Snapshot& snapshot, const std::string& query) {
+    const auto& stats = snapshot.stats();
+    json doc_freq = json::object();
+    for (const auto& term : snapshot.scoring_terms(query)) doc_freq[term] = stats.doc_freq(term);
+    json total_length = json::array();
+    for (uint32_t f = 0; f < kNumFields; ++f) total_length.push_back(snapshot.total_length(f));
+    return {{"num_docs", stats.num_docs}, {"total_length", total_length}, {"doc_freq", doc_freq}};
+}
+
+json sum_shard_stats(const std::vector<json>& shards) {
+    size_t num_docs = 0;
+    std::vector<uint64_t> total_length(kNumFields);
+    json doc_freq = json::object();
+    for (const auto& shard : shards) {
+        num_docs += shard.at("num_docs").get<size_t>();
+        for (uint32_t f = 0; f < kNumFields; ++f) total_length[f] += shard.at("total_length").at(f).get<uint64_t>();
+        for (const auto& [term, df] : shard.at("doc_freq").items()) {
+            doc_freq[term] = doc_freq.value(term, uint32_t{0}) + df.get<uint32_t>();
+        }
+    }
+    return {{"num_docs", num_docs}, {"total_length", total_length}, {"doc_freq", doc_freq}};
+}
+
+CollectionStats collection_stats_from_json(const json& j) {
+    CollectionStats stats;
+    stats.num_docs = j.at("num_docs").get<size_t>();
+    for (uint32_t f = 0; f < kNumFields; ++f) {
+        auto total = j.at("total_length").at(f).get<uint64_t>();
+        stats.avg_length[f] = stats.num_docs ? static_cast<double>(total) / stats.num_docs : 0.0;
+    }
+    auto doc_freq = std::make_shared<std::unordered_map<std::string, uint32_t>>();
+    for (const auto& [term, df] : j.at("doc_freq").items()) (*doc_freq)[term] = df.get<uint32_t>();
+    stats.doc_freq = [doc_freq](std::string_view term) {
+        auto it = doc_freq->find(std::string(term));
+        return it == doc_freq->end() ? 0u : it->second;
+    };
+    return stats;
+}
+
+// Координатор: своего индекса нет, /search идёт на все шарды параллельно,
+// выдачи шардов (top offset + limit каждая) сливаются в общий top-k.
+// GET /documents/{id} спрашивает шарды по очереди; /admin/index - состояние шардов.
+// Документы в распределённую коллекцию координатор не добавляет.
+int run_coordinator(const std::vector<std::string>& shard_urls, int port) {
+    ThreadPool pool(shard_urls.size());
+    auto dump = [](const json& j) { return j.dump(-1, ' ', false, json::error_handler_t::replace); };
+    auto client = [](const std::string& url) {
+        auto c = std::make_unique<httplib::Client>(url);
+        c->set_connection_timeout(1, 0);
+        c->set_read_timeout(5, 0);
+        return c;
+    };
+    // POST path на все шарды; ошибка любого шарда - ошибка всего запроса.
+    auto fan_out = [&](const std::string& path, const std::string& body) {
+        std::vector<json> replies(shard_urls.size());
+        pool.run(shard_urls.size(), [&](size_t s) {
+            auto res = client(shard_urls[s])->Post(path, body, "application/json");
+            if (!res) throw std::runtime_error(shard_urls[s] + ": " + httplib::to_string(res.error()));
+            if (res->status != 200) throw std::runtime_error(shard_urls[s] + ": HTTP " + std::to_string(res->status));
+            replies[s] = json::parse(res->body);
+        });
+        return replies;
+    };
+
+    httplib::Server svr;
+    svr.set_read_timeout(5, 0);
+    svr.set_write_timeout(5, 0);
+
+    svr.Get("/search", [&](const auto& req, auto& res) {
+        if (!req.has_param("q")) return;
+        SearchRequest q = parse_search_request(req);
+        try {
+            json stats = sum_shard_stats(fan_out("/shard/stats", dump({{"q", q.query}})));
+            size_t depth = q.limit > SIZE_MAX - q.offset ? SIZE_MAX : q.limit + q.offset;
+            json request = {{"q", q.query}, {"mode", q.mode}, {"k1", q.k1}, {"b", q.b}, {"w_title", q.w_title},
+                            {"limit", depth}, {"budget", q.budget}, {"stats", stats}};
+            TopK top(depth);
+            std::unordered_map<DocId, json> docs;
+            for (auto& reply : fan_out("/shard/search", dump(request))) {
+                for (auto& hit : reply) {
+                    DocId id = hit.at("id").get<DocId>();
+                    top.push(hit.at("score").get<double>(), id);
+                    hit.erase("score");
+                    docs[id] = std::move(hit);
+                }
+            }
+            json j = json::array();
+            for (const auto& hit : top.take(q.offset)) j.push_back(std::move(docs[hit.id]));
+            res.set_content(dump(j), "application/json");
+        } catch (const std::exception& e) {
+            res.status = 502;
+            res.set_content(dump({{"error", e.what()}}), "application/json");
+        }
+    });
+
+    svr.Get(R"(/documents/(\d+))", [&](const auto& req, auto& res) {
+        for (const auto& url : shard_urls) {
+            auto reply = client(url)->Get(req.path);
+            if (reply && reply->status == 200) {
+                res.set_content(reply->body, "application/json");
+                return;
+            }
+        }
+        res.status = 404;
+    });
+
+    svr.Get("/admin/index", [&](const auto&, auto& res) {
+        json shards = json::array();
+        for (const auto& url : shard_urls) {
+            auto reply = client(url)->Get("/admin/index");
+            json status = {{"url", url}};
+            if (!reply) status["error"] = httplib::to_string(reply.error());
+            else if (reply->status != 200) status["error"] = "HTTP " + std::to_string(reply->status);
+            else status["index"] = json::parse(reply->body, nullptr, false);
+            shards.push_back(std::move(status));
+        }
+        res.set_content(dump({{"shards", shards}}), "application/json");
+    });
+
+    std::cout << "Coordinator for " << shard_urls.size() << " shards on port " << port << std::endl;
+    svr.listen("0.0.0.0", port);
+    return 0;
+}
+
+// Параметры запуска:
+//   --cache-mb N             бюджет кэша готовых ответов /search (0 - без кэша), по умолчанию 64
+//   --cache-ttl S            время жизни ответа в кэше в секундах (0 - бессрочно), по умолчанию 300
+//   --conjunction-cache-mb N бюджет кэша промежуточных пересечений AND, по умолчанию 0 (выключен)
+//   --slow-query-ms N        писать в журнал запросы /search дольше N мс с разбивкой по этапам (0 - не писать)
+//   --slow-query-log FILE    файл журнала медленных запросов, по умолчанию stderr
+//   --refresh-ms N           через сколько мс добавленные и удалённые документы становятся
+//                            видны поиску, по умолчанию 1000 (0 - только по refresh=1)
+//   --merge-factor N         сколько сегментов одного уровня сливаются в один, по умолчанию 10
+//   --watch-ms N             как часто проверять index.version, по умолчанию 2000 (0 - не проверять);
+//                            новая версия загружается в фоне и подменяет текущую без остановки.
+//                            Перезагрузку можно запросить и сигналом SIGHUP или POST /admin/reload
+//   --warmup-queries N       сколько последних запросов /search прогоняется на новой версии
+//                            перед публикацией, по умолчанию 64
+//   --index NAME             индекс (коллекция), по умолчанию index; индекс, разбитый индексатором
+//                            на шарды (--shards), ищется по всем шардам сразу
+//   --search-threads N       потоков для поиска по шардам и сегментам одного запроса,
+//                            по умолчанию по числу ядер (0 - в потоке запроса)
+//   --port N                 порт, по умолчанию 8080
+//   --shard-urls URL,...     режим координатора: вместо своего индекса - шарды в других процессах,
+//                            например http://localhost:8081,http://localhost:8082
+int main(int argc, char** argv) {
+    size_t cache_mb = 64;
+    size_t cache_ttl = 300;
+    size_t conjunction_cache_mb = 0;
+    double slow_query_ms = 0;
+    std::string slow_query_log;
+    size_t refresh_ms = 1000;
+    size_t merge_factor = 10;
+    size_t watch_ms = 2000;
+    size_t warmup_queries = 64;
+    std::string index_name = "index";
+    size_t search_threads = default_num_threads();
+    int port = 8080;
+    std::vector<std::string> shard_urls;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--cache-mb") == 0) cache_mb = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--cache-ttl") == 0) cache_ttl = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--conjunction-cache-mb") == 0) conjunction_cache_mb = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--slow-query-ms") == 0) slow_query_ms = std::stod(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--slow-query-log") == 0) slow_query_log = argv[i + 1];
+        else if (std::strcmp(argv[i], "--refresh-ms") == 0) refresh_ms = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--merge-factor") == 0) merge_factor = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--watch-ms") == 0) watch_ms = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--warmup-queries") == 0) warmup_queries = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--index") == 0) index_name = argv[i + 1];
+        else if (std::strcmp(argv[i], "--search-threads") == 0) search_threads = std::stoul(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--port") == 0) port = std::stoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--shard-urls") == 0) {
+            std::stringstream urls(argv[i + 1]);
+            for (std::string url; std::getline(urls, url, ',');) {
+                if (!url.empty()) shard_urls.push_back(url);
+            }
+        }
+        else { std::cerr << "Unknown option " << argv[i] << std::endl; return 1; }
+    }
+    if (!shard_urls.empty()) return run_coordinator(shard_urls, port);
+
+    // Кэш ответов: ключ - нормализованный запрос и все параметры, влияющие на выдачу.
+    ShardedLruCache<std::string> result_cache(cache_mb << 20, std::chrono::seconds(cache_ttl));
+    SearchEngine::ConjunctionCache conjunction_cache(conjunction_cache_mb << 20, std::chrono::seconds(cache_ttl));
+
+    // Поток запроса тоже ищет по своей части сегментов, поэтому рабочих на один меньше.
+    ThreadPool search_pool(search_threads > 1 ? search_threads - 1 : 0);
+
+    // Исходный индекс (или его шарды) и сегменты, дописанные через /documents (index.manifest).
+    LiveIndex::Options live_options;
+    live_options.refresh_interval = std::chrono::milliseconds(refresh_ms);
+    live_options.merge_factor = merge_factor;
+    if (conjunction_cache_mb > 0) live_options.conjunction_cache = &conjunction_cache;
+    if (search_threads > 1) live_options.search_pool = &search_pool;
+    auto load_index = [&](uint64_t epoch) {
+        auto start = std::chrono::steady_clock::now();
+        auto loaded = std::make_shared<LoadedIndex>();
+        loaded->index = std::make_unique<LiveIndex>(index_name, live_options);
+        loaded->epoch = epoch;
+        loaded->loaded_at = std::chrono::system_clock::now();
+        loaded->load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return loaded;
+    };
     std::cout << "Loading index..." << std::endl;
-    try { index.load("index"); } 
-    catch (...) { std::cerr << "Error!" << std::endl; return 1; }
-    
-    const auto& forward_index = index.get_forward_index();
-    SearchEngine engine(index);
+    std::atomic<std::shared_ptr<LoadedIndex>> current;
+    try { current.store(load_index(0)); }
+    catch (const std::exception& e) { std::cerr << "Error! " << e.what() << std::endl; return 1; }
+
+    // Ключ кэша: загрузка индекса, поколение снимка, нормализованный запрос и все
+    // параметры, влияющие на выдачу. После refresh и перезагрузки ключи меняются,
+    // старые ответы вытесняются LRU.
+    auto result_key = [&](const LoadedIndex& loaded, const LiveIndex::Snapshot& snapshot, const std::string& mode,
+                          const std::string& query, double k1, double b, double w_title, size_t limit, size_t offset,
+                          size_t budget, bool explain) {
+        char params[128];
+        std::snprintf(params, sizeof(params), "|%.6g|%.6g|%.6g|%zu|%zu|%zu|%d",
+                      k1, b, w_title, limit, offset, budget, explain ? 1 : 0);
+        return std::to_string(loaded.epoch) + '.' + std::to_string(snapshot.generation()) + '|' + mode + '|' +
+               snapshot.normalize_query(query) + params;
+    };
+    auto run_search = [](const LiveIndex::Snapshot& snapshot, const SearchRequest& q) {
+        if (q.mode == "or") return snapshot.search_ranked_or(q.query, q.limit, q.offset, q.k1, q.b, q.w_title);
+        if (q.mode == "saat") {
+            return snapshot.search_impacts(q.query, q.limit, q.offset, q.k1, q.b, q.w_title, q.budget);
+        }
+        return snapshot.search_top_k(q.query, q.limit, q.offset, q.k1, q.b, q.w_title);
+    };
+    auto fetch_documents = [&](const LiveIndex::Snapshot& snapshot, const ScoredDocs& hits) {
+        std::vector<Document> docs;
+        for (const auto& hit : hits) {
+            if (auto doc = snapshot.document(hit.id)) docs.push_back(std::move(*doc));
+        }
+        return docs;
+    };
+    auto document_json = [](const Document& d) {
+        return json{{"id", d.id}, {"title", d.title}, {"plot_snippet", utf8_truncate(d.plot, 300) + "..."}};
+    };
+    auto documents_json = [&](const std::vector<Document>& docs) {
+        json j = json::array();
+        for (const auto& d : docs) j.push_back(document_json(d));
+        return j;
+    };
+    auto dump = [](const json& j) { return j.dump(-1, ' ', false, json::error_handler_t::replace); };
+
+    QueryMetrics metrics;
+    std::mutex slow_log_mutex;
+    std::ofstream slow_log_file;
+    if (!slow_query_log.empty()) {
+        slow_log_file.open(slow_query_log, std::ios::app);
+        if (!slow_log_file.is_open()) { std::cerr << "Cannot open " << slow_query_log << std::endl; return 1; }
+    }
+    std::ostream& slow_log = slow_query_log.empty() ? std::cerr : slow_log_file;
+    auto log_slow_query = [&](const QueryTrace& trace, uint64_t total_ns, const std::string& mode,
+                              const std::string& query, int status) {
+        std::string line = "slow query " + std::to_string(total_ns / 1e6) + " ms status=" + std::to_string(status) +
+                           " mode=" + (mode.empty() ? "top_k" : mode);
+        for (size_t s = 0; s < kNumStages; ++s) {
+            line += ' ';
+            line += stage_name(static_cast<Stage>(s));
+            line += '=' + std::to_string(trace.stage_ns[s] / 1e6);
+        }
+        line += " postings=" + std::to_string(trace.postings) + " scored=" + std::to_string(trace.scored) +
+                " results=" + std::to_string(trace.results) + " q=" + json(query).dump(-1, ' ', false,
+                                                                                      json::error_handler_t::replace);
+        std::lock_guard lock(slow_log_mutex);
+        slow_log << line << std::endl;
+    };
+
+    // Перезагрузка индекса. Новая версия загружается и прогревается в фоне, пока
+    // запросы идут по старой, затем публикуется атомарно. Запись в коллекцию
+    // закрывается на время загрузки (/documents отвечает 503), чтобы старый и
+    // новый LiveIndex не писали манифест одновременно.
+    RecentQueries recent_queries(warmup_queries);
+    std::mutex reload_mutex;
+    std::atomic<bool> reloading{false};
+    std::atomic<uint64_t> reloads{0};
+    std::mutex error_mutex;
+    std::string last_error;  // под error_mutex; пусто - последняя загрузка удалась
+    auto set_error = [&](std::string error) {
+        if (!error.empty()) std::cerr << "Reload failed: " << error << std::endl;
+        std::lock_guard lock(error_mutex);
+        last_error = std::move(error);
+    };
+    auto reload = [&](const std::string& reason) -> bool {
+        std::lock_guard lock(reload_mutex);
+        reloading = true;
+        auto old = current.load();
+        std::cout << "Reloading index (" << reason << ")..." << std::endl;
+        try {
+            // Пока новые файлы не читаются (индексатор ещё пишет их), старая версия
+            // продолжает работать как ни в чём не бывало.
+            auto shards = Index::shards(index_name);
+            if (shards.empty()) shards.push_back("");
+            for (const auto& shard : shards) {
+                Index probe;
+                probe.load(shard.empty() ? index_name : index_name + "." + shard);
+            }
+        } catch (const std::exception& e) {
+            set_error(e.what());
+            reloading = false;
+            return false;
+        }
+        old->index->close();
+        std::shared_ptr<LoadedIndex> fresh;
+        try {
+            fresh = load_index(old->epoch + 1);
+        } catch (const std::exception& e) {
+            // Новая версия не открылась (например, битый манифест): старая снова
+            // принимает изменения, иначе /documents отвечал бы 503 до следующей
+            // удачной перезагрузки.
+            old->index->reopen();
+            set_error(e.what());
+            reloading = false;
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto snapshot = fresh->index->snapshot();
+        try {
+            for (const auto& q : recent_queries.list()) {
+                fetch_documents(*snapshot, run_search(*snapshot, q));
+                ++fresh->warmup_queries;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Warm-up failed: " << e.what() << std::endl;
+        }
+        fresh->warmup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        current.store(fresh);
+        ++reloads;
+        set_error({});
+        std::cout << "Index version " << fresh->index->base_version() << " loaded in " << fresh->load_ms
+                  << " ms, warmed up with " << fresh->warmup_queries << " queries in " << fresh->warmup_ms << " ms"
+                  << std::endl;
+        reloading = false;
+        return true;
+    };
+
+    // Фоновая проверка index.version и SIGHUP.
+    std::signal(SIGHUP, [](int) { reload_signal = 1; });
+    std::atomic<bool> stop_watcher{false};
+    std::thread watcher([&] {
+        uint64_t failed_version = 0;
+        auto retry_delay = std::chrono::milliseconds(watch_ms);
+        auto retry_at = std::chrono::steady_clock::now();
+        auto next_check = std::chrono::steady_clock::now();
+        while (!stop_watcher) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (reload_signal) {
+                reload_signal = 0;
+                reload("SIGHUP");
+            }
+            if (watch_ms == 0 || std::chrono::steady_clock::now() < next_check) continue;
+            next_check = std::chrono::steady_clock::now() + std::chrono::milliseconds(watch_ms);
+            uint64_t version = 0;
+            try { version = Index::version(index_name); } catch (...) { continue; }
+            if (version == current.load()->index->base_version()) continue;
+            // Неудачную версию пробуем снова всё реже (до минуты): файлы могли
+            // дописать или починить, не меняя версию.
+            if (version == failed_version && std::chrono::steady_clock::now() < retry_at) continue;
+            if (reload("index.version " + std::to_string(version))) {
+                failed_version = 0;
+                continue;
+            }
+            retry_delay = version == failed_version
+                              ? std::min<std::chrono::milliseconds>(retry_delay * 2, std::chrono::minutes(1))
+                              : std::chrono::milliseconds(watch_ms);
+            failed_version = version;
+            retry_at = std::chrono::steady_clock::now() + retry_delay;
+        }
+    });
+
     httplib::Server svr;
     
     svr.set_read_timeout(5, 0);
@@ -39,33 +499,294 @@ int main() {
 
     svr.Get("/search", [&](const auto& req, auto& res) {
         if (!req.has_param("q")) return;
-        std::string query = req.get_param_value("q");
-        
-        double k1 = 1.2;
-        double b = 0.75;
-        double w_title = 5.0;
+        SearchRequest request = parse_search_request(req);
+        const auto& [mode, query, k1, b, w_title, limit, offset, budget] = request;
+        bool explain = req.has_param("explain") && req.get_param_value("explain") != "0";
+        QueryTrace trace;
+        int status = 200;
+        try {
+            auto loaded = current.load();
+            auto snapshot = loaded->index->snapshot();
+            std::string cache_key =
+                result_key(*loaded, *snapshot, mode, query, k1, b, w_title, limit, offset, budget, explain);
+            recent_queries.add(request);
+            auto cached = result_cache.get(cache_key);
+            trace.mark_stage(Stage::Cache);
+            if (cached) {
+                res.set_content(*cached, "application/json");
+                metrics.record_cache_hit(trace.total_ns());
+                return;
+            }
+
+            ScoredDocs hits = run_search(*snapshot, request);
+            trace.results = hits.size();
+            auto docs = fetch_documents(*snapshot, hits);
+            trace.mark_stage(Stage::Fetch);
+            std::string plan;
+            // explain=1: вместе с выдачей возвращается план булевой части запроса.
+            if (explain) {
+                plan = snapshot->explain(query);
+                trace.mark_stage(Stage::Evaluate);
+            }
+            json j = documents_json(docs);
+            if (explain) j = json{{"plan", plan}, {"results", j}};
+            std::string body = dump(j);
+            trace.mark_stage(Stage::Serialize);
+            result_cache.put(cache_key, body, body.size());
+            res.set_content(body, "application/json");
+        } catch (...) {
+            res.status = status = 500;
+            metrics.record_error();
+        }
+        uint64_t total_ns = trace.total_ns();
+        metrics.record(trace, total_ns);
+        if (slow_query_ms > 0 && total_ns >= slow_query_ms * 1e6) log_slow_query(trace, total_ns, mode, query, status);
+    });
+
+    // Пачка запросов за один HTTP-запрос. Тело:
+    //   {"queries": ["q1", {"q": "q2", "limit": 5, "offset": 10}, ...],
+    //    "k1": 1.2, "b": 0.75, "w_title": 5.0, "limit": 20, "offset": 0}
+    // Ответ - массив выдач в порядке queries, каждая в формате /search; он уходит
+    // chunked-кусками по мере выполнения запросов, без сборки общего JSON. Кэш
+    // ответов общий с /search.
+    svr.Post("/search/batch", [&](const auto& req, auto& res) {
+        try {
+            json body = json::parse(req.body);
+            double k1 = body.value("k1", 1.2);
+            double b = body.value("b", 0.75);
+            double w_title = body.value("w_title", 5.0);
+            size_t limit = std::min<size_t>(body.value("limit", size_t{20}), 1000);
+            size_t offset = body.value("offset", size_t{0});
+
+            std::vector<SearchEngine::BatchQuery> queries;
+            for (const auto& item : body.at("queries")) {
+                if (item.is_string()) queries.push_back({item.get<std::string>(), limit, offset});
+                else queries.push_back({item.at("q").get<std::string>(),
+                                        std::min<size_t>(item.value("limit", limit), 1000),
+                                        item.value("offset", offset)});
+            }
+
+            // Запросы выполняются группами прямо в content provider: выдачи группы
+            // уходят клиенту, пока следующая ещё не посчитана, так что ни первый байт,
+            // ни память не ждут всей пачки. Снимок один на всю пачку.
+            constexpr size_t kBatchGroup = 64;
+            auto loaded = current.load();
+            auto snapshot = loaded->index->snapshot();
+            auto batch = std::make_shared<const std::vector<SearchEngine::BatchQuery>>(std::move(queries));
+            res.set_chunked_content_provider(
+                "application/json",
+                [&, loaded, snapshot, batch, k1, b, w_title, next = size_t{0}](size_t, httplib::DataSink& sink) mutable {
+                    try {
+                        size_t end = std::min(next + kBatchGroup, batch->size());
+                        std::vector<std::string> results(end - next);
+                        std::vector<std::string> keys(end - next);
+                        std::vector<size_t> missing;
+                        std::vector<SearchEngine::BatchQuery> to_run;
+                        for (size_t i = 0; i < results.size(); ++i) {
+                            const auto& query = (*batch)[next + i];
+                            keys[i] = result_key(*loaded, *snapshot, "", query.query, k1, b, w_title, query.k,
+                                                 query.offset, 0, false);
+                            if (auto cached = result_cache.get(keys[i])) {
+                                results[i] = std::move(*cached);
+                            } else {
+                                missing.push_back(i);
+                                to_run.push_back(query);
+                            }
+                        }
+                        auto hits = snapshot->search_batch(to_run, k1, b, w_title);
+                        for (size_t m = 0; m < missing.size(); ++m) {
+                            size_t i = missing[m];
+                            results[i] = dump(documents_json(fetch_documents(*snapshot, hits[m])));
+                            result_cache.put(keys[i], results[i], results[i].size());
+                        }
+
+                        std::string chunk = next == 0 ? "[" : "";
+                        for (size_t i = 0; i < results.size(); ++i) {
+                            if (next + i > 0) chunk += ',';
+                            chunk += results[i];
+                        }
+                        next = end;
+                        if (next == batch->size()) chunk += ']';
+                        if (!sink.write(chunk.data(), chunk.size())) return false;
+                        if (next == batch->size()) sink.done();
+                        return true;
+                    } catch (...) {
+                        // Заголовки уже ушли: остаётся оборвать ответ.
+                        return false;
+                    }
+                });
+        } catch (const json::exception&) {
+            res.status = 400;
+        } catch (...) { res.status = 500; }
+    });
+
+    // Изменение коллекции. POST /documents, тело - документ или массив документов:
+    //   {"title": "...", "plot": "...", "id": 123}
+    // id необязателен: без него документ получает новый DocId, с ним - заменяет
+    // документ с этим DocId. Ответ - {"ids": [...]}. DELETE /documents/{id} удаляет
+    // документ (404, если его нет). Изменения видны поиску после ближайшего refresh
+    // (--refresh-ms); с параметром refresh=1 запрос дожидается refresh сам.
+    svr.Post("/documents", [&](const auto& req, auto& res) {
+        try {
+            json body = json::parse(req.body);
+            json items = body.is_array() ? body : json::array({body});
+            // Сначала проверка всех документов, чтобы ошибка не оставила пачку применённой наполовину.
+            for (const auto& item : items) {
+                item.at("title").template get<std::string>();
+                item.value("plot", std::string());
+                // get<DocId> молча обрезает большие и отрицательные числа.
+                if (item.contains("id") && !(item.at("id").is_number_unsigned() &&
+                                             item.at("id").template get<uint64_t>() <= LiveIndex::kMaxDocId)) {
+                    res.status = 400;
+                    return;
+                }
+            }
+            auto loaded = current.load();
+            json ids = json::array();
+            for (const auto& item : items) {
+                std::optional<DocId> id;
+                if (item.contains("id")) id = item.at("id").template get<DocId>();
+                ids.push_back(loaded->index->add_document(item.at("title").template get<std::string>(),
+                                                          item.value("plot", std::string()), id));
+            }
+            if (req.has_param("refresh") && req.get_param_value("refresh") != "0") loaded->index->refresh();
+            res.set_content(json{{"ids", ids}}.dump(), "application/json");
+        } catch (const json::exception&) {
+            res.status = 400;
+        } catch (const std::runtime_error&) {
+            // Версия индекса как раз подменяется (LiveIndex закрыт) - стоит повторить.
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+        } catch (...) { res.status = 500; }
+    });
 
-        if (req.has_param("k1")) try { k1 = std::stod(req.get_param_value("k1")); } catch(...) {}
-        if (req.has_param("b")) try { b = std::stod(req.get_param_value("b")); } catch(...) {}
-        if (req.has_param("w_title")) try { w_title = std::stod(req.get_param_value("w_title")); } catch(...) {}
+    // Шард распределённой коллекции (см. run_coordinator). /shard/search: тело -
+    // {"q", "mode", "k1", "b", "w_title", "limit", "budget", "stats"}, где stats -
+    // сумма ответов /shard/stats всех шардов; ответ - выдача /search со score.
+    svr.Post("/shard/stats", [&](const auto& req, auto& res) {
+        try {
+            json body = json::parse(req.body);
+            auto snapshot = current.load()->index->snapshot();
+            res.set_content(dump(shard_stats_json(*snapshot, body.at("q").template get<std::string>())),
+                            "application/json");
+        } catch (const json::exception&) {
+            res.status = 400;
+        } catch (...) { res.status = 500; }
+    });
 
+    svr.Post("/shard/search", [&](const auto& req, auto& res) {
         try {
-            auto ids = engine.search(query, k1, b, w_title);
+            json body = json::parse(req.body);
+            SearchRequest request{body.value("mode", std::string()), body.at("q").template get<std::string>(),
+                                  body.value("k1", 1.2), body.value("b", 0.75), body.value("w_title", 5.0),
+                                  body.value("limit", size_t{20}), 0, body.value("budget", size_t{0})};
+            auto snapshot = current.load()->index->snapshot();
+            LiveIndex::Snapshot view(*snapshot, collection_stats_from_json(body.at("stats")));
             json j = json::array();
-            size_t cnt = 0;
-            for (auto id : ids) {
-                if (cnt++ >= 20) break;
-                if (id < forward_index.size()) {
-                    const auto& d = forward_index.get_document(id);
-                    std::string snip = utf8_truncate(d.plot, 300) + "...";
-                    j.push_back({{"id", id}, {"title", d.title}, {"plot_snippet", snip}});
+            for (const auto& hit : run_search(view, request)) {
+                if (auto doc = view.document(hit.id)) {
+                    json item = document_json(*doc);
+                    item["score"] = hit.score;
+                    j.push_back(std::move(item));
                 }
             }
-            res.set_content(j.dump(-1, ' ', false, json::error_handler_t::replace), "application/json");
+            res.set_content(dump(j), "application/json");
+        } catch (const json::exception&) {
+            res.status = 400;
         } catch (...) { res.status = 500; }
     });
 
-    svr.listen("0.0.0.0", 8080);
+    svr.Get(R"(/documents/(\d+))", [&](const auto& req, auto& res) {
+        try {
+            auto doc = current.load()->index->snapshot()->document(parse_doc_id(req.matches[1].str()));
+            if (!doc) { res.status = 404; return; }
+            res.set_content(dump({{"id", doc->id}, {"title", doc->title}, {"plot", doc->plot}}), "application/json");
+        } catch (...) { res.status = 400; }
+    });
+
+    svr.Delete(R"(/documents/(\d+))", [&](const auto& req, auto& res) {
+        try {
+            auto loaded = current.load();
+            if (!loaded->index->delete_document(parse_doc_id(req.matches[1].str()))) {
+                res.status = 404;
+                return;
+            }
+            if (req.has_param("refresh") && req.get_param_value("refresh") != "0") loaded->index->refresh();
+            res.set_content(R"({"deleted":true})", "application/json");
+        } catch (const std::runtime_error&) {
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+        } catch (...) { res.status = 400; }
+    });
+
+    // Метрики в текстовом формате Prometheus: задержки /search по этапам,
+    // счётчики запросов и кэшей, версия индекса.
+    svr.Get("/metrics", [&](const auto&, auto& res) {
+        std::string out = metrics.prometheus();
+        const std::pair<const char*, CacheStats> caches[] = {{"results", result_cache.stats()},
+                                                             {"conjunctions", conjunction_cache.stats()}};
+        const std::tuple<const char*, const char*, uint64_t CacheStats::*> fields[] = {
+            {"search_cache_hits_total", "counter", &CacheStats::hits},
+            {"search_cache_misses_total", "counter", &CacheStats::misses},
+            {"search_cache_insertions_total", "counter", &CacheStats::insertions},
+            {"search_cache_evictions_total", "counter", &CacheStats::evictions},
+            {"search_cache_expirations_total", "counter", &CacheStats::expirations},
+            {"search_cache_entries", "gauge", &CacheStats::entries},
+            {"search_cache_bytes", "gauge", &CacheStats::bytes}};
+        for (const auto& [name, type, field] : fields) {
+            out += std::string("# TYPE ") + name + ' ' + type + '\n';
+            for (const auto& [cache, stats] : caches) {
+                out += std::string(name) + "{cache=\"" + cache + "\"} " + std::to_string(stats.*field) + '\n';
+            }
+        }
+        auto loaded = current.load();
+        out += "# TYPE search_index_version gauge\nsearch_index_version " +
+               std::to_string(loaded->index->base_version()) + '\n';
+        out += "# TYPE search_index_documents gauge\nsearch_index_documents " +
+               std::to_string(loaded->index->snapshot()->num_docs()) + '\n';
+        out += "# TYPE search_index_reloads_total counter\nsearch_index_reloads_total " +
+               std::to_string(reloads.load()) + '\n';
+        res.set_content(out, "text/plain; version=0.0.4");
+    });
+
+    // Состояние индекса: версия, время и длительность загрузки, прогрев.
+    auto index_status = [&] {
+        auto loaded = current.load();
+        auto snapshot = loaded->index->snapshot();
+        json j = {{"version", loaded->index->base_version()},
+                  {"loaded_at", iso_time(loaded->loaded_at)},
+                  {"load_ms", loaded->load_ms},
+                  {"warmup_ms", loaded->warmup_ms},
+                  {"warmup_queries", loaded->warmup_queries},
+                  {"reloads", reloads.load()},
+                  {"reloading", reloading.load()},
+                  {"documents", snapshot->num_docs()},
+                  {"segments", snapshot->segments().size()},
+                  {"generation", snapshot->generation()}};
+        std::lock_guard lock(error_mutex);
+        if (!last_error.empty()) j["last_error"] = last_error;
+        return j;
+    };
+
+    svr.Get("/admin/index", [&](const auto&, auto& res) {
+        res.set_content(dump(index_status()), "application/json");
+    });
+
+    // Перезагрузка по запросу; ответ - после публикации новой версии (или ошибки).
+    svr.Post("/admin/reload", [&](const auto&, auto& res) {
+        if (!reload("/admin/reload")) res.status = 500;
+        res.set_content(dump(index_status()), "application/json");
+    });
+
+    svr.Get("/cache/stats", [&](const auto&, auto& res) {
+        json j = {{"results", cache_stats_json(result_cache.stats())},
+                  {"conjunctions", cache_stats_json(conjunction_cache.stats())}};
+        res.set_content(j.dump(), "application/json");
+    });
+
+    svr.listen("0.0.0.0", port);
+    stop_watcher = true;
+    watcher.join();
     return 0;
 }
 